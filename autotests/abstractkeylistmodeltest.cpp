@@ -12,8 +12,12 @@
 
 #include <Libkleo/KeyGroup>
 #include <Libkleo/KeyListModel>
+#include <Libkleo/KeyListSortFilterProxyModel>
 
+#include <QAbstractItemModelTester>
+#include <QRegularExpression>
 #include <QSet>
+#include <QSignalSpy>
 #include <QTest>
 
 #include <gpgme++/key.h>
@@ -27,19 +31,54 @@ Q_DECLARE_METATYPE(KeyGroup)
 
 namespace
 {
-Key createTestKey(const char *uid)
+Key createTestKey(const char *uid, const QByteArray &fpr = {})
 {
     static int count = 0;
     count++;
 
     gpgme_key_t key;
     gpgme_key_from_uid(&key, uid);
-    const QByteArray fingerprint = QByteArray::number(count, 16).rightJustified(40, '0');
+    const QByteArray fingerprint = fpr.isEmpty() ? QByteArray::number(count, 16).rightJustified(40, '0') : fpr;
     key->fpr = strdup(fingerprint.constData());
 
     return Key(key, false);
 }
 
+// creates a key which can be used as remark key
+Key createRemarkKey(const char *keyID)
+{
+    gpgme_key_t key;
+    gpgme_key_from_uid(&key, "remarks@example.net");
+    key->fpr = strdup(QByteArray{keyID}.rightJustified(40, '0').constData());
+    auto subkey = static_cast<gpgme_subkey_t>(calloc(1, sizeof(*key->subkeys)));
+    qstrncpy(subkey->_keyid, keyID, sizeof(subkey->_keyid));
+    subkey->keyid = subkey->_keyid;
+    key->subkeys = subkey;
+    key->_last_subkey = subkey;
+    return Key(key, false);
+}
+
+// creates a key which has been listed with the remark @p remark made with the remark key with key ID @p keyID
+Key createKeyWithRemark(const char *uid, const char *keyID, const char *remark)
+{
+    gpgme_key_t key;
+    gpgme_key_from_uid(&key, uid);
+    key->fpr = strdup(QByteArray(40, 'F').constData());
+    key->keylist_mode = GPGME_KEYLIST_MODE_SIGS | GPGME_KEYLIST_MODE_SIG_NOTATIONS;
+    auto signature = static_cast<gpgme_key_sig_t>(calloc(1, sizeof(*key->uids->signatures)));
+    auto notation = static_cast<gpgme_sig_notation_t>(calloc(1, sizeof(*signature->notations)));
+    notation->name = strdup("rem@gnupg.org");
+    notation->name_len = qstrlen(notation->name);
+    notation->value = strdup(remark);
+    notation->value_len = qstrlen(notation->value);
+    qstrncpy(signature->_keyid, keyID, sizeof(signature->_keyid));
+    signature->keyid = signature->_keyid;
+    signature->notations = notation;
+    key->uids->signatures = signature;
+    key->uids->_last_keysig = signature;
+    return Key(key, false);
+}
+
 KeyGroup createGroup(const QString &name,
                      const std::vector<Key> &keys = std::vector<Key>(),
                      KeyGroup::Source source = KeyGroup::ApplicationConfig,
@@ -103,6 +142,62 @@ void AbstractKeyListModelTest::testSetGroups()
     QVERIFY(!model->index(groups[0]).isValid());
 }
 
+void AbstractKeyListModelTest::testAddKeys()
+{
+    QScopedPointer<AbstractKeyListModel> model(createModel());
+
+    std::vector<Key> keys;
+    for (int i = 0; i < 6; ++i) {
+        keys.push_back(createTestKey("test@example.net"));
+    }
+    model->setKeys({keys[0], keys[3], keys[5]});
+
+    const auto indexes = model->addKeys({keys[4], keys[1], keys[3], keys[2], keys[1]});
+    QCOMPARE(indexes.size(), 5);
+    QCOMPARE(model->rowCount(), 6);
+    for (int row = 0; row < 6; ++row) {
+        QCOMPARE(model->key(model->index(keys[row])).primaryFingerprint(), keys[row].primaryFingerprint());
+    }
+}
+
+void AbstractKeyListModelTest::testAddManyInterleavedKeys()
+{
+    QScopedPointer<AbstractKeyListModel> model(createModel());
+
+    std::vector<Key> keys;
+    for (int i = 0; i < 100; ++i) {
+        keys.push_back(createTestKey("test@example.net"));
+    }
+    std::vector<Key> evenKeys;
+    std::vector<Key> oddKeys;
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        (i % 2 == 0 ? evenKeys : oddKeys).push_back(keys[i]);
+    }
+    model->setKeys(evenKeys);
+
+    // checks that the model announces the changes of the rows correctly
+    QAbstractItemModelTester tester(model.data(), QAbstractItemModelTester::FailureReportingMode::QtTest);
+    model->addKeys(oddKeys);
+    QCOMPARE(model->rowCount(), 100);
+    for (const Key &key : keys) {
+        QCOMPARE(model->key(model->index(key)).primaryFingerprint(), key.primaryFingerprint());
+    }
+}
+
+void AbstractKeyListModelTest::testDataOfUpdatedKey()
+{
+    QScopedPointer<AbstractKeyListModel> model(createModel());
+
+    const Key key = createTestKey("Alice <test@example.net>");
+    model->setKeys({key});
+    QCOMPARE(model->data(model->index(key, KeyList::PrettyName)).toString(), QStringLiteral("Alice"));
+
+    const Key updatedKey = createTestKey("Bob <test@example.net>", key.primaryFingerprint());
+    model->addKeys({updatedKey});
+    QCOMPARE(model->rowCount(), 1);
+    QCOMPARE(model->data(model->index(key, KeyList::PrettyName)).toString(), QStringLiteral("Bob"));
+}
+
 void AbstractKeyListModelTest::testKeys()
 {
     QScopedPointer<AbstractKeyListModel> model(createModel());
@@ -283,4 +378,138 @@ void AbstractKeyListModelTest::testClear()
     QCOMPARE(model->rowCount(), 0);
 }
 
+void AbstractKeyListModelTest::testAsyncFiltering()
+{
+    QScopedPointer<AbstractKeyListModel> model(createModel());
+    model->setKeys({
+        createTestKey("alice@example.net"),
+        createTestKey("bob@example.net"),
+        createTestKey("carol@example.org"),
+    });
+    model->setGroups({
+        createGroup(QStringLiteral("Example.net")),
+    });
+    KeyListSortFilterProxyModel proxy;
+    proxy.setSourceModel(model.data());
+    QSignalSpy spy(&proxy, &KeyListSortFilterProxyModel::filteringFinished);
+
+    proxy.setFilterFixedStringAsync(QStringLiteral("EXAMPLE.NET"));
+    // the rows are updated when all rows have been matched
+    QCOMPARE(proxy.rowCount(), 4);
+    QVERIFY(spy.wait());
+    QCOMPARE(proxy.rowCount(), 3);
+    QCOMPARE(proxy.filterRegularExpression().pattern(), QRegularExpression::escape(QStringLiteral("EXAMPLE.NET")));
+
+    // rows added while the filter is matched are matched as well
+    proxy.setFilterFixedStringAsync(QStringLiteral("example.org"));
+    model->addKey(createTestKey("dave@example.org"));
+    QVERIFY(spy.wait());
+    QCOMPARE(proxy.rowCount(), 2);
+}
+
+void AbstractKeyListModelTest::testRefiningFilter()
+{
+    QScopedPointer<AbstractKeyListModel> model(createModel());
+    model->setKeys({
+        createTestKey("alice@example.net"),
+        createTestKey("bob@example.net"),
+        createTestKey("carol@example.org"),
+    });
+    KeyListSortFilterProxyModel proxy;
+    proxy.setSourceModel(model.data());
+    QSignalSpy spy(&proxy, &KeyListSortFilterProxyModel::filteringFinished);
+
+    proxy.setFilterFixedStringAsync(QStringLiteral("example"));
+    QVERIFY(spy.wait());
+    QCOMPARE(proxy.rowCount(), 3);
+
+    // only the rows matching the previous text are matched against the longer text
+    proxy.setFilterFixedStringAsync(QStringLiteral("example.net"));
+    QVERIFY(spy.wait());
+    QCOMPARE(proxy.rowCount(), 2);
+    proxy.setFilterFixedString(QStringLiteral("bob@example.net"));
+    QCOMPARE(proxy.rowCount(), 1);
+
+    // a text which does not contain the previous text is matched against all rows
+    proxy.setFilterFixedStringAsync(QStringLiteral("carol"));
+    QVERIFY(spy.wait());
+    QCOMPARE(proxy.rowCount(), 1);
+    proxy.setFilterFixedString(QStringLiteral("example"));
+    QCOMPARE(proxy.rowCount(), 3);
+}
+
+void AbstractKeyListModelTest::testFilteringBySearchText()
+{
+    QScopedPointer<AbstractKeyListModel> model(createModel());
+    const Key key = createTestKey("Alice <Alice@Example.net>");
+    model->setKeys({key, createTestKey("bob@example.net")});
+    QCOMPARE(model->index(key).data(KeyList::SearchTextRole).toString(), QStringLiteral("alice <alice@example.net>"));
+
+    KeyListSortFilterProxyModel proxy;
+    proxy.setSourceModel(model.data());
+    proxy.setFilterFixedString(QStringLiteral("ALICE@EXAMPLE"));
+    QCOMPARE(proxy.rowCount(), 1);
+    proxy.setFilterFixedString(QStringLiteral("alice.example"));
+    QCOMPARE(proxy.rowCount(), 0);
+    // filters which are not literal are matched against the user IDs
+    proxy.setFilterRegularExpression(QRegularExpression{QStringLiteral("alice.example"), QRegularExpression::CaseInsensitiveOption});
+    QCOMPARE(proxy.rowCount(), 1);
+}
+
+void AbstractKeyListModelTest::testFilteringByRemarks()
+{
+    QScopedPointer<AbstractKeyListModel> model(createModel());
+    const Key keyWithRemark = createKeyWithRemark("alice@example.net", "0123456789ABCDEF", "Tag");
+    // the remarks of this key have not been loaded
+    const Key otherKey = createTestKey("bob@example.net");
+    model->setKeys({keyWithRemark, otherKey});
+    model->setRemarkKeys({createRemarkKey("0123456789ABCDEF")});
+
+    QCOMPARE(model->index(keyWithRemark, KeyList::Remarks).data(KeyList::RemarksRole).toString(), QStringLiteral("Tag"));
+    // the role does not return a placeholder for remarks which have not been loaded
+    QVERIFY(model->index(otherKey, KeyList::Remarks).data(KeyList::RemarksRole).isNull());
+    QVERIFY(!model->index(otherKey, KeyList::Remarks).data().isNull());
+
+    KeyListSortFilterProxyModel proxy;
+    proxy.setSourceModel(model.data());
+    proxy.setFilterFixedString(QStringLiteral("tag"));
+    QCOMPARE(proxy.rowCount(), 1);
+    proxy.setFilterRegularExpression(QRegularExpression{QStringLiteral("t.g"), QRegularExpression::CaseInsensitiveOption});
+    QCOMPARE(proxy.rowCount(), 1);
+    // the placeholder shown while the remarks are loaded is not matched
+    proxy.setFilterFixedString(QStringLiteral("Load"));
+    QCOMPARE(proxy.rowCount(), 0);
+    proxy.setFilterRegularExpression(QRegularExpression{QStringLiteral("Lo.d")});
+    QCOMPARE(proxy.rowCount(), 0);
+
+    QSignalSpy spy(&proxy, &KeyListSortFilterProxyModel::filteringFinished);
+    proxy.setFilterFixedStringAsync(QStringLiteral("TAG"));
+    QVERIFY(spy.wait());
+    QCOMPARE(proxy.rowCount(), 1);
+}
+
+void AbstractKeyListModelTest::testSorting()
+{
+    QScopedPointer<AbstractKeyListModel> model(createModel());
+    model->setKeys({
+        createTestKey("bob <bob@example.net>"),
+        createTestKey("Alice <alice@example.net>"),
+        createTestKey("carol <carol@example.net>"),
+    });
+    KeyListSortFilterProxyModel proxy;
+    proxy.setSourceModel(model.data());
+    proxy.setSortCaseSensitivity(Qt::CaseInsensitive);
+    proxy.sort(KeyList::PrettyName);
+    QCOMPARE(proxy.index(0, KeyList::PrettyName).data().toString(), QStringLiteral("Alice"));
+    QCOMPARE(proxy.index(1, KeyList::PrettyName).data().toString(), QStringLiteral("bob"));
+    QCOMPARE(proxy.index(2, KeyList::PrettyName).data().toString(), QStringLiteral("carol"));
+
+    // rows added later are sorted with the prepared values of the other rows
+    model->addKey(createTestKey("Bert <bert@example.net>"));
+    QCOMPARE(proxy.index(1, KeyList::PrettyName).data().toString(), QStringLiteral("Bert"));
+
+    proxy.sort(KeyList::PrettyName, Qt::DescendingOrder);
+    QCOMPARE(proxy.index(0, KeyList::PrettyName).data().toString(), QStringLiteral("carol"));
+}
+
 #include "moc_abstractkeylistmodeltest.cpp"
@@ -24,6 +24,9 @@ private Q_SLOTS:
     void testCreation();
     void testSetKeys();
     void testSetGroups();
+    void testAddKeys();
+    void testAddManyInterleavedKeys();
+    void testDataOfUpdatedKey();
     void testKeys();
     void testIndex();
     void testIndexForGroup();
@@ -31,6 +34,11 @@ private Q_SLOTS:
     void testSetData();
     void testRemoveGroup();
     void testClear();
+    void testAsyncFiltering();
+    void testRefiningFilter();
+    void testFilteringBySearchText();
+    void testFilteringByRemarks();
+    void testSorting();
 
 private:
     virtual Kleo::AbstractKeyListModel *createModel() = 0;
@@ -0,0 +1,282 @@
+/*
+    This file is part of libkleopatra's test suite.
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <Libkleo/Compliance>
+#include <Libkleo/DefaultKeyFilter>
+#include <Libkleo/KeyCache>
+#include <Libkleo/Test>
+
+#include <QObject>
+#include <QTest>
+
+#include <gpgme++/key.h>
+
+#include <gpgme.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+using namespace Kleo;
+using namespace GpgME;
+
+namespace
+{
+using Setter = void (DefaultKeyFilter::*)(const DefaultKeyFilter::TriState);
+
+// a criterion of DefaultKeyFilter together with the check of the criterion
+// as it was done before the key states were introduced
+struct Criterion {
+    const char *name;
+    Setter setter;
+    std::function<bool(const Key &)> property;
+};
+
+bool isCardKey(const Key &key)
+{
+    const auto subkeys = key.subkeys();
+    return std::any_of(subkeys.begin(), subkeys.end(), std::mem_fn(&Subkey::isCardKey));
+}
+
+const std::vector<Criterion> &criteria()
+{
+    static const std::vector<Criterion> criteria = {
+        {"Revoked", &DefaultKeyFilter::setRevoked, std::mem_fn(&Key::isRevoked)},
+        {"Expired", &DefaultKeyFilter::setExpired, std::mem_fn(&Key::isExpired)},
+        {"Invalid", &DefaultKeyFilter::setInvalid, std::mem_fn(&Key::isInvalid)},
+        {"Disabled", &DefaultKeyFilter::setDisabled, std::mem_fn(&Key::isDisabled)},
+        {"Root", &DefaultKeyFilter::setRoot, std::mem_fn(&Key::isRoot)},
+        {"CanEncrypt", &DefaultKeyFilter::setCanEncrypt, std::mem_fn(&Key::canEncrypt)},
+        {"CanSign", &DefaultKeyFilter::setCanSign, std::mem_fn(&Key::canSign)},
+        {"CanCertify", &DefaultKeyFilter::setCanCertify, std::mem_fn(&Key::canCertify)},
+        {"CanAuthenticate", &DefaultKeyFilter::setCanAuthenticate, std::mem_fn(&Key::canAuthenticate)},
+        {"HasEncrypt", &DefaultKeyFilter::setHasEncrypt, std::mem_fn(&Key::hasEncrypt)},
+        {"HasSign", &DefaultKeyFilter::setHasSign, std::mem_fn(&Key::hasSign)},
+        {"HasCertify", &DefaultKeyFilter::setHasCertify, std::mem_fn(&Key::hasCertify)},
+        {"HasAuthenticate", &DefaultKeyFilter::setHasAuthenticate, std::mem_fn(&Key::hasAuthenticate)},
+        {"Qualified", &DefaultKeyFilter::setQualified, std::mem_fn(&Key::isQualified)},
+        {"CardKey", &DefaultKeyFilter::setCardKey, isCardKey},
+        {"HasSecret", &DefaultKeyFilter::setHasSecret, std::mem_fn(&Key::hasSecret)},
+        {"IsOpenPGP",
+         &DefaultKeyFilter::setIsOpenPGP,
+         [](const Key &key) {
+             return key.protocol() == GpgME::OpenPGP;
+         }},
+        {"WasValidated",
+         &DefaultKeyFilter::setWasValidated,
+         [](const Key &key) {
+             return bool(key.keyListMode() & GpgME::Validate);
+         }},
+        {"IsDeVs", &DefaultKeyFilter::setIsDeVs, DeVSCompliance::keyIsCompliant},
+        {"Bad",
+         &DefaultKeyFilter::setIsBad,
+         [](const Key &key) {
+             return key.isNull() || key.isRevoked() || key.isExpired() || key.isDisabled() || key.isInvalid();
+         }},
+    };
+    return criteria;
+}
+
+// creates a key with the fingerprint @p fingerprint modified by @p modify
+Key createTestKey(const char *fingerprint, const std::function<void(gpgme_key_t)> &modify)
+{
+    gpgme_key_t key;
+    gpgme_key_from_uid(&key, "test@example.net");
+    key->fpr = strdup(fingerprint);
+    key->protocol = GPGME_PROTOCOL_OpenPGP;
+    auto subkey = static_cast<gpgme_subkey_t>(calloc(1, sizeof(*key->subkeys)));
+    subkey->keyid = subkey->_keyid;
+    key->subkeys = subkey;
+    key->_last_subkey = subkey;
+    modify(key);
+    return Key(key, false);
+}
+
+std::vector<Key> createTestKeys()
+{
+    const std::vector<std::function<void(gpgme_key_t)>> modifications = {
+        [](gpgme_key_t) {},
+        [](gpgme_key_t key) {
+            key->revoked = 1;
+        },
+        [](gpgme_key_t key) {
+            key->expired = 1;
+        },
+        [](gpgme_key_t key) {
+            key->invalid = 1;
+        },
+        [](gpgme_key_t key) {
+            key->disabled = 1;
+        },
+        [](gpgme_key_t key) {
+            key->protocol = GPGME_PROTOCOL_CMS;
+            key->subkeys->fpr = strdup(key->fpr);
+            key->chain_id = strdup(key->fpr);
+        },
+        [](gpgme_key_t key) {
+            key->can_encrypt = key->has_encrypt = 1;
+            key->can_sign = key->has_sign = 1;
+        },
+        [](gpgme_key_t key) {
+            key->can_certify = key->has_certify = 1;
+            key->can_authenticate = key->has_authenticate = 1;
+            key->secret = 1;
+        },
+        [](gpgme_key_t key) {
+            key->has_encrypt = 1;
+            key->is_qualified = 1;
+        },
+        [](gpgme_key_t key) {
+            key->subkeys->is_cardkey = 1;
+            key->secret = 1;
+        },
+        [](gpgme_key_t key) {
+            key->keylist_mode = GPGME_KEYLIST_MODE_VALIDATE;
+            key->subkeys->is_de_vs = 1;
+        },
+        [](gpgme_key_t key) {
+            key->keylist_mode = GPGME_KEYLIST_MODE_VALIDATE;
+            key->revoked = 1;
+            key->subkeys->is_cardkey = 1;
+        },
+    };
+    std::vector<Key> keys;
+    for (std::size_t i = 0; i < modifications.size(); ++i) {
+        const std::string fingerprint = std::string(38, '0') + char('A' + i / 10) + char('0' + i % 10);
+        keys.push_back(createTestKey(fingerprint.c_str(), modifications[i]));
+    }
+    return keys;
+}
+
+bool matchesLikeBefore(const std::vector<std::pair<const Criterion *, DefaultKeyFilter::TriState>> &setCriteria, const Key &key)
+{
+    return std::all_of(setCriteria.begin(), setCriteria.end(), [&key](const auto &criterion) {
+        return criterion.first->property(key) == (criterion.second == DefaultKeyFilter::Set);
+    });
+}
+}
+
+class DefaultKeyFilterTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase()
+    {
+        mKeys = createTestKeys();
+    }
+
+    void test_single_criteria_match_like_before()
+    {
+        compareSingleCriteria();
+    }
+
+    void test_single_criteria_match_like_before_for_keys_of_the_key_cache()
+    {
+        // the key cache computes the states of its keys in advance
+        const auto keyCache = KeyCache::mutableInstance();
+        keyCache->setKeys(mKeys);
+        compareSingleCriteria();
+        keyCache->setKeys({});
+    }
+
+    void test_combined_criteria_match_like_before()
+    {
+        const auto keyCache = KeyCache::mutableInstance();
+        for (const bool inKeyCache : {false, true}) {
+            keyCache->setKeys(inKeyCache ? mKeys : std::vector<Key>{});
+            for (const Criterion &first : criteria()) {
+                for (const Criterion &second : criteria()) {
+                    if (&first == &second) {
+                        continue;
+                    }
+                    for (const auto firstState : {DefaultKeyFilter::Set, DefaultKeyFilter::NotSet}) {
+                        for (const auto secondState : {DefaultKeyFilter::Set, DefaultKeyFilter::NotSet}) {
+                            DefaultKeyFilter filter;
+                            (filter.*first.setter)(firstState);
+                            (filter.*second.setter)(secondState);
+                            for (const Key &key : mKeys) {
+                                QVERIFY2(filter.matches(key, KeyFilter::Filtering) == matchesLikeBefore({{&first, firstState}, {&second, secondState}}, key),
+                                         qPrintable(QStringLiteral("%1 and %2 for key %3")
+                                                        .arg(QLatin1StringView{first.name},
+                                                             QLatin1StringView{second.name},
+                                                             QLatin1StringView{key.primaryFingerprint()})));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        keyCache->setKeys({});
+    }
+
+    void test_isdevs_criterion_follows_changes_of_the_compliance_mode()
+    {
+        const auto keyCache = KeyCache::mutableInstance();
+        keyCache->setKeys(mKeys);
+        DefaultKeyFilter filter;
+        filter.setIsDeVs(DefaultKeyFilter::Set);
+        const auto compareWithCompliance = [this, &filter]() {
+            for (const Key &key : mKeys) {
+                QCOMPARE(filter.matches(key, KeyFilter::Filtering), DeVSCompliance::keyIsCompliant(key));
+            }
+        };
+        {
+            Tests::FakeCryptoConfigStringValue fakeCompliance{"gpg", "compliance", QStringLiteral("de-vs")};
+            compareWithCompliance();
+            // the key without the Validate key list mode is not compliant
+            QVERIFY(!filter.matches(mKeys[0], KeyFilter::Filtering));
+        }
+        {
+            Tests::FakeCryptoConfigStringValue fakeCompliance{"gpg", "compliance", QStringLiteral("")};
+            // all keys are compliant if the compliance mode is not active
+            for (const Key &key : mKeys) {
+                QVERIFY(filter.matches(key, KeyFilter::Filtering));
+            }
+        }
+        {
+            Tests::FakeCryptoConfigStringValue fakeCompliance{"gpg", "compliance", QStringLiteral("de-vs")};
+            compareWithCompliance();
+        }
+        keyCache->setKeys({});
+    }
+
+    void test_criterion_which_does_not_matter_is_ignored()
+    {
+        DefaultKeyFilter filter;
+        filter.setRevoked(DefaultKeyFilter::Set);
+        filter.setRevoked(DefaultKeyFilter::DoesNotMatter);
+        for (const Key &key : mKeys) {
+            QVERIFY(filter.matches(key, KeyFilter::Filtering));
+        }
+    }
+
+private:
+    void compareSingleCriteria()
+    {
+        for (const Criterion &criterion : criteria()) {
+            for (const auto state : {DefaultKeyFilter::Set, DefaultKeyFilter::NotSet}) {
+                DefaultKeyFilter filter;
+                (filter.*criterion.setter)(state);
+                for (const Key &key : mKeys) {
+                    QVERIFY2(filter.matches(key, KeyFilter::Filtering) == matchesLikeBefore({{&criterion, state}}, key),
+                             qPrintable(QStringLiteral("%1 %2 for key %3")
+                                            .arg(QLatin1StringView{criterion.name},
+                                                 state == DefaultKeyFilter::Set ? QStringLiteral("set") : QStringLiteral("not set"),
+                                                 QLatin1StringView{key.primaryFingerprint()})));
+                }
+            }
+        }
+    }
+
+private:
+    std::vector<Key> mKeys;
+};
+
+QTEST_MAIN(DefaultKeyFilterTest)
+#include "defaultkeyfiltertest.moc"
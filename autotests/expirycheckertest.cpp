@@ -16,12 +16,15 @@
 #include <Libkleo/KeyCache>
 
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QProcess>
 #include <QRegularExpression>
 #include <QSignalSpy>
 #include <QTemporaryDir>
 #include <QTest>
 
+#include <algorithm>
+
 using namespace Kleo;
 using namespace GpgME;
 
@@ -59,6 +62,35 @@ private:
     qint64 mCurrentTime;
 };
 
+class RunningTimeProvider : public Kleo::TimeProvider
+{
+public:
+    explicit RunningTimeProvider(const QDateTime &startTime)
+        : mStartTime{startTime.toSecsSinceEpoch()}
+    {
+        mElapsedTimer.start();
+    }
+
+    qint64 currentTime() const override
+    {
+        return mStartTime + mElapsedTimer.elapsed() / 1000;
+    }
+
+    QDate currentDate() const override
+    {
+        return QDateTime::fromSecsSinceEpoch(currentTime(), timeZone()).date();
+    }
+
+    QTimeZone timeZone() const override
+    {
+        return QTimeZone{QTimeZone::UTC};
+    }
+
+private:
+    qint64 mStartTime;
+    QElapsedTimer mElapsedTimer;
+};
+
 class ExpiryCheckerTest : public QObject
 {
     Q_OBJECT
@@ -661,6 +693,95 @@ private Q_SLOTS:
         }
     }
 
+    void checkKeys()
+    {
+        const auto certificate = testKey("9E99817D12280C9677674430492EDA1DCE2E4C63", GpgME::CMS);
+        const auto issuer = testKey("3193786A48BDF2D4D20B8FC6501F4DE8BE231B05", GpgME::CMS);
+        const auto notExpiringKey = testKey("test@kolab.org", GpgME::OpenPGP);
+        const ExpiryChecker::CheckFlags checkFlags = ExpiryChecker::CertificationKey | ExpiryChecker::CheckChain;
+
+        ExpiryChecker checker(ExpiryCheckerSettings{days{1}, days{10}, days{10}, days{10}});
+        // 5 days before expiration date of the certificate and 336 days after expiration date of the issuer certificate
+        checker.setTimeProviderForTest(std::make_shared<FakeTimeProvider>(QDateTime{{2020, 5, 25}, {}, QTimeZone::UTC}));
+        QSignalSpy spy(&checker, &ExpiryChecker::expiryMessage);
+        const auto report = checker.checkKeys({certificate, Key{}, notExpiringKey, issuer}, checkFlags, ExpiryChecker::Execution::Parallel);
+        QCOMPARE(spy.count(), 0);
+
+        // both certificates are affected by the expired issuer certificate; the expired certificate comes first
+        QCOMPARE(report.size(), 2);
+        QCOMPARE(report[0].expiration.certificate, issuer);
+        QCOMPARE(report[1].expiration.certificate, certificate);
+        for (const auto &result : report) {
+            const auto expected = checker.checkKey(result.expiration.certificate, checkFlags);
+            QCOMPARE(result.checkFlags, expected.checkFlags);
+            QCOMPARE(result.expiration.status, expected.expiration.status);
+            QCOMPARE(result.expiration.duration, expected.expiration.duration);
+            QCOMPARE(result.chainExpiration.size(), expected.chainExpiration.size());
+            for (std::size_t i = 0; i < result.chainExpiration.size(); ++i) {
+                QCOMPARE(result.chainExpiration[i].certificate, expected.chainExpiration[i].certificate);
+                QCOMPARE(result.chainExpiration[i].status, expected.chainExpiration[i].status);
+                QCOMPARE(result.chainExpiration[i].duration, expected.chainExpiration[i].duration);
+            }
+        }
+        QCOMPARE(report[1].expiration.status, ExpiryChecker::ExpiresSoon);
+        QCOMPARE(report[1].chainExpiration.size(), 1);
+        QCOMPARE(report[1].chainExpiration[0].status, ExpiryChecker::Expired);
+    }
+
+    void watchKeyCache()
+    {
+        ExpiryChecker checker(ExpiryCheckerSettings{days{1}, days{10}, days{10}, days{10}});
+        // 1 second before expiration date of the certificate 9E99817D12280C9677674430492EDA1DCE2E4C63
+        checker.setTimeProviderForTest(std::make_shared<RunningTimeProvider>(QDateTime{{2020, 5, 30}, {10, 48, 37}, QTimeZone::UTC}));
+        QSignalSpy spy(&checker, &ExpiryChecker::expiryMessage);
+        checker.startWatchingKeyCache(ExpiryChecker::CertificationKey | ExpiryChecker::CheckChain);
+        QCOMPARE(spy.count(), 0);
+
+        QVERIFY(spy.wait(5000));
+        const auto it = std::find_if(spy.cbegin(), spy.cend(), [](const QList<QVariant> &arguments) {
+            return arguments.at(0).value<GpgME::Key>().keyID() == QByteArray{"492EDA1DCE2E4C63"};
+        });
+        QVERIFY(it != spy.cend());
+        const auto info = it->at(2).value<ExpiryChecker::ExpiryInformation>();
+        QVERIFY(info == ExpiryChecker::OwnKeyExpired || info == ExpiryChecker::OtherKeyExpired);
+        QVERIFY(it->at(1).toString().contains(QStringLiteral("expired less than a day ago")));
+
+        checker.stopWatchingKeyCache();
+    }
+
+    void watchKeyCacheUpdatesChangedKeys()
+    {
+        const auto key = testKey("expires@example.net", GpgME::OpenPGP);
+        QVERIFY(!key.isNull());
+        const auto hasMessageForKey = [&key](const QSignalSpy &spy) {
+            return std::any_of(spy.cbegin(), spy.cend(), [&key](const QList<QVariant> &arguments) {
+                return arguments.at(0).value<GpgME::Key>().primaryFingerprint() == QByteArrayView{key.primaryFingerprint()};
+            });
+        };
+        const qint64 expirationTime = key.subkey(0).expirationTime();
+        {
+            // a removed key is no longer watched
+            ExpiryChecker checker(ExpiryCheckerSettings{days{1}, days{1}, days{1}, days{1}});
+            checker.setTimeProviderForTest(std::make_shared<RunningTimeProvider>(QDateTime::fromSecsSinceEpoch(expirationTime - 1, QTimeZone::UTC)));
+            QSignalSpy spy(&checker, &ExpiryChecker::expiryMessage);
+            checker.startWatchingKeyCache(ExpiryChecker::SigningKey);
+            KeyCache::mutableInstance()->remove(key);
+            (void)spy.wait(2500);
+            QVERIFY(!hasMessageForKey(spy));
+            checker.stopWatchingKeyCache();
+        }
+        {
+            // an inserted key is watched
+            ExpiryChecker checker(ExpiryCheckerSettings{days{1}, days{1}, days{1}, days{1}});
+            checker.setTimeProviderForTest(std::make_shared<RunningTimeProvider>(QDateTime::fromSecsSinceEpoch(expirationTime - 1, QTimeZone::UTC)));
+            QSignalSpy spy(&checker, &ExpiryChecker::expiryMessage);
+            checker.startWatchingKeyCache(ExpiryChecker::SigningKey);
+            KeyCache::mutableInstance()->insert(key);
+            QTRY_VERIFY_WITH_TIMEOUT(hasMessageForKey(spy), 5000);
+            checker.stopWatchingKeyCache();
+        }
+    }
+
     void noSuitableSubkey_data()
     {
         QTest::addColumn<GpgME::Key>("key");
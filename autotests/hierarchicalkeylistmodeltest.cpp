@@ -14,12 +14,65 @@
 
 #include <QTest>
 
+#include <gpgme++/key.h>
+
+#include <gpgme.h>
+
 using namespace Kleo;
+using namespace GpgME;
+
+namespace
+{
+Key createTestCertificate(const char *fingerprint, const char *issuerFingerprint)
+{
+    gpgme_key_t key;
+    gpgme_key_from_uid(&key, "CN=Test");
+    key->protocol = GPGME_PROTOCOL_CMS;
+    key->fpr = strdup(fingerprint);
+    key->chain_id = strdup(issuerFingerprint);
+    return Key(key, false);
+}
+}
 
 class HierarchicalKeyListModelTest : public AbstractKeyListModelTest
 {
     Q_OBJECT
 
+private Q_SLOTS:
+    void testChildrenAddedBeforeTheirIssuers()
+    {
+        QScopedPointer<AbstractKeyListModel> model(createModel());
+        const Key root = createTestCertificate("1000000000000000000000000000000000000000", "1000000000000000000000000000000000000000");
+        const Key intermediate = createTestCertificate("2000000000000000000000000000000000000000", "1000000000000000000000000000000000000000");
+        const Key leaf = createTestCertificate("3000000000000000000000000000000000000000", "2000000000000000000000000000000000000000");
+
+        model->addKeys({leaf});
+        model->addKeys({intermediate});
+        QCOMPARE(model->rowCount(), 1);
+        model->addKeys({root});
+        QCOMPARE(model->rowCount(), 1);
+        QCOMPARE(model->index(leaf).parent(), model->index(intermediate));
+        QCOMPARE(model->index(intermediate).parent(), model->index(root));
+
+        // refreshing a certificate keeps the tree
+        model->addKeys({intermediate});
+        QCOMPARE(model->rowCount(), 1);
+        QCOMPARE(model->rowCount(model->index(root)), 1);
+        QCOMPARE(model->index(leaf).parent(), model->index(intermediate));
+    }
+
+    void testIssuerCycleIsBroken()
+    {
+        QScopedPointer<AbstractKeyListModel> model(createModel());
+        const Key key1 = createTestCertificate("A000000000000000000000000000000000000000", "B000000000000000000000000000000000000000");
+        const Key key2 = createTestCertificate("B000000000000000000000000000000000000000", "A000000000000000000000000000000000000000");
+
+        model->addKeys({key1, key2});
+        QVERIFY(model->index(key1).isValid());
+        QVERIFY(model->index(key2).isValid());
+        QCOMPARE(model->rowCount(), 1);
+    }
+
 private:
     AbstractKeyListModel *createModel() override
     {
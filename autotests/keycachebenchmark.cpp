@@ -0,0 +1,103 @@
+/*
+    This file is part of libkleopatra's test suite.
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <Libkleo/KeyCache>
+#include <Libkleo/Predicates>
+
+#include <QObject>
+#include <QTest>
+
+#include <gpgme++/global.h>
+#include <gpgme++/key.h>
+
+#include <gpgme.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Kleo;
+using namespace GpgME;
+
+namespace
+{
+constexpr int numberOfKeys = 20000;
+
+Key createTestKey(const char *uid, const char *fingerprint)
+{
+    gpgme_key_t key;
+    gpgme_key_from_uid(&key, uid);
+    key->fpr = strdup(fingerprint);
+    return Key(key, false);
+}
+}
+
+class KeyCacheBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase()
+    {
+        GpgME::initializeLibrary();
+
+        // fingerprints which differ in the first and in the last bytes to avoid a bias towards either lookup
+        for (int i = 0; i < numberOfKeys; ++i) {
+            char fingerprint[41];
+            std::snprintf(fingerprint, sizeof(fingerprint), "%08X%024X%08X", unsigned(i) * 2654435761u, 0u, unsigned(i));
+            const std::string uid = "test" + std::to_string(i) + "@example.net";
+            mKeys.push_back(createTestKey(uid.c_str(), fingerprint));
+            mFingerprints.emplace_back(fingerprint);
+        }
+        std::shuffle(mFingerprints.begin(), mFingerprints.end(), std::mt19937{42});
+
+        mSortedKeys = mKeys;
+        _detail::sort_by_fpr(mSortedKeys);
+
+        KeyCache::mutableInstance()->setKeys(mKeys);
+    }
+
+    void cleanupTestCase()
+    {
+        KeyCache::mutableInstance()->setKeys({});
+    }
+
+    void benchmarkFindByFingerprintInSortedVector()
+    {
+        int found = 0;
+        QBENCHMARK {
+            found = 0;
+            for (const auto &fpr : mFingerprints) {
+                const auto it = std::lower_bound(mSortedKeys.begin(), mSortedKeys.end(), fpr.c_str(), _detail::ByFingerprint<std::less>());
+                found += (it != mSortedKeys.end() && _detail::ByFingerprint<std::equal_to>()(*it, fpr.c_str()));
+            }
+        }
+        QCOMPARE(found, numberOfKeys);
+    }
+
+    void benchmarkFindByFingerprintInKeyCache()
+    {
+        const auto keyCache = KeyCache::instance();
+        int found = 0;
+        QBENCHMARK {
+            found = 0;
+            for (const auto &fpr : mFingerprints) {
+                found += !keyCache->findByFingerprint(fpr.c_str()).isNull();
+            }
+        }
+        QCOMPARE(found, numberOfKeys);
+    }
+
+private:
+    std::vector<Key> mKeys;
+    std::vector<Key> mSortedKeys;
+    std::vector<std::string> mFingerprints;
+};
+
+QTEST_MAIN(KeyCacheBenchmark)
+#include "keycachebenchmark.moc"
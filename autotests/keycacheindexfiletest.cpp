@@ -0,0 +1,175 @@
+/*
+    This file is part of libkleopatra's test suite.
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "models/keycacheindexfile_p.h"
+
+#include <QFile>
+#include <QObject>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <memory>
+
+using namespace Kleo;
+
+namespace
+{
+const char *const openpgpFpr = "1111111111111111111111111111111111111111";
+const char *const cmsFpr = "2222222222222222222222222222222222222222";
+
+bool writeTestFile(const QString &fileName)
+{
+    KeyCacheIndexFile::Writer writer;
+    const quint32 openpgpKey = writer.addKey(openpgpFpr, GpgME::OpenPGP);
+    writer.addEntry(KeyCacheIndexFile::Fingerprint, openpgpFpr, openpgpKey);
+    writer.addEntry(KeyCacheIndexFile::KeyID, "1111111111111111", openpgpKey);
+    writer.addEntry(KeyCacheIndexFile::EMail, "test@example.net", openpgpKey);
+    writer.addEntry(KeyCacheIndexFile::KeyGrip, "ABCDEF0123456789ABCDEF0123456789ABCDEF01", openpgpKey);
+    const quint32 cmsKey = writer.addKey(cmsFpr, GpgME::CMS);
+    writer.addEntry(KeyCacheIndexFile::Fingerprint, cmsFpr, cmsKey);
+    writer.addEntry(KeyCacheIndexFile::EMail, "test@example.net", cmsKey);
+    return writer.write(fileName);
+}
+
+// overwrites the bytes at @p offset of the file @p fileName with @p bytes
+bool patchFile(const QString &fileName, qint64 offset, const QByteArray &bytes)
+{
+    QFile file{fileName};
+    return file.open(QIODevice::ReadWrite) && file.seek(offset) && file.write(bytes) == bytes.size();
+}
+}
+
+class KeyCacheIndexFileTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init()
+    {
+        mTempDir = std::make_unique<QTemporaryDir>();
+        QVERIFY(mTempDir->isValid());
+        mFileName = mTempDir->filePath(QStringLiteral("keycache.idx"));
+    }
+
+    void cleanup()
+    {
+        mTempDir.reset();
+    }
+
+    void test_written_file_can_be_opened_and_searched()
+    {
+        QVERIFY(writeTestFile(mFileName));
+
+        KeyCacheIndexFile indexFile;
+        QVERIFY(indexFile.open(mFileName));
+        QVERIFY(indexFile.isOpen());
+
+        // fingerprints are compared case-insensitively
+        auto refs = indexFile.find(KeyCacheIndexFile::Fingerprint, QByteArray{openpgpFpr}.toLower().toStdString());
+        QCOMPARE(refs.size(), 1);
+        QCOMPARE(refs[0].fingerprint, QByteArray{openpgpFpr});
+        QCOMPARE(refs[0].protocol, GpgME::OpenPGP);
+
+        refs = indexFile.find(KeyCacheIndexFile::KeyID, "1111111111111111");
+        QCOMPARE(refs.size(), 1);
+        QCOMPARE(refs[0].fingerprint, QByteArray{openpgpFpr});
+
+        refs = indexFile.find(KeyCacheIndexFile::KeyGrip, "abcdef0123456789abcdef0123456789abcdef01");
+        QCOMPARE(refs.size(), 1);
+
+        refs = indexFile.find(KeyCacheIndexFile::EMail, "Test@Example.net");
+        QCOMPARE(refs.size(), 2);
+        QCOMPARE(refs[0].protocol == GpgME::CMS ? refs[1].protocol : refs[0].protocol, GpgME::OpenPGP);
+
+        // the values of one index are not found in another index
+        QVERIFY(indexFile.find(KeyCacheIndexFile::SubkeyID, "1111111111111111").empty());
+
+        indexFile.close();
+        QVERIFY(!indexFile.isOpen());
+        QVERIFY(indexFile.find(KeyCacheIndexFile::Fingerprint, openpgpFpr).empty());
+    }
+
+    void test_keys_missing_in_stale_file_are_not_found()
+    {
+        QVERIFY(writeTestFile(mFileName));
+
+        KeyCacheIndexFile indexFile;
+        QVERIFY(indexFile.open(mFileName));
+
+        QVERIFY(indexFile.find(KeyCacheIndexFile::Fingerprint, "3333333333333333333333333333333333333333").empty());
+        QVERIFY(indexFile.find(KeyCacheIndexFile::EMail, "new@example.net").empty());
+        QVERIFY(indexFile.find(KeyCacheIndexFile::Fingerprint, "").empty());
+    }
+
+    void test_empty_index_can_be_written_and_opened()
+    {
+        QVERIFY(KeyCacheIndexFile::Writer{}.write(mFileName));
+
+        KeyCacheIndexFile indexFile;
+        QVERIFY(indexFile.open(mFileName));
+        QVERIFY(indexFile.find(KeyCacheIndexFile::Fingerprint, openpgpFpr).empty());
+    }
+
+    void test_missing_file_is_rejected()
+    {
+        KeyCacheIndexFile indexFile;
+        QVERIFY(!indexFile.open(mFileName));
+        QVERIFY(!indexFile.isOpen());
+    }
+
+    void test_truncated_file_is_rejected()
+    {
+        QVERIFY(writeTestFile(mFileName));
+        QFile file{mFileName};
+        QVERIFY(file.resize(file.size() - 1));
+
+        KeyCacheIndexFile indexFile;
+        QVERIFY(!indexFile.open(mFileName));
+        QVERIFY(!indexFile.isOpen());
+
+        // a file which is too short for the header
+        QVERIFY(file.resize(10));
+        QVERIFY(!indexFile.open(mFileName));
+    }
+
+    void test_file_with_bad_magic_is_rejected()
+    {
+        QVERIFY(writeTestFile(mFileName));
+        QVERIFY(patchFile(mFileName, 0, "XLEO"));
+
+        KeyCacheIndexFile indexFile;
+        QVERIFY(!indexFile.open(mFileName));
+    }
+
+    void test_file_with_other_version_is_rejected()
+    {
+        QVERIFY(writeTestFile(mFileName));
+        // the version follows the 8 bytes of the magic
+        const quint32 version = 2;
+        QVERIFY(patchFile(mFileName, 8, QByteArray(reinterpret_cast<const char *>(&version), sizeof(version))));
+
+        KeyCacheIndexFile indexFile;
+        QVERIFY(!indexFile.open(mFileName));
+    }
+
+    void test_opening_invalid_file_closes_previous_file()
+    {
+        QVERIFY(writeTestFile(mFileName));
+        KeyCacheIndexFile indexFile;
+        QVERIFY(indexFile.open(mFileName));
+
+        QVERIFY(!indexFile.open(mTempDir->filePath(QStringLiteral("missing.idx"))));
+        QVERIFY(!indexFile.isOpen());
+        QVERIFY(indexFile.find(KeyCacheIndexFile::Fingerprint, openpgpFpr).empty());
+    }
+
+private:
+    std::unique_ptr<QTemporaryDir> mTempDir;
+    QString mFileName;
+};
+
+QTEST_MAIN(KeyCacheIndexFileTest)
+#include "keycacheindexfiletest.moc"
@@ -7,6 +7,10 @@
 */
 
 #include <Libkleo/KeyCache>
+#include <Libkleo/KeyCacheSnapshot>
+#include <Libkleo/KeyGroup>
+#include <Libkleo/KeySummary>
+#include <Libkleo/Predicates>
 
 #include <QGpgME/DataProvider>
 #include <QGpgME/Protocol>
@@ -21,7 +25,9 @@
 
 #include <gpgme.h>
 
+#include <algorithm>
 #include <memory>
+#include <thread>
 
 using namespace Kleo;
 using namespace GpgME;
@@ -93,6 +99,30 @@ static const char *clearsigned_using_signing_subkey_of_curve_448 =
 
 namespace
 {
+Key createTestKey(const char *uid, const char *fingerprint)
+{
+    gpgme_key_t key;
+    gpgme_key_from_uid(&key, uid);
+    key->fpr = strdup(fingerprint);
+    return Key(key, false);
+}
+
+Key createTestEncryptionKey(const char *uid, const char *fingerprint, unsigned long creationTime)
+{
+    gpgme_key_t key;
+    gpgme_key_from_uid(&key, uid);
+    key->fpr = strdup(fingerprint);
+    key->protocol = GPGME_PROTOCOL_OpenPGP;
+    key->can_encrypt = 1;
+    key->has_encrypt = 1;
+    auto subkey = static_cast<gpgme_subkey_t>(calloc(1, sizeof(*key->subkeys)));
+    subkey->keyid = subkey->_keyid;
+    subkey->can_encrypt = 1;
+    subkey->timestamp = creationTime;
+    key->subkeys = subkey;
+    key->_last_subkey = subkey;
+    return Key(key, false);
+}
 }
 
 class KeyCacheTest : public QObject
@@ -182,6 +212,203 @@ private Q_SLOTS:
         QVERIFY(std::string_view{keys.front().primaryFingerprint()} == key_v5_curve_448_fpr);
     }
 
+    void test_insert_and_remove_keep_indexes_consistent()
+    {
+        const auto keyCache = KeyCache::instance();
+        const Key key1 = createTestKey("test1@example.net", "1111111111111111111111111111111111111111");
+        const Key key2 = createTestKey("test2@example.net", "1111111122222222222222222222222222222222");
+        const Key key3 = createTestKey("test3@example.net", "3333333333333333333333333333333333333333");
+        KeyCache::mutableInstance()->setKeys({key3, key1});
+
+        QCOMPARE(keyCache->keys().size(), 2);
+        QVERIFY(std::string_view{keyCache->keys()[0].primaryFingerprint()} == key1.primaryFingerprint());
+        QVERIFY(keyCache->findByFingerprint(key2.primaryFingerprint()).isNull());
+
+        KeyCache::mutableInstance()->insert(key2);
+        QCOMPARE(keyCache->keys().size(), 3);
+        QVERIFY(std::string_view{keyCache->keys()[1].primaryFingerprint()} == key2.primaryFingerprint());
+        QVERIFY(std::string_view{keyCache->findByFingerprint(key2.primaryFingerprint()).primaryFingerprint()} == key2.primaryFingerprint());
+        QCOMPARE(keyCache->findByEMailAddress("TEST2@example.net").size(), 1);
+        QCOMPARE(keyCache->findByEMailAddress("test3@example.net").size(), 1);
+
+        KeyCache::mutableInstance()->remove(key1);
+        QCOMPARE(keyCache->keys().size(), 2);
+        QVERIFY(keyCache->findByFingerprint(key1.primaryFingerprint()).isNull());
+        QVERIFY(keyCache->findByEMailAddress("test1@example.net").empty());
+        QCOMPARE(keyCache->findByEMailAddress("test2@example.net").size(), 1);
+    }
+
+    void test_many_small_updates_keep_indexes_consistent()
+    {
+        const auto keyCache = KeyCache::instance();
+        const auto fingerprint = [](int i) {
+            return QByteArray::number(i).rightJustified(40, '0');
+        };
+        KeyCache::mutableInstance()->setKeys({});
+        // insert enough keys one by one so that the pending updates are merged a few times
+        for (int i = 0; i < 1000; ++i) {
+            KeyCache::mutableInstance()->insert(createTestKey("test@example.net", fingerprint(i).constData()));
+        }
+        for (int i = 0; i < 1000; i += 2) {
+            KeyCache::mutableInstance()->remove(keyCache->findByFingerprint(fingerprint(i).constData()));
+        }
+        KeyCache::mutableInstance()->insert(createTestKey("other@example.net", fingerprint(0).constData()));
+
+        QCOMPARE(keyCache->keys().size(), 501);
+        QVERIFY(std::is_sorted(keyCache->keys().begin(), keyCache->keys().end(), _detail::ByFingerprint<std::less>()));
+        QCOMPARE(keyCache->findByEMailAddress("test@example.net").size(), 500);
+        QCOMPARE(keyCache->findByEMailAddress("other@example.net").size(), 1);
+        QVERIFY(!keyCache->findByFingerprint(fingerprint(0).constData()).isNull());
+        QVERIFY(keyCache->findByFingerprint(fingerprint(2).constData()).isNull());
+        QVERIFY(!keyCache->findByFingerprint(fingerprint(999).constData()).isNull());
+    }
+
+    void test_findBestByMailBoxes_returns_same_keys_as_findBestByMailBox()
+    {
+        const auto keyCache = KeyCache::instance();
+        const Key olderKey = createTestEncryptionKey("alice@example.net", "1111111111111111111111111111111111111111", 1000);
+        const Key newerKey = createTestEncryptionKey("alice@example.net", "2222222222222222222222222222222222222222", 2000);
+        const Key otherKey = createTestEncryptionKey("bob@example.net", "3333333333333333333333333333333333333333", 1000);
+        KeyCache::mutableInstance()->setKeys({olderKey, newerKey, otherKey});
+
+        // use enough addresses so that the best keys are determined in chunks
+        const std::vector<std::string> someAddresses = {"bob@example.net", "<ALICE@example.net>", "unknown@example.net", "alice@example.net", ""};
+        std::vector<std::string> addresses;
+        for (int i = 0; i < 200; ++i) {
+            addresses.insert(addresses.end(), someAddresses.begin(), someAddresses.end());
+        }
+        const auto keys = keyCache->findBestByMailBoxes(addresses, GpgME::OpenPGP, KeyCache::KeyUsage::Encrypt);
+
+        QCOMPARE(keys.size(), addresses.size());
+        for (std::size_t i = 0; i < addresses.size(); ++i) {
+            const Key expected = keyCache->findBestByMailBox(addresses[i].c_str(), GpgME::OpenPGP, KeyCache::KeyUsage::Encrypt);
+            QCOMPARE(keys[i].primaryFingerprint(), expected.primaryFingerprint());
+        }
+        QCOMPARE(keys[0].primaryFingerprint(), otherKey.primaryFingerprint());
+        QCOMPARE(keys[1].primaryFingerprint(), newerKey.primaryFingerprint());
+        QVERIFY(keys[2].isNull());
+        QCOMPARE(keys[3].primaryFingerprint(), newerKey.primaryFingerprint());
+        QVERIFY(keys[4].isNull());
+    }
+
+    void test_groups_are_found_by_name_and_by_key()
+    {
+        const auto keyCache = KeyCache::instance();
+        const Key aliceKey = createTestEncryptionKey("alice@example.net", "1111111111111111111111111111111111111111", 1000);
+        const Key bobKey = createTestKey("bob@example.net", "2222222222222222222222222222222222222222");
+        KeyCache::mutableInstance()->setKeys({aliceKey, bobKey});
+        KeyCache::mutableInstance()->setGroups({
+            KeyGroup{QStringLiteral("group1"), QStringLiteral("team"), {aliceKey, bobKey}, KeyGroup::ApplicationConfig},
+            KeyGroup{QStringLiteral("group2"), QStringLiteral("team"), {aliceKey}, KeyGroup::ApplicationConfig},
+            KeyGroup{QStringLiteral("group3"), QStringLiteral("other"), {bobKey}, KeyGroup::ApplicationConfig},
+        });
+
+        QCOMPARE(keyCache->findGroup(QStringLiteral("team"), GpgME::UnknownProtocol, KeyCache::KeyUsage::Encrypt).id(), QStringLiteral("group2"));
+        QCOMPARE(keyCache->findGroup(QStringLiteral("team"), GpgME::OpenPGP, KeyCache::KeyUsage::Encrypt).id(), QStringLiteral("group2"));
+        QVERIFY(keyCache->findGroup(QStringLiteral("team"), GpgME::CMS, KeyCache::KeyUsage::Encrypt).isNull());
+        QVERIFY(keyCache->findGroup(QStringLiteral("unknown"), GpgME::UnknownProtocol, KeyCache::KeyUsage::Encrypt).isNull());
+        QCOMPARE(keyCache->getGroupKeys(QStringLiteral("team")).size(), 2);
+
+        const auto groups = keyCache->findGroupsContaining(bobKey);
+        QCOMPARE(groups.size(), 2);
+        QCOMPARE(groups[0].id(), QStringLiteral("group1"));
+        QCOMPARE(groups[1].id(), QStringLiteral("group3"));
+
+        // the groups are updated when their keys change
+        const Key updatedBobKey = createTestEncryptionKey("bob@example.net", "2222222222222222222222222222222222222222", 1000);
+        KeyCache::mutableInstance()->insert(updatedBobKey);
+        QCOMPARE(keyCache->findGroup(QStringLiteral("team"), GpgME::UnknownProtocol, KeyCache::KeyUsage::Encrypt).id(), QStringLiteral("group1"));
+        QVERIFY(keyCache->group(QStringLiteral("group3")).keys().begin()->hasEncrypt());
+    }
+
+    void test_async_queries_are_finished_if_cache_is_initialized()
+    {
+        const auto keyCache = KeyCache::instance();
+        const Key key1 = createTestKey("test1@example.net", "1111111111111111111111111111111111111111");
+        KeyCache::mutableInstance()->setKeys({key1});
+
+        QVERIFY(keyCache->whenReady().isFinished());
+        auto future = keyCache->findByKeyIDOrFingerprintAsync({"1111111111111111111111111111111111111111"});
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.result().size(), 1);
+        QCOMPARE(keyCache->findByEMailAddressAsync("test1@example.net").result().size(), 1);
+        QCOMPARE(keyCache->keysAsync().result().size(), 1);
+    }
+
+    void test_search_finds_prefixes_and_substrings()
+    {
+        const auto keyCache = KeyCache::instance();
+        const Key alice = createTestKey("Alice Example <alice@example.net>", "AAAA111111111111111111111111111111111111");
+        const Key bob = createTestKey("Bob <bob@example.org>", "BBBB222222222222222222222222222222222222");
+        KeyCache::mutableInstance()->setKeys({alice, bob});
+
+        QCOMPARE(keyCache->search(u"ALI", 10).size(), 1);
+        QVERIFY(std::string_view{keyCache->search(u"ali", 10).front().primaryFingerprint()} == alice.primaryFingerprint());
+        QCOMPARE(keyCache->search(u"example", 10).size(), 2);
+        QCOMPARE(keyCache->search(u"example", 1).size(), 1);
+        QCOMPARE(keyCache->search(u"@example.org", 10).size(), 1);
+        QCOMPARE(keyCache->search(u"bbbb22", 10).size(), 1);
+        QVERIFY(keyCache->search(u"xyz", 10).empty());
+
+        KeyCache::mutableInstance()->remove(bob);
+        QVERIFY(keyCache->search(u"bob", 10).empty());
+    }
+
+    void test_snapshot_can_be_queried_from_other_threads()
+    {
+        const auto keyCache = KeyCache::instance();
+        const Key key1 = createTestKey("test1@example.net", "1111111111111111111111111111111111111111");
+        const Key key2 = createTestKey("test2@example.net", "2222222222222222222222222222222222222222");
+        KeyCache::mutableInstance()->setKeys({key1});
+        const auto snapshot = keyCache->snapshot();
+
+        KeyCache::mutableInstance()->insert(key2);
+        QCOMPARE(snapshot->keys().size(), 1);
+        QCOMPARE(keyCache->snapshot()->keys().size(), 2);
+
+        std::vector<int> found(4, 0);
+        std::vector<std::thread> threads;
+        const auto latestSnapshot = keyCache->snapshot();
+        for (std::size_t i = 0; i < found.size(); ++i) {
+            threads.emplace_back([&latestSnapshot, &found, i]() {
+                found[i] = !latestSnapshot->findByFingerprint("2222222222222222222222222222222222222222").isNull()
+                    + latestSnapshot->findByEMailAddress("test1@example.net").size();
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        QCOMPARE(found, std::vector<int>(4, 2));
+    }
+
+    void test_light_mode_keeps_summaries_and_recently_used_keys()
+    {
+        const auto keyCache = KeyCache::instance();
+        const Key key1 = createTestKey("test1@example.net", "1111111111111111111111111111111111111111");
+        const Key key2 = createTestKey("test2@example.net", "2222222222222222222222222222222222222222");
+        const Key key3 = createTestKey("test3@example.net", "3333333333333333333333333333333333333333");
+        KeyCache::mutableInstance()->enableLightMode(true, 2);
+        KeyCache::mutableInstance()->setKeys({key1, key2, key3});
+
+        const auto summaries = keyCache->keySummaries();
+        QCOMPARE(summaries.size(), 3);
+        QCOMPARE(summaries[0].fingerprint, std::string{key1.primaryFingerprint()});
+        QCOMPARE(summaries[1].emails, std::vector<std::string>{"test2@example.net"});
+        // only the two most recently used keys are kept in full
+        QCOMPARE(keyCache->keys().size(), 2);
+        QVERIFY(std::string_view{keyCache->keys()[0].primaryFingerprint()} == key2.primaryFingerprint());
+        QCOMPARE(keyCache->findByEMailAddress("test3@example.net").size(), 1);
+
+        KeyCache::mutableInstance()->remove(key2);
+        QCOMPARE(keyCache->keySummaries().size(), 2);
+        QCOMPARE(keyCache->keys().size(), 1);
+
+        // restore the normal mode for the other tests; the reload triggered by it isn't needed
+        KeyCache::mutableInstance()->enableLightMode(false);
+        KeyCache::mutableInstance()->cancelKeyListing();
+        QVERIFY(!keyCache->lightModeEnabled());
+    }
+
 private:
     GpgME::Key keyCurve448;
 };
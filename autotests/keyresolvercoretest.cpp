@@ -1425,6 +1425,48 @@ private Q_SLOTS:
         QCOMPARE(result.solution.signingKeys[0].primaryFingerprint(), testKey("sender-mixed@example.net", CMS).primaryFingerprint());
     }
 
+    void test_resolved_keys_are_updated_after_keys_changed()
+    {
+        const Key key = testKey("sender-openpgp@example.net", OpenPGP);
+        {
+            KeyResolverCore resolver(/*encrypt=*/true, /*sign=*/false, OpenPGP);
+            resolver.setRecipients({"sender-openpgp@example.net"});
+            const auto result = resolver.resolve();
+            QCOMPARE(result.solution.encryptionKeys.value("sender-openpgp@example.net").size(), 1);
+        }
+
+        // removing a key and updating another key makes the key cache report both keys as changed
+        KeyCache::mutableInstance()->remove(key);
+        KeyCache::mutableInstance()->insert(testKey("sender-smime@example.net", CMS));
+
+        KeyResolverCore resolver(/*encrypt=*/true, /*sign=*/false, OpenPGP);
+        resolver.setRecipients({"sender-openpgp@example.net"});
+        const auto result = resolver.resolve();
+
+        QCOMPARE(result.flags & KeyResolverCore::ResolvedMask, KeyResolverCore::SomeUnresolved);
+        QCOMPARE(result.solution.encryptionKeys.value("sender-openpgp@example.net").size(), 0);
+    }
+
+    void test_resolved_keys_are_updated_after_keys_removed()
+    {
+        const Key key = testKey("sender-openpgp@example.net", OpenPGP);
+        {
+            KeyResolverCore resolver(/*encrypt=*/true, /*sign=*/false, OpenPGP);
+            resolver.setRecipients({"sender-openpgp@example.net"});
+            const auto result = resolver.resolve();
+            QCOMPARE(result.solution.encryptionKeys.value("sender-openpgp@example.net").size(), 1);
+        }
+
+        KeyCache::mutableInstance()->remove(key);
+
+        KeyResolverCore resolver(/*encrypt=*/true, /*sign=*/false, OpenPGP);
+        resolver.setRecipients({"sender-openpgp@example.net"});
+        const auto result = resolver.resolve();
+
+        QCOMPARE(result.flags & KeyResolverCore::ResolvedMask, KeyResolverCore::SomeUnresolved);
+        QCOMPARE(result.solution.encryptionKeys.value("sender-openpgp@example.net").size(), 0);
+    }
+
 private:
     Key testKey(const char *email, Protocol protocol = UnknownProtocol)
     {
@@ -14,12 +14,14 @@
 
 #include "defaultkeyfilter.h"
 #include "utils/compliance.h"
+#include "utils/keystate_p.h"
 
 #include <libkleo/compliance.h>
 #include <libkleo/formatting.h>
 #include <libkleo/keyhelpers.h>
 
 #include <functional>
+#include <utility>
 
 using namespace GpgME;
 using namespace Kleo;
@@ -37,6 +39,43 @@ public:
     {
     }
 
+    // compiles the tri-state criteria into a mask and the expected value of the masked key state
+    void updateStateMask()
+    {
+        const std::pair<TriState, KeyState::Flag> criteria[] = {
+            {mRevoked, KeyState::Revoked},
+            {mExpired, KeyState::Expired},
+            {mInvalid, KeyState::Invalid},
+            {mDisabled, KeyState::Disabled},
+            {mRoot, KeyState::Root},
+            {mCanEncrypt, KeyState::CanEncrypt},
+            {mCanSign, KeyState::CanSign},
+            {mCanCertify, KeyState::CanCertify},
+            {mCanAuthenticate, KeyState::CanAuthenticate},
+            {mHasEncrypt, KeyState::HasEncrypt},
+            {mHasSign, KeyState::HasSign},
+            {mHasCertify, KeyState::HasCertify},
+            {mHasAuthenticate, KeyState::HasAuthenticate},
+            {mQualified, KeyState::Qualified},
+            {mCardKey, KeyState::CardKey},
+            {mHasSecret, KeyState::HasSecret},
+            {mIsOpenPGP, KeyState::IsOpenPGP},
+            {mWasValidated, KeyState::WasValidated},
+            {mIsDeVs, KeyState::IsDeVs},
+            {mBad, KeyState::Bad},
+        };
+        mStateMask = 0;
+        mStateValue = 0;
+        for (const auto &[triState, flag] : criteria) {
+            if (triState != DoesNotMatter) {
+                mStateMask |= flag;
+                if (triState == Set) {
+                    mStateValue |= flag;
+                }
+            }
+        }
+    }
+
     QColor mFgColor;
     QColor mBgColor;
     QString mName;
@@ -77,6 +116,9 @@ public:
     GpgME::Key::OwnerTrust mOwnerTrustReferenceLevel = Key::OwnerTrust::Unknown;
     LevelState mValidity = LevelDoesNotMatter;
     GpgME::UserID::Validity mValidityReferenceLevel = UserID::Validity::Unknown;
+
+    quint32 mStateMask = 0;
+    quint32 mStateValue = 0;
 };
 
 DefaultKeyFilter::DefaultKeyFilter()
@@ -92,51 +134,7 @@ bool DefaultKeyFilter::matches(const Key &key, MatchContexts contexts) const
     if (!(d->mMatchContexts & contexts)) {
         return false;
     }
-#ifdef MATCH
-#undef MATCH
-#endif
-#define MATCH(member, method)                                                                                                                                  \
-    do {                                                                                                                                                       \
-        if (member != DoesNotMatter && key.method() != bool(member == Set)) {                                                                                  \
-            return false;                                                                                                                                      \
-        }                                                                                                                                                      \
-    } while (false)
-#define IS_MATCH(what) MATCH(d->m##what, is##what)
-#define CAN_MATCH(what) MATCH(d->mCan##what, can##what)
-#define HAS_MATCH(what) MATCH(d->mHas##what, has##what)
-    IS_MATCH(Revoked);
-    IS_MATCH(Expired);
-    IS_MATCH(Invalid);
-    IS_MATCH(Disabled);
-    IS_MATCH(Root);
-    CAN_MATCH(Encrypt);
-    CAN_MATCH(Sign);
-    CAN_MATCH(Certify);
-    CAN_MATCH(Authenticate);
-    HAS_MATCH(Encrypt);
-    HAS_MATCH(Sign);
-    HAS_MATCH(Certify);
-    HAS_MATCH(Authenticate);
-    IS_MATCH(Qualified);
-    if (d->mCardKey != DoesNotMatter) {
-        if ((d->mCardKey == Set && !is_card_key(key)) || (d->mCardKey == NotSet && is_card_key(key))) {
-            return false;
-        }
-    }
-    MATCH(d->mHasSecret, hasSecret);
-#undef MATCH
-    if (d->mIsOpenPGP != DoesNotMatter && bool(key.protocol() == GpgME::OpenPGP) != bool(d->mIsOpenPGP == Set)) {
-        return false;
-    }
-    if (d->mWasValidated != DoesNotMatter && bool(key.keyListMode() & GpgME::Validate) != bool(d->mWasValidated == Set)) {
-        return false;
-    }
-    if (d->mIsDeVs != DoesNotMatter && bool(DeVSCompliance::keyIsCompliant(key)) != bool(d->mIsDeVs == Set)) {
-        return false;
-    }
-    if (d->mBad != DoesNotMatter &&
-        /* This is similar to GPGME::Key::isBad which was introduced in GPGME 1.13.0 */
-        bool(key.isNull() || key.isRevoked() || key.isExpired() || key.isDisabled() || key.isInvalid()) != bool(d->mBad == Set)) {
+    if (d->mStateMask && (KeyState::of(key, d->mStateMask) & d->mStateMask) != d->mStateValue) {
         return false;
     }
     const UserID uid = key.userID(0);
@@ -397,91 +395,109 @@ void DefaultKeyFilter::setFont(const QFont &value)
 void DefaultKeyFilter::setRevoked(DefaultKeyFilter::TriState value)
 {
     d->mRevoked = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setExpired(DefaultKeyFilter::TriState value)
 {
     d->mExpired = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setInvalid(DefaultKeyFilter::TriState value)
 {
     d->mInvalid = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setDisabled(DefaultKeyFilter::TriState value)
 {
     d->mDisabled = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setRoot(DefaultKeyFilter::TriState value)
 {
     d->mRoot = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setCanEncrypt(DefaultKeyFilter::TriState value)
 {
     d->mCanEncrypt = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setCanSign(DefaultKeyFilter::TriState value)
 {
     d->mCanSign = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setCanCertify(DefaultKeyFilter::TriState value)
 {
     d->mCanCertify = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setCanAuthenticate(DefaultKeyFilter::TriState value)
 {
     d->mCanAuthenticate = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setHasEncrypt(DefaultKeyFilter::TriState value)
 {
     d->mHasEncrypt = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setHasSign(DefaultKeyFilter::TriState value)
 {
     d->mHasSign = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setHasCertify(DefaultKeyFilter::TriState value)
 {
     d->mHasCertify = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setHasAuthenticate(DefaultKeyFilter::TriState value)
 {
     d->mHasAuthenticate = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setQualified(DefaultKeyFilter::TriState value)
 {
     d->mQualified = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setCardKey(DefaultKeyFilter::TriState value)
 {
     d->mCardKey = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setHasSecret(DefaultKeyFilter::TriState value)
 {
     d->mHasSecret = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setIsOpenPGP(DefaultKeyFilter::TriState value)
 {
     d->mIsOpenPGP = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setWasValidated(DefaultKeyFilter::TriState value)
 {
     d->mWasValidated = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setOwnerTrust(DefaultKeyFilter::LevelState value)
@@ -507,11 +523,13 @@ void DefaultKeyFilter::setValidityReferenceLevel(GpgME::UserID::Validity value)
 void DefaultKeyFilter::setIsDeVs(DefaultKeyFilter::TriState value)
 {
     d->mIsDeVs = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setIsBad(DefaultKeyFilter::TriState value)
 {
     d->mBad = value;
+    d->updateStateMask();
 }
 
 void DefaultKeyFilter::setValidIfSMIME(DefaultKeyFilter::TriState value)
@@ -17,6 +17,9 @@
 #include "debug.h"
 #include "dn.h"
 #include "expirycheckersettings.h"
+#include "expirytimeline_p.h"
+
+#include "utils/parallel_p.h"
 
 #include <libkleo/algorithm.h>
 #include <libkleo/keycache.h>
@@ -28,16 +31,26 @@
 #include <QGpgME/Protocol>
 
 #include <QTimeZone>
+#include <QTimer>
 
 #include <gpgme++/keylistresult.h>
 
+#include <algorithm>
+#include <optional>
 #include <set>
+#include <unordered_map>
 
 #include <cmath>
 #include <ctime>
+#include <limits>
 
 using namespace Kleo;
 
+static const int maximumCertificateChainLength = 100;
+// the timer of the timeline runs on the monotonic clock which stops while the system is suspended;
+// therefore, the deadlines are rechecked against the wall-clock time at least this often
+static const int maximumTimelineTimerInterval = 60 * 60 * 1000;
+
 class Kleo::ExpiryCheckerPrivate
 {
     Kleo::ExpiryChecker *q;
@@ -47,16 +60,46 @@ public:
         : q{qq}
         , settings{settings_}
     {
+        timelineTimer.setSingleShot(true);
+        timelineTimer.setTimerType(Qt::PreciseTimer);
+        QObject::connect(&timelineTimer, &QTimer::timeout, q, [this]() {
+            processDueDeadlines();
+        });
     }
 
+    qint64 currentTime() const;
+    QDate currentDate() const;
+    QTimeZone timeZone() const;
+
     ExpiryChecker::Expiration calculateExpiration(const GpgME::Subkey &subkey) const;
     ExpiryChecker::Expiration checkForExpiration(const GpgME::Key &key, Kleo::chrono::days threshold, ExpiryChecker::CheckFlags flags) const;
 
     ExpiryChecker::Result checkKeyNearExpiry(const GpgME::Key &key, ExpiryChecker::CheckFlags flags);
 
+    // the expirations of a CA certificate and of the certificates in its chain
+    using ChainExpirations = std::vector<ExpiryChecker::Expiration>;
+    using ChainCache = std::unordered_map<std::string, ChainExpirations>;
+    const ChainExpirations &chainExpirations(const GpgME::Key &certificate, ChainCache &cache) const;
+    const ChainExpirations *chainOfKey(const GpgME::Key &key, ExpiryChecker::CheckFlags flags, ChainCache &cache) const;
+    std::vector<ExpiryChecker::Result>
+    checkKeysNearExpiry(const std::vector<GpgME::Key> &keys, ExpiryChecker::CheckFlags flags, ExpiryChecker::Execution execution) const;
+
+    void rebuildTimeline();
+    void updateTimeline(const std::vector<GpgME::Key> &changedKeys);
+    void addToTimeline(const GpgME::Key &key, qint64 now, const QTimeZone &zone, ChainCache &chainCache);
+    void scheduleNextDeadline();
+    void processDueDeadlines();
+
     ExpiryCheckerSettings settings;
     std::set<QByteArray> alreadyWarnedFingerprints;
     std::shared_ptr<TimeProvider> timeProvider;
+
+    ExpiryChecker::CheckFlags watchedFlags;
+    std::shared_ptr<const KeyCache> watchedKeyCache;
+    std::vector<QMetaObject::Connection> keyCacheConnections;
+    std::optional<std::vector<GpgME::Key>> changedKeys; // the keys reported by keysChanged()
+    ExpiryTimeline timeline;
+    QTimer timelineTimer;
 };
 
 ExpiryChecker::ExpiryChecker(const ExpiryCheckerSettings &settings, QObject *parent)
@@ -431,17 +474,36 @@ static GpgME::Subkey findBestSubkey(const GpgME::Key &key, ExpiryChecker::CheckF
     return result;
 }
 
+static qint64 expirationTimeOf(const GpgME::Subkey &subkey)
+{
+    // interpret the expiration time as unsigned 32-bit value if it's negative; gpg also uses uint32 internally
+    return qint64(subkey.expirationTime() < 0 ? quint32(subkey.expirationTime()) : subkey.expirationTime());
+}
+
+qint64 ExpiryCheckerPrivate::currentTime() const
+{
+    return timeProvider ? timeProvider->currentTime() : QDateTime::currentSecsSinceEpoch();
+}
+
+QDate ExpiryCheckerPrivate::currentDate() const
+{
+    return timeProvider ? timeProvider->currentDate() : QDate::currentDate();
+}
+
+QTimeZone ExpiryCheckerPrivate::timeZone() const
+{
+    return timeProvider ? timeProvider->timeZone() : QTimeZone{QTimeZone::LocalTime};
+}
+
 ExpiryChecker::Expiration ExpiryCheckerPrivate::calculateExpiration(const GpgME::Subkey &subkey) const
 {
     if (subkey.neverExpires()) {
         return {subkey.parent(), ExpiryChecker::NotNearExpiry, Kleo::chrono::days::zero()};
     }
-    const qint64 currentTime = timeProvider ? timeProvider->currentTime() : QDateTime::currentSecsSinceEpoch();
-    const auto currentDate = timeProvider ? timeProvider->currentDate() : QDate::currentDate();
-    const auto timeZone = timeProvider ? timeProvider->timeZone() : QTimeZone{QTimeZone::LocalTime};
-    // interpret the expiration time as unsigned 32-bit value if it's negative; gpg also uses uint32 internally
-    const qint64 expirationTime = qint64(subkey.expirationTime() < 0 ? quint32(subkey.expirationTime()) : subkey.expirationTime());
-    const auto expirationDate = QDateTime::fromSecsSinceEpoch(expirationTime, timeZone).date();
+    const qint64 currentTime = this->currentTime();
+    const auto currentDate = this->currentDate();
+    const qint64 expirationTime = expirationTimeOf(subkey);
+    const auto expirationDate = QDateTime::fromSecsSinceEpoch(expirationTime, timeZone()).date();
     if (expirationTime <= currentTime) {
         return {subkey.parent(), ExpiryChecker::Expired, Kleo::chrono::days{expirationDate.daysTo(currentDate)}};
     } else {
@@ -467,7 +529,6 @@ ExpiryChecker::Expiration ExpiryCheckerPrivate::checkForExpiration(const GpgME::
 
 ExpiryChecker::Result ExpiryCheckerPrivate::checkKeyNearExpiry(const GpgME::Key &orig_key, ExpiryChecker::CheckFlags flags)
 {
-    static const int maximumCertificateChainLength = 100;
     const bool isOwnKey = flags & ExpiryChecker::OwnKey;
 
     ExpiryChecker::Result result;
@@ -537,6 +598,339 @@ ExpiryChecker::Result ExpiryChecker::checkKey(const GpgME::Key &key, CheckFlags
     return d->checkKeyNearExpiry(key, flags);
 }
 
+static bool isSameCertificate(const GpgME::Key &lhs, const GpgME::Key &rhs)
+{
+    return qstrcmp(lhs.primaryFingerprint(), rhs.primaryFingerprint()) == 0;
+}
+
+static bool isNearExpiry(const ExpiryChecker::Expiration &expiration)
+{
+    return expiration.status == ExpiryChecker::Expired || expiration.status == ExpiryChecker::ExpiresSoon;
+}
+
+// orders expirations by the date of expiration; expired certificates come before certificates expiring on the same day
+static std::pair<qint64, int> expirationOrder(const ExpiryChecker::Expiration &expiration)
+{
+    switch (expiration.status) {
+    case ExpiryChecker::Expired:
+        return {-qint64(expiration.duration.count()), 0};
+    case ExpiryChecker::ExpiresSoon:
+        return {qint64(expiration.duration.count()), 1};
+    default:
+        return {std::numeric_limits<qint64>::max(), 2};
+    }
+}
+
+// orders results by the earliest expiration of the certificate or its chain, then by the expiration of the certificate
+static auto resultOrder(const ExpiryChecker::Result &result)
+{
+    auto earliest = expirationOrder(result.expiration);
+    for (const auto &expiration : result.chainExpiration) {
+        earliest = std::min(earliest, expirationOrder(expiration));
+    }
+    return std::make_pair(earliest, expirationOrder(result.expiration));
+}
+
+const ExpiryCheckerPrivate::ChainExpirations &ExpiryCheckerPrivate::chainExpirations(const GpgME::Key &certificate, ChainCache &cache) const
+{
+    if (const auto it = cache.find(certificate.primaryFingerprint()); it != cache.end()) {
+        return it->second;
+    }
+
+    // walk up the chain until its end or until a certificate with known chain expirations
+    ChainExpirations path;
+    const ChainExpirations *knownChain = nullptr;
+    bool isCompleteChain = true;
+    auto key = certificate;
+    while (true) {
+        const auto threshold = key.isRoot() ? settings.rootCertThreshold() : settings.chainCertThreshold();
+        path.push_back(checkForExpiration(key, threshold, {}));
+        if (path.back().status == ExpiryChecker::NoSuitableSubkey || key.isRoot() || (key.protocol() != GpgME::CMS)) {
+            break;
+        }
+        if (path.size() >= std::size_t(maximumCertificateChainLength)) {
+            isCompleteChain = false;
+            break;
+        }
+        const auto keys = KeyCache::instance()->findIssuers(key, KeyCache::NoOption);
+        if (keys.empty()) {
+            break;
+        }
+        key = keys.front();
+        if (const auto it = cache.find(key.primaryFingerprint()); it != cache.end()) {
+            knownChain = &it->second;
+            break;
+        }
+        if (std::any_of(path.cbegin(), path.cend(), [&key](const auto &expiration) {
+                return isSameCertificate(expiration.certificate, key);
+            })) {
+            // looks like a circle in the chain
+            isCompleteChain = false;
+            break;
+        }
+    }
+    if (!isCompleteChain) {
+        // the chains of the other certificates on the path depend on where the circle is entered
+        return cache.emplace(certificate.primaryFingerprint(), std::move(path)).first->second;
+    }
+
+    // the chain of each certificate on the path is the certificate followed by the chain of its issuer
+    ChainExpirations chain = knownChain ? *knownChain : ChainExpirations{};
+    for (auto it = path.crbegin(); it != path.crend(); ++it) {
+        // end the chain before it leads back to the certificate
+        chain.erase(std::find_if(chain.begin(),
+                                 chain.end(),
+                                 [it](const auto &expiration) {
+                                     return isSameCertificate(expiration.certificate, it->certificate);
+                                 }),
+                    chain.end());
+        chain.insert(chain.begin(), *it);
+        cache.emplace(it->certificate.primaryFingerprint(), chain);
+    }
+    return cache.at(certificate.primaryFingerprint());
+}
+
+const ExpiryCheckerPrivate::ChainExpirations *ExpiryCheckerPrivate::chainOfKey(const GpgME::Key &key, ExpiryChecker::CheckFlags flags, ChainCache &cache) const
+{
+    if (!(flags & ExpiryChecker::CheckChain) || key.isNull() || key.isRoot() || (key.protocol() != GpgME::CMS)) {
+        return nullptr;
+    }
+    const auto issuers = KeyCache::instance()->findIssuers(key, KeyCache::NoOption);
+    if (issuers.empty()) {
+        return nullptr;
+    }
+    return &chainExpirations(issuers.front(), cache);
+}
+
+// returns the number of certificates of @p chain that checkKey() checks for @p key
+static std::size_t checkedChainLength(const ExpiryCheckerPrivate::ChainExpirations &chain, const GpgME::Key &key)
+{
+    const auto chainLength = std::min<std::size_t>(chain.size(), maximumCertificateChainLength - 1);
+    // the chain ends before it leads back to the key
+    const auto it = std::find_if(chain.cbegin(), chain.cbegin() + chainLength, [&key](const auto &expiration) {
+        return isSameCertificate(expiration.certificate, key);
+    });
+    return std::distance(chain.cbegin(), it);
+}
+
+std::vector<ExpiryChecker::Result>
+ExpiryCheckerPrivate::checkKeysNearExpiry(const std::vector<GpgME::Key> &keys, ExpiryChecker::CheckFlags flags, ExpiryChecker::Execution execution) const
+{
+    const auto threshold = (flags & ExpiryChecker::OwnKey) ? settings.ownKeyThreshold() : settings.otherKeyThreshold();
+    const auto usageFlags = flags & ExpiryChecker::UsageMask;
+
+    // look up the chains before checking the certificates because the key cache must only be used
+    // by the calling thread; the chains are shared by all certificates issued by the same CA
+    ChainCache chainCache;
+    std::vector<const ChainExpirations *> chains(keys.size());
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        chains[i] = chainOfKey(keys[i], flags, chainCache);
+    }
+
+    std::vector<ExpiryChecker::Result> results(keys.size());
+    std::vector<char> nearExpiry(keys.size()); // char instead of bool, so that the workers write to distinct memory locations
+    const auto checkKeys = [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            const auto &key = keys[i];
+            if (key.isNull()) {
+                continue;
+            }
+            auto &result = results[i];
+            result.checkFlags = flags;
+            result.expiration = checkForExpiration(key, threshold, usageFlags);
+            if (chains[i] && (result.expiration.status != ExpiryChecker::NoSuitableSubkey)) {
+                const auto &chain = *chains[i];
+                const auto chainLength = checkedChainLength(chain, key);
+                for (std::size_t j = 0; j < chainLength; ++j) {
+                    if (chain[j].status != ExpiryChecker::NotNearExpiry) {
+                        result.chainExpiration.push_back(chain[j]);
+                    }
+                }
+            }
+            nearExpiry[i] = isNearExpiry(result.expiration) || std::any_of(result.chainExpiration.cbegin(), result.chainExpiration.cend(), isNearExpiry);
+        }
+    };
+    if (execution == ExpiryChecker::Execution::Parallel) {
+        forEachChunkInParallel(keys.size(), checkKeys);
+    } else {
+        checkKeys(0, keys.size());
+    }
+
+    std::vector<ExpiryChecker::Result> report;
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        if (nearExpiry[i]) {
+            report.push_back(std::move(results[i]));
+        }
+    }
+    std::stable_sort(report.begin(), report.end(), [](const auto &lhs, const auto &rhs) {
+        return resultOrder(lhs) < resultOrder(rhs);
+    });
+    return report;
+}
+
+std::vector<ExpiryChecker::Result> ExpiryChecker::checkKeys(std::vector<GpgME::Key> keys, CheckFlags flags, Execution execution) const
+{
+    if (!(flags & UsageMask)) {
+        qWarning(LIBKLEO_LOG) << __func__ << "called with invalid flags:" << flags;
+        return {};
+    }
+    return d->checkKeysNearExpiry(keys, flags, execution);
+}
+
+void ExpiryCheckerPrivate::rebuildTimeline()
+{
+    timeline.clear();
+    const qint64 now = currentTime();
+    const auto zone = timeZone();
+    ChainCache chainCache;
+    // iterate over a copy because looking up the issuers may add keys to the key cache in light mode
+    const std::vector<GpgME::Key> keys = watchedKeyCache->keys();
+    for (const auto &key : keys) {
+        addToTimeline(key, now, zone, chainCache);
+    }
+    scheduleNextDeadline();
+}
+
+void ExpiryCheckerPrivate::updateTimeline(const std::vector<GpgME::Key> &changedKeys)
+{
+    // the deadlines of a CA certificate are shared by all keys issued by it, and
+    // a new CA certificate may complete the chains of many keys; start over
+    const bool caCertificateChanged = std::any_of(changedKeys.cbegin(), changedKeys.cend(), [](const auto &key) {
+        return key.protocol() == GpgME::CMS && (key.isRoot() || key.hasCertify());
+    });
+    // the deadlines of removed keys are only dropped when they become due or on rebuild
+    if (caCertificateChanged || timeline.removedKeyCount() + changedKeys.size() > 2 * timeline.keyCount() + 100) {
+        rebuildTimeline();
+        return;
+    }
+    const qint64 now = currentTime();
+    const auto zone = timeZone();
+    ChainCache chainCache;
+    for (const auto &changedKey : changedKeys) {
+        timeline.removeKey(changedKey.primaryFingerprint());
+        // the signal reports removed keys and the old versions of updated keys, too
+        const auto &key = watchedKeyCache->findByFingerprint(changedKey.primaryFingerprint());
+        if (!key.isNull()) {
+            addToTimeline(key, now, zone, chainCache);
+        }
+    }
+    scheduleNextDeadline();
+}
+
+void ExpiryCheckerPrivate::addToTimeline(const GpgME::Key &key, qint64 now, const QTimeZone &zone, ChainCache &chainCache)
+{
+    // returns the times after now at which the expiration status of the subkey changes for the threshold
+    const auto deadlinesOf = [now, zone](const GpgME::Subkey &subkey, Kleo::chrono::days threshold) {
+        std::vector<qint64> deadlines;
+        if (subkey.isNull() || subkey.neverExpires()) {
+            return deadlines;
+        }
+        const qint64 expirationTime = expirationTimeOf(subkey);
+        const auto expirationDate = QDateTime::fromSecsSinceEpoch(expirationTime, zone).date();
+        const qint64 nearExpiryTime = expirationDate.addDays(-threshold.count()).startOfDay(zone).toSecsSinceEpoch();
+        for (const qint64 time : {nearExpiryTime, expirationTime}) {
+            if (time > now) {
+                deadlines.push_back(time);
+            }
+        }
+        return deadlines;
+    };
+
+    const auto flags = watchedFlags | (key.hasSecret() ? ExpiryChecker::OwnKey : ExpiryChecker::CheckFlags{});
+    const auto threshold = (flags & ExpiryChecker::OwnKey) ? settings.ownKeyThreshold() : settings.otherKeyThreshold();
+    const auto subkey = findBestSubkey(key, flags & ExpiryChecker::UsageMask);
+    if (subkey.isNull()) {
+        return;
+    }
+    std::vector<std::pair<qint64, const char *>> deadlines;
+    for (const qint64 time : deadlinesOf(subkey, threshold)) {
+        deadlines.emplace_back(time, key.primaryFingerprint());
+    }
+    if (const auto chain = chainOfKey(key, flags, chainCache)) {
+        const auto chainLength = checkedChainLength(*chain, key);
+        for (std::size_t i = 0; i < chainLength; ++i) {
+            const auto &certificate = (*chain)[i].certificate;
+            const auto chainThreshold = certificate.isRoot() ? settings.rootCertThreshold() : settings.chainCertThreshold();
+            for (const qint64 time : deadlinesOf(certificate.subkey(0), chainThreshold)) {
+                deadlines.emplace_back(time, certificate.primaryFingerprint());
+            }
+        }
+    }
+    if (deadlines.empty()) {
+        return;
+    }
+    const auto watchedKey = timeline.addKey(key, flags);
+    for (const auto &[time, fingerprint] : deadlines) {
+        timeline.addDeadline(time, fingerprint, watchedKey);
+    }
+}
+
+void ExpiryCheckerPrivate::scheduleNextDeadline()
+{
+    timelineTimer.stop();
+    const auto nextDeadline = timeline.nextDeadline();
+    if (!nextDeadline) {
+        return;
+    }
+    // deadlines which are too far in the future are rescheduled when the timer fires
+    const qint64 msecs = std::clamp<qint64>((*nextDeadline - currentTime()) * 1000, 0, maximumTimelineTimerInterval);
+    qCDebug(LIBKLEO_LOG) << __func__ << "Next expiration deadline in" << msecs << "ms";
+    timelineTimer.start(int(msecs));
+}
+
+void ExpiryCheckerPrivate::processDueDeadlines()
+{
+    for (const auto &watchedKey : timeline.takeDueKeys(currentTime())) {
+        checkKeyNearExpiry(watchedKey.key, watchedKey.flags);
+    }
+    scheduleNextDeadline();
+}
+
+void ExpiryChecker::startWatchingKeyCache(CheckFlags flags)
+{
+    if (!(flags & UsageMask)) {
+        qWarning(LIBKLEO_LOG) << __func__ << "called with invalid flags:" << flags;
+        return;
+    }
+    stopWatchingKeyCache();
+    d->watchedFlags = flags & ~CheckFlags{OwnKey};
+    d->watchedKeyCache = KeyCache::instance();
+    d->keyCacheConnections = {
+        connect(d->watchedKeyCache.get(),
+                &KeyCache::keysChanged,
+                this,
+                [this](const std::vector<GpgME::Key> &keys) {
+                    d->changedKeys = keys;
+                }),
+        connect(d->watchedKeyCache.get(),
+                &KeyCache::keysMayHaveChanged,
+                this,
+                [this]() {
+                    // keysChanged() is emitted right before if only some keys have changed
+                    if (d->changedKeys) {
+                        const auto keys = std::move(*d->changedKeys);
+                        d->changedKeys.reset();
+                        d->updateTimeline(keys);
+                    } else {
+                        d->rebuildTimeline();
+                    }
+                }),
+    };
+    d->rebuildTimeline();
+}
+
+void ExpiryChecker::stopWatchingKeyCache()
+{
+    for (const auto &connection : d->keyCacheConnections) {
+        disconnect(connection);
+    }
+    d->keyCacheConnections.clear();
+    d->changedKeys.reset();
+    d->timelineTimer.stop();
+    d->timeline.clear();
+    d->watchedKeyCache.reset();
+}
+
 void ExpiryChecker::setTimeProviderForTest(const std::shared_ptr<TimeProvider> &timeProvider)
 {
     d->timeProvider = timeProvider;
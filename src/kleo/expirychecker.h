@@ -24,6 +24,7 @@
 #include <gpgme++/key.h>
 
 #include <memory>
+#include <vector>
 
 namespace Kleo
 {
@@ -101,6 +102,46 @@ public:
 
     Result checkKey(const GpgME::Key &key, CheckFlags flags) const;
 
+    enum class Execution {
+        Sequential,
+        Parallel,
+    };
+
+    /**
+     * Checks all @p keys like checkKey(), e.g. all certificates of the key cache,
+     * but doesn't emit expiryMessage().
+     *
+     * The expiration of a CA certificate is determined only once even if it
+     * is part of the certificate chains of many of the checked certificates.
+     * If @p execution is Execution::Parallel, then the certificates are also
+     * checked by idle threads of the global thread pool.
+     *
+     * @returns the results for the keys that are expired or expire soon or that
+     * have expired or soon expiring chain certificates. The results are sorted by
+     * the date of the earliest expiration, i.e. the most urgent results come first.
+     * Null keys are ignored.
+     *
+     * @p keys is taken by value because looking up the certificate chains may
+     * add issuers to the key cache, e.g. in light mode, which invalidates the
+     * vector returned by KeyCache::keys().
+     */
+    std::vector<Result> checkKeys(std::vector<GpgME::Key> keys, CheckFlags flags, Execution execution = Execution::Sequential) const;
+
+    /**
+     * Starts watching the keys of the key cache for changes of their expiration status.
+     *
+     * When a key starts to expire soon or expires, or a certificate in its chain
+     * does, the key is checked with @p flags like with checkKey(), i.e. expiryMessage()
+     * is emitted. Keys with secret key are checked as own keys. Instead of polling,
+     * a single timer is armed for the next change of the expiration status of any
+     * watched key. The watched keys are updated when the key cache changes.
+     *
+     * Keys that already expire soon or that are already expired when the watching
+     * starts are not reported. Use checkKeys() for them.
+     */
+    void startWatchingKeyCache(CheckFlags flags);
+    void stopWatchingKeyCache();
+
 Q_SIGNALS:
     void expiryMessage(const GpgME::Key &key, QString msg, Kleo::ExpiryChecker::ExpiryInformation info, bool isNewMessage) const;
 
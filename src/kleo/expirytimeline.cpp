@@ -0,0 +1,117 @@
+/*
+    kleo/expirytimeline.cpp
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-libkleo.h>
+
+#include "expirytimeline_p.h"
+
+#include <algorithm>
+#include <iterator>
+
+using namespace Kleo;
+
+namespace
+{
+// std::push_heap() and std::pop_heap() build a max-heap; reversing the order makes the earliest deadline the top
+const auto later = [](const auto &lhs, const auto &rhs) {
+    return lhs.time > rhs.time;
+};
+}
+
+void ExpiryTimeline::clear()
+{
+    m_keys.clear();
+    m_removed.clear();
+    m_keyIndexes.clear();
+    m_deadlines.clear();
+    m_affectedKeys.clear();
+    m_slots.clear();
+}
+
+std::size_t ExpiryTimeline::addKey(const GpgME::Key &key, ExpiryChecker::CheckFlags flags)
+{
+    removeKey(key.primaryFingerprint());
+    m_keys.push_back({key, flags});
+    m_removed.push_back(false);
+    if (const char *const fpr = key.primaryFingerprint()) {
+        m_keyIndexes[fpr] = m_keys.size() - 1;
+    }
+    return m_keys.size() - 1;
+}
+
+void ExpiryTimeline::removeKey(const char *fingerprint)
+{
+    if (!fingerprint) {
+        return;
+    }
+    const auto it = m_keyIndexes.find(fingerprint);
+    if (it != m_keyIndexes.end()) {
+        m_removed[it->second] = true;
+        m_keyIndexes.erase(it);
+    }
+}
+
+std::size_t ExpiryTimeline::removedKeyCount() const
+{
+    return m_keys.size() - m_keyIndexes.size();
+}
+
+std::size_t ExpiryTimeline::keyCount() const
+{
+    return m_keyIndexes.size();
+}
+
+void ExpiryTimeline::addDeadline(qint64 time, const char *fingerprint, std::size_t key)
+{
+    Q_ASSERT(key < m_keys.size());
+    const auto [it, inserted] = m_slots.try_emplace({fingerprint ? fingerprint : "", time}, m_affectedKeys.size());
+    if (inserted) {
+        m_affectedKeys.emplace_back();
+        m_deadlines.push_back({time, it->second});
+        std::push_heap(m_deadlines.begin(), m_deadlines.end(), later);
+    }
+    m_affectedKeys[it->second].push_back(key);
+}
+
+std::optional<qint64> ExpiryTimeline::nextDeadline() const
+{
+    if (m_deadlines.empty()) {
+        return std::nullopt;
+    }
+    return m_deadlines.front().time;
+}
+
+std::vector<ExpiryTimeline::WatchedKey> ExpiryTimeline::takeDueKeys(qint64 time)
+{
+    std::vector<std::size_t> dueKeys;
+    while (!m_deadlines.empty() && m_deadlines.front().time <= time) {
+        std::pop_heap(m_deadlines.begin(), m_deadlines.end(), later);
+        auto &affectedKeys = m_affectedKeys[m_deadlines.back().slot];
+        dueKeys.insert(dueKeys.end(), affectedKeys.begin(), affectedKeys.end());
+        // the slot is not reused; release the memory of the affected keys
+        affectedKeys = {};
+        m_deadlines.pop_back();
+    }
+    // a key may be affected by several deadlines, e.g. of the certificates in its chain
+    std::sort(dueKeys.begin(), dueKeys.end());
+    dueKeys.erase(std::unique(dueKeys.begin(), dueKeys.end()), dueKeys.end());
+    dueKeys.erase(std::remove_if(dueKeys.begin(),
+                                 dueKeys.end(),
+                                 [this](std::size_t key) {
+                                     return m_removed[key];
+                                 }),
+                  dueKeys.end());
+
+    std::vector<WatchedKey> result;
+    result.reserve(dueKeys.size());
+    std::transform(dueKeys.begin(), dueKeys.end(), std::back_inserter(result), [this](std::size_t key) {
+        return m_keys[key];
+    });
+    return result;
+}
@@ -0,0 +1,80 @@
+/*
+    kleo/expirytimeline_p.h
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include "expirychecker.h"
+
+#include <gpgme++/key.h>
+
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Kleo
+{
+
+/**
+ * The upcoming changes of the expiration status of the keys watched by an
+ * ExpiryChecker.
+ *
+ * The timeline is a min-heap of deadlines, i.e. of the times at which a
+ * certificate starts to expire soon or expires. Each deadline refers to the
+ * watched keys affected by it. A deadline of a CA certificate is shared by
+ * all watched keys whose certificate chain contains the CA certificate.
+ *
+ * Removed keys are only marked as removed; their deadlines are skipped when
+ * they become due.
+ */
+class ExpiryTimeline
+{
+public:
+    struct WatchedKey {
+        GpgME::Key key;
+        ExpiryChecker::CheckFlags flags;
+    };
+
+    void clear();
+
+    /** Adds a watched key replacing an earlier version of the key and returns its index. */
+    std::size_t addKey(const GpgME::Key &key, ExpiryChecker::CheckFlags flags);
+    /** Stops watching the key with fingerprint @p fingerprint. */
+    void removeKey(const char *fingerprint);
+    /** Returns the number of removed keys whose deadlines are still in the timeline. */
+    std::size_t removedKeyCount() const;
+    /** Returns the number of watched keys. */
+    std::size_t keyCount() const;
+    /**
+     * Adds a deadline at @p time (in seconds since epoch) for the certificate with
+     * fingerprint @p fingerprint affecting the watched key with index @p key.
+     */
+    void addDeadline(qint64 time, const char *fingerprint, std::size_t key);
+
+    /** Returns the time of the next deadline or nothing if there are no deadlines. */
+    std::optional<qint64> nextDeadline() const;
+    /** Removes the deadlines until @p time (inclusive) and returns the watched keys affected by them. */
+    std::vector<WatchedKey> takeDueKeys(qint64 time);
+
+private:
+    struct Deadline {
+        qint64 time;
+        std::size_t slot; //< the index of the affected keys
+    };
+
+    std::vector<WatchedKey> m_keys;
+    std::vector<bool> m_removed; // whether the watched key at the same index has been removed
+    std::unordered_map<std::string, std::size_t> m_keyIndexes; // the indexes of the watched keys by fingerprint
+    std::vector<Deadline> m_deadlines; // a min-heap ordered by time
+    std::vector<std::vector<std::size_t>> m_affectedKeys;
+    std::map<std::pair<std::string, qint64>, std::size_t> m_slots; // the slots of the deadlines by certificate and time
+};
+
+}
@@ -13,7 +13,6 @@
 
 #include "defaultkeyfilter.h"
 #include "kconfigbasedkeyfilter.h"
-#include "stl_util.h"
 
 #include <libkleo/algorithm.h>
 #include <libkleo/compliance.h>
@@ -28,15 +27,21 @@
 #include <KSharedConfig>
 
 #include <QAbstractListModel>
+#include <QColor>
 #include <QCoreApplication>
+#include <QHash>
 #include <QIcon>
 #include <QModelIndex>
 #include <QRegularExpression>
 #include <QStringList>
+#include <QTimer>
+
+#include <gpgme++/key.h>
 
 #include <algorithm>
 #include <climits>
 #include <functional>
+#include <map>
 
 using namespace Kleo;
 using namespace GpgME;
@@ -253,13 +258,111 @@ public:
     void clear()
     {
         filters.clear();
+        appearances.clear();
+        appearanceIds.clear();
+        memoizedAppearances.clear();
     }
 
+    struct Appearance {
+        KeyFilter::FontDescription fontDescription;
+        QColor bgColor;
+        QColor fgColor;
+        QIcon icon;
+    };
+    const Appearance &appearance(const Key &key);
+
     std::vector<std::shared_ptr<KeyFilter>> filters;
     Model model;
     GpgME::Protocol protocol = GpgME::UnknownProtocol;
+
+private:
+    Appearance makeAppearance(const std::vector<std::size_t> &matchingFilters) const;
+    void checkComplianceState();
+
+    struct MemoizedAppearance {
+        Key key; // the version of the key the appearance was determined for
+        std::size_t id;
+    };
+    std::vector<Appearance> appearances; // the distinct appearances; the ids are the indexes
+    std::map<std::vector<std::size_t>, std::size_t> appearanceIds; // indexes of the matching filters -> appearance id
+    QHash<QByteArray, MemoizedAppearance> memoizedAppearances; // by fingerprint
+    // the state of the compliance mode the memoized appearances were determined for
+    int complianceState = -1;
+    bool complianceStateChecked = false;
 };
 
+static constexpr qsizetype maximumMemoizedAppearances = 10000;
+
+void KeyFilterManager::Private::checkComplianceState()
+{
+    // whether a filter matches a key also depends on the compliance mode; check it
+    // at most once per event loop iteration because reading the configuration is slow
+    if (complianceStateChecked) {
+        return;
+    }
+    complianceStateChecked = true;
+    QTimer::singleShot(0, &model, [this]() {
+        complianceStateChecked = false;
+    });
+    const int state = (DeVSCompliance::isActive() ? 1 : 0) | (DeVSCompliance::isCompliant() ? 2 : 0);
+    if (state != complianceState) {
+        memoizedAppearances.clear();
+        complianceState = state;
+    }
+}
+
+KeyFilterManager::Private::Appearance KeyFilterManager::Private::makeAppearance(const std::vector<std::size_t> &matchingFilters) const
+{
+    Appearance appearance;
+    for (const std::size_t i : matchingFilters) {
+        const auto &filter = filters[i];
+        appearance.fontDescription = appearance.fontDescription.resolve(filter->fontDescription());
+        if (!appearance.bgColor.isValid()) {
+            appearance.bgColor = filter->bgColor();
+        }
+        if (!appearance.fgColor.isValid()) {
+            appearance.fgColor = filter->fgColor();
+        }
+        if (appearance.icon.isNull() && !filter->icon().isEmpty()) {
+            appearance.icon = QIcon::fromTheme(filter->icon());
+        }
+    }
+    return appearance;
+}
+
+// The appearance of a key is determined by the set of filters matching the key. The distinct
+// appearances are computed once; for each key only the id of its appearance is remembered.
+const KeyFilterManager::Private::Appearance &KeyFilterManager::Private::appearance(const Key &key)
+{
+    checkComplianceState();
+    const char *const fpr = key.primaryFingerprint();
+    if (fpr) {
+        const auto it = memoizedAppearances.constFind(QByteArray::fromRawData(fpr, qstrlen(fpr)));
+        if (it != memoizedAppearances.cend() && it->key.impl() == key.impl()) {
+            return appearances[it->id];
+        }
+    }
+
+    std::vector<std::size_t> matchingFilters;
+    for (std::size_t i = 0; i < filters.size(); ++i) {
+        if (filters[i]->matches(key, KeyFilter::Appearance)) {
+            matchingFilters.push_back(i);
+        }
+    }
+    const auto [idIt, inserted] = appearanceIds.try_emplace(matchingFilters, appearances.size());
+    if (inserted) {
+        appearances.push_back(makeAppearance(matchingFilters));
+    }
+    if (fpr) {
+        // the memoized appearances keep the keys alive; start over instead of growing without bound
+        if (memoizedAppearances.size() >= maximumMemoizedAppearances) {
+            memoizedAppearances.clear();
+        }
+        memoizedAppearances.insert(QByteArray{fpr}, MemoizedAppearance{key, idIt->second});
+    }
+    return appearances[idIt->second];
+}
+
 KeyFilterManager *KeyFilterManager::mSelf = nullptr;
 
 KeyFilterManager::KeyFilterManager(QObject *parent)
@@ -431,38 +534,9 @@ QVariant Model::data(const QModelIndex &idx, int role) const
     }
 }
 
-static KeyFilter::FontDescription
-get_fontdescription(const std::vector<std::shared_ptr<KeyFilter>> &filters, const Key &key, const KeyFilter::FontDescription &initial)
-{
-    return kdtools::accumulate_if(
-        filters.begin(),
-        filters.end(),
-        [&key](const std::shared_ptr<KeyFilter> &filter) {
-            return filter->matches(key, KeyFilter::Appearance);
-        },
-        initial,
-        [](const KeyFilter::FontDescription &lhs, const std::shared_ptr<KeyFilter> &rhs) {
-            return lhs.resolve(rhs->fontDescription());
-        });
-}
-
 QFont KeyFilterManager::font(const Key &key, const QFont &baseFont) const
 {
-    const KeyFilter::FontDescription fd = get_fontdescription(d->filters, key, KeyFilter::FontDescription());
-
-    return fd.font(baseFont);
-}
-
-static QColor get_color(const std::vector<std::shared_ptr<KeyFilter>> &filters, const Key &key, QColor (KeyFilter::*fun)() const)
-{
-    const auto it = std::find_if(filters.cbegin(), filters.cend(), [&fun, &key](const std::shared_ptr<KeyFilter> &filter) {
-        return filter->matches(key, KeyFilter::Appearance) && (filter.get()->*fun)().isValid();
-    });
-    if (it == filters.cend()) {
-        return {};
-    } else {
-        return (it->get()->*fun)();
-    }
+    return d->appearance(key).fontDescription.font(baseFont);
 }
 
 static QColor get_color(const std::vector<std::shared_ptr<KeyFilter>> &filters, const UserID &userID, QColor (KeyFilter::*fun)() const)
@@ -477,26 +551,14 @@ static QColor get_color(const std::vector<std::shared_ptr<KeyFilter>> &filters,
     }
 }
 
-static QString get_string(const std::vector<std::shared_ptr<KeyFilter>> &filters, const Key &key, QString (KeyFilter::*fun)() const)
-{
-    const auto it = std::find_if(filters.cbegin(), filters.cend(), [&fun, &key](const std::shared_ptr<KeyFilter> &filter) {
-        return filter->matches(key, KeyFilter::Appearance) && !(filter.get()->*fun)().isEmpty();
-    });
-    if (it == filters.cend()) {
-        return QString();
-    } else {
-        return (*it)->icon();
-    }
-}
-
 QColor KeyFilterManager::bgColor(const Key &key) const
 {
-    return get_color(d->filters, key, &KeyFilter::bgColor);
+    return d->appearance(key).bgColor;
 }
 
 QColor KeyFilterManager::fgColor(const Key &key) const
 {
-    return get_color(d->filters, key, &KeyFilter::fgColor);
+    return d->appearance(key).fgColor;
 }
 
 QColor KeyFilterManager::bgColor(const UserID &userID) const
@@ -511,8 +573,7 @@ QColor KeyFilterManager::fgColor(const UserID &userID) const
 
 QIcon KeyFilterManager::icon(const Key &key) const
 {
-    const QString icon = get_string(d->filters, key, &KeyFilter::icon);
-    return icon.isEmpty() ? QIcon() : QIcon::fromTheme(icon);
+    return d->appearance(key).icon;
 }
 
 Protocol KeyFilterManager::protocol() const
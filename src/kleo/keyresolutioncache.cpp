@@ -0,0 +1,152 @@
+/*
+    kleo/keyresolutioncache.cpp
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-libkleo.h>
+
+#include "keyresolutioncache_p.h"
+
+#include "models/keycacheindex_p.h"
+
+#include <QHashFunctions>
+
+#include <algorithm>
+#include <utility>
+
+using namespace Kleo;
+using namespace GpgME;
+
+size_t Kleo::qHash(const KeyResolutionCache::Query &query, size_t seed) noexcept
+{
+    return qHashMulti(seed,
+                      query.address,
+                      int(query.protocol),
+                      int(query.usage),
+                      query.minimumValidity,
+                      query.deVsCompliance,
+                      int(query.source));
+}
+
+KeyResolutionCache::KeyResolutionCache(const std::shared_ptr<const KeyCache> &keyCache)
+    : m_keyCache{keyCache}
+{
+    m_connections = {
+        QObject::connect(keyCache.get(),
+                         &KeyCache::keysChanged,
+                         [this](const std::vector<Key> &keys) {
+                             keysChanged(keys);
+                         }),
+        QObject::connect(keyCache.get(),
+                         &KeyCache::keysMayHaveChanged,
+                         [this]() {
+                             keysMayHaveChanged();
+                         }),
+    };
+}
+
+KeyResolutionCache::~KeyResolutionCache()
+{
+    for (const auto &connection : m_connections) {
+        QObject::disconnect(connection);
+    }
+}
+
+std::shared_ptr<KeyResolutionCache> KeyResolutionCache::instance(const std::shared_ptr<const KeyCache> &keyCache)
+{
+    // the cache lives as long as the application, so that the results survive the key resolvers;
+    // it is replaced if the key cache has been replaced
+    static std::shared_ptr<KeyResolutionCache> self;
+    if (!self || self->m_keyCache.lock() != keyCache) {
+        self.reset(new KeyResolutionCache{keyCache});
+    }
+    return self;
+}
+
+const std::vector<Key> *KeyResolutionCache::find(const Query &query) const
+{
+    const auto it = m_entries.constFind(query);
+    return it != m_entries.cend() ? &it->keys : nullptr;
+}
+
+void KeyResolutionCache::insert(const Query &query, const std::vector<Key> &keys, const std::vector<Key> &relevantKeys)
+{
+    remove(query);
+    Entry entry{keys, {}};
+    entry.fingerprints.reserve(keys.size() + relevantKeys.size());
+    for (const auto *keyList : {&keys, &relevantKeys}) {
+        for (const Key &key : *keyList) {
+            if (const char *const fpr = key.primaryFingerprint()) {
+                entry.fingerprints.emplace_back(fpr);
+            }
+        }
+    }
+    std::sort(entry.fingerprints.begin(), entry.fingerprints.end());
+    entry.fingerprints.erase(std::unique(entry.fingerprints.begin(), entry.fingerprints.end()), entry.fingerprints.end());
+    for (const QByteArray &fpr : entry.fingerprints) {
+        m_queriesByFingerprint.insert(fpr, query);
+    }
+    if (query.source == Keys) {
+        // any key with the address could become the best key for the address
+        m_queriesByEMail.insert(query.address, query);
+    }
+    m_entries.insert(query, std::move(entry));
+}
+
+void KeyResolutionCache::clear()
+{
+    m_entries.clear();
+    m_queriesByFingerprint.clear();
+    m_queriesByEMail.clear();
+}
+
+void KeyResolutionCache::remove(const Query &query)
+{
+    const auto it = m_entries.find(query);
+    if (it == m_entries.end()) {
+        return;
+    }
+    for (const QByteArray &fpr : std::as_const(it->fingerprints)) {
+        m_queriesByFingerprint.remove(fpr, query);
+    }
+    if (query.source == Keys) {
+        m_queriesByEMail.remove(query.address, query);
+    }
+    m_entries.erase(it);
+}
+
+void KeyResolutionCache::keysChanged(const std::vector<Key> &keys)
+{
+    m_keysChangedReceived = true;
+    if (m_entries.isEmpty()) {
+        return;
+    }
+    for (const Key &key : keys) {
+        if (const char *const fpr = key.primaryFingerprint()) {
+            const auto queries = m_queriesByFingerprint.values(QByteArray::fromRawData(fpr, qstrlen(fpr)));
+            for (const Query &query : queries) {
+                remove(query);
+            }
+        }
+        for (const std::string &email : KeyCacheIndex::emails(key)) {
+            const auto queries = m_queriesByEMail.values(QString::fromStdString(email).toLower());
+            for (const Query &query : queries) {
+                remove(query);
+            }
+        }
+    }
+}
+
+void KeyResolutionCache::keysMayHaveChanged()
+{
+    if (m_keysChangedReceived) {
+        // the changes have already been handled by keysChanged()
+        m_keysChangedReceived = false;
+        return;
+    }
+    clear();
+}
@@ -0,0 +1,93 @@
+/*
+    kleo/keyresolutioncache_p.h
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <libkleo/keycache.h>
+
+#include <QByteArray>
+#include <QHash>
+#include <QMetaObject>
+#include <QMultiHash>
+#include <QString>
+
+#include <gpgme++/key.h>
+
+#include <memory>
+#include <vector>
+
+namespace Kleo
+{
+
+/**
+ * Remembers the keys KeyResolverCore resolved for an address.
+ *
+ * The results are shared by all key resolvers using the same key cache. A
+ * result is forgotten when the key cache reports a change of one of the keys
+ * the result depends on or of a key with the resolved email address. All
+ * results are forgotten if the key cache reports changes without details,
+ * e.g. after a full key listing or after changes of the groups.
+ */
+class KeyResolutionCache
+{
+public:
+    enum Source : quint8 {
+        Keys, //< the best key for the address
+        Group, //< the keys of the group named like the address
+    };
+
+    struct Query {
+        QString address; //< the normalized address in lower case, or the group name
+        GpgME::Protocol protocol = GpgME::UnknownProtocol;
+        KeyCache::KeyUsage usage = KeyCache::KeyUsage::AnyUsage;
+        int minimumValidity = 0;
+        bool deVsCompliance = false; //< whether only de-vs compliant keys are acceptable
+        Source source = Keys;
+
+        bool operator==(const Query &other) const = default;
+    };
+
+    ~KeyResolutionCache();
+
+    /** Returns the resolution cache for the key cache @p keyCache. */
+    static std::shared_ptr<KeyResolutionCache> instance(const std::shared_ptr<const KeyCache> &keyCache);
+
+    /** Returns the remembered result of @p query or nullptr. */
+    const std::vector<GpgME::Key> *find(const Query &query) const;
+    /**
+     * Remembers the result @p keys of @p query. The result is forgotten if
+     * one of @p keys or of the additional keys @p relevantKeys changes.
+     */
+    void insert(const Query &query, const std::vector<GpgME::Key> &keys, const std::vector<GpgME::Key> &relevantKeys = {});
+    void clear();
+
+private:
+    explicit KeyResolutionCache(const std::shared_ptr<const KeyCache> &keyCache);
+
+    void keysChanged(const std::vector<GpgME::Key> &keys);
+    void keysMayHaveChanged();
+    void remove(const Query &query);
+
+private:
+    struct Entry {
+        std::vector<GpgME::Key> keys;
+        std::vector<QByteArray> fingerprints; // of the keys the result depends on
+    };
+
+    std::weak_ptr<const KeyCache> m_keyCache;
+    std::vector<QMetaObject::Connection> m_connections;
+    QHash<Query, Entry> m_entries;
+    QMultiHash<QByteArray, Query> m_queriesByFingerprint;
+    QMultiHash<QString, Query> m_queriesByEMail; // by lower-case address
+    bool m_keysChangedReceived = false;
+};
+
+size_t qHash(const KeyResolutionCache::Query &query, size_t seed = 0) noexcept;
+
+}
@@ -20,6 +20,7 @@
 
 #include "enum.h"
 #include "keygroup.h"
+#include "keyresolutioncache_p.h"
 
 #include <libkleo/compat.h>
 #include <libkleo/compliance.h>
@@ -90,6 +91,7 @@ public:
         , mEncrypt(enc)
         , mSign(sig)
         , mCache(KeyCache::instance())
+        , mResolutionCache(KeyResolutionCache::instance(mCache))
         , mPreferredProtocol(UnknownProtocol)
         , mMinimumValidity(UserID::Marginal)
     {
@@ -103,13 +105,16 @@ public:
     void addRecipients(const QStringList &addresses);
     void setOverrideKeys(const QMap<Protocol, QMap<QString, QStringList>> &overrides);
     void resolveOverrides();
+    KeyResolutionCache::Query resolutionQuery(const QString &address, Protocol protocol, KeyCache::KeyUsage usage, KeyResolutionCache::Source source) const;
     std::vector<Key> resolveRecipientWithGroup(const QString &address, Protocol protocol);
+    std::vector<Key> resolveRecipientWithGroup(const QString &address, const KeyGroup &group);
     void resolveEncryptionGroups();
     std::vector<Key> resolveSenderWithGroup(const QString &address, Protocol protocol);
+    std::vector<Key> resolveSenderWithGroup(const KeyGroup &group, Protocol protocol);
     void resolveSigningGroups();
     void resolveSign(Protocol proto);
     void setSigningKeys(const QStringList &fingerprints);
-    std::vector<Key> resolveRecipient(const QString &address, Protocol protocol);
+    std::vector<Key> resolveRecipient(const QString &address, const Key &key, Protocol protocol);
     void resolveEnc(Protocol proto);
     void mergeEncryptionKeys();
     Result resolve();
@@ -128,6 +133,9 @@ public:
     // The cache is needed as a member variable to avoid rebuilding
     // it between calls if we are the only user.
     std::shared_ptr<const KeyCache> mCache;
+    // the results of the resolution of addresses shared by all key resolvers
+    std::shared_ptr<KeyResolutionCache> mResolutionCache;
+    bool mDeVsCompliance = false;
     bool mAllowMixed = true;
     Protocol mPreferredProtocol;
     int mMinimumValidity;
@@ -285,17 +293,36 @@ void KeyResolverCore::Private::resolveOverrides()
     }
 }
 
+KeyResolutionCache::Query
+KeyResolverCore::Private::resolutionQuery(const QString &address, Protocol protocol, KeyCache::KeyUsage usage, KeyResolutionCache::Source source) const
+{
+    // group names are case-sensitive
+    return {source == KeyResolutionCache::Keys ? address.toLower() : address, protocol, usage, mMinimumValidity, mDeVsCompliance, source};
+}
+
 std::vector<Key> KeyResolverCore::Private::resolveSenderWithGroup(const QString &address, Protocol protocol)
 {
+    const auto query = resolutionQuery(address, protocol, KeyCache::KeyUsage::Sign, KeyResolutionCache::Group);
+    if (const auto keys = mResolutionCache->find(query)) {
+        return *keys;
+    }
+
     // prefer single-protocol groups over mixed-protocol groups
     auto group = mCache->findGroup(address, protocol, KeyCache::KeyUsage::Sign);
     if (group.isNull()) {
         group = mCache->findGroup(address, UnknownProtocol, KeyCache::KeyUsage::Sign);
     }
     if (group.isNull()) {
+        mResolutionCache->insert(query, {});
         return {};
     }
+    const std::vector<Key> result = resolveSenderWithGroup(group, protocol);
+    mResolutionCache->insert(query, result, std::vector<Key>(group.keys().begin(), group.keys().end()));
+    return result;
+}
 
+std::vector<Key> KeyResolverCore::Private::resolveSenderWithGroup(const KeyGroup &group, Protocol protocol)
+{
     // take the first key matching the protocol
     const auto &keys = group.keys();
     const auto it = std::find_if(std::begin(keys), std::end(keys), [protocol](const auto &key) {
@@ -348,15 +375,25 @@ void KeyResolverCore::Private::resolveSign(Protocol proto)
         // Explicitly set
         return;
     }
+    const auto query = resolutionQuery(mSender, proto, KeyCache::KeyUsage::Sign, KeyResolutionCache::Keys);
+    if (const auto keys = mResolutionCache->find(query)) {
+        if (!keys->empty()) {
+            mSigKeys.insert(proto, *keys);
+        }
+        return;
+    }
     const auto key = mCache->findBestByMailBox(mSender.toUtf8().constData(), proto, KeyCache::KeyUsage::Sign);
     if (key.isNull()) {
         qCDebug(LIBKLEO_LOG) << "Failed to find" << Formatting::displayName(proto) << "signing key for" << mSender;
+        mResolutionCache->insert(query, {});
         return;
     }
     if (!isAcceptableSigningKey(key)) {
         qCDebug(LIBKLEO_LOG) << "Unacceptable signing key" << key.primaryFingerprint() << "for" << mSender;
+        mResolutionCache->insert(query, {}, {key});
         return;
     }
+    mResolutionCache->insert(query, {key});
     mSigKeys.insert(proto, {key});
 }
 
@@ -376,11 +413,19 @@ void KeyResolverCore::Private::setSigningKeys(const QStringList &fingerprints)
 
 std::vector<Key> KeyResolverCore::Private::resolveRecipientWithGroup(const QString &address, Protocol protocol)
 {
-    const auto group = mCache->findGroup(address, protocol, KeyCache::KeyUsage::Encrypt);
-    if (group.isNull()) {
-        return {};
+    const auto query = resolutionQuery(address, protocol, KeyCache::KeyUsage::Encrypt, KeyResolutionCache::Group);
+    if (const auto keys = mResolutionCache->find(query)) {
+        return *keys;
     }
 
+    const auto group = mCache->findGroup(address, protocol, KeyCache::KeyUsage::Encrypt);
+    const std::vector<Key> result = group.isNull() ? std::vector<Key>{} : resolveRecipientWithGroup(address, group);
+    mResolutionCache->insert(query, result, std::vector<Key>(group.keys().begin(), group.keys().end()));
+    return result;
+}
+
+std::vector<Key> KeyResolverCore::Private::resolveRecipientWithGroup(const QString &address, const KeyGroup &group)
+{
     // If we have one unacceptable group key we reject the
     // whole group to avoid the situation where one key is
     // skipped or the operation fails.
@@ -446,9 +491,8 @@ void KeyResolverCore::Private::resolveEncryptionGroups()
     }
 }
 
-std::vector<Key> KeyResolverCore::Private::resolveRecipient(const QString &address, Protocol protocol)
+std::vector<Key> KeyResolverCore::Private::resolveRecipient(const QString &address, const Key &key, Protocol protocol)
 {
-    const auto key = mCache->findBestByMailBox(address.toUtf8().constData(), protocol, KeyCache::KeyUsage::Encrypt);
     if (key.isNull()) {
         qCDebug(LIBKLEO_LOG) << "Failed to find any" << Formatting::displayName(protocol) << "key for:" << address;
         return {};
@@ -464,6 +508,7 @@ std::vector<Key> KeyResolverCore::Private::resolveRecipient(const QString &addre
 // Try to find matching keys in the provided protocol for the unresolved addresses
 void KeyResolverCore::Private::resolveEnc(Protocol proto)
 {
+    std::vector<QMap<QString, QMap<Protocol, std::vector<Key>>>::iterator> unresolved;
     for (auto it = mEncKeys.begin(); it != mEncKeys.end(); ++it) {
         const QString &address = it.key();
         auto &protocolKeysMap = it.value();
@@ -482,7 +527,29 @@ void KeyResolverCore::Private::resolveEnc(Protocol proto)
                 continue;
             }
         }
-        protocolKeysMap[proto] = resolveRecipient(address, proto);
+        if (const auto keys = mResolutionCache->find(resolutionQuery(address, proto, KeyCache::KeyUsage::Encrypt, KeyResolutionCache::Keys))) {
+            protocolKeysMap[proto] = *keys;
+            continue;
+        }
+        unresolved.push_back(it);
+    }
+    if (unresolved.empty()) {
+        return;
+    }
+
+    // look up the best keys for all remaining addresses at once
+    std::vector<std::string> addresses;
+    addresses.reserve(unresolved.size());
+    for (const auto &it : unresolved) {
+        addresses.push_back(it.key().toStdString());
+    }
+    const std::vector<Key> keys = mCache->findBestByMailBoxes(addresses, proto, KeyCache::KeyUsage::Encrypt);
+    for (std::size_t i = 0; i < unresolved.size(); ++i) {
+        const QString &address = unresolved[i].key();
+        const std::vector<Key> result = resolveRecipient(address, keys[i], proto);
+        // remember the best key even if it is not acceptable, so that changes of this key invalidate the result
+        mResolutionCache->insert(resolutionQuery(address, proto, KeyCache::KeyUsage::Encrypt, KeyResolutionCache::Keys), result, {keys[i]});
+        unresolved[i].value()[proto] = result;
     }
 }
 
@@ -571,6 +638,8 @@ KeyResolverCore::Result KeyResolverCore::Private::resolve()
         return {AllResolved, {}, {}};
     }
 
+    mDeVsCompliance = DeVSCompliance::isCompliant();
+
     // First resolve through overrides
     resolveOverrides();
 
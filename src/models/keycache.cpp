@@ -14,34 +14,49 @@
 
 #include "keycache.h"
 #include "keycache_p.h"
+#include "keycacheindex_p.h"
+#include "keycacheindexfile_p.h"
+#include "keycachelightindex_p.h"
+#include "keycachesearchindex_p.h"
+#include "keycachesnapshot.h"
+#include "keygroupindex_p.h"
+#include "keysummary.h"
+#include "utils/keystate_p.h"
+#include "utils/parallel_p.h"
 
 #include <libkleo/algorithm.h>
 #include <libkleo/compat.h>
 #include <libkleo/debug.h>
-#include <libkleo/dn.h>
 #include <libkleo/enum.h>
 #include <libkleo/filesystemwatcher.h>
+#include <libkleo/formatting.h>
 #include <libkleo/gnupg.h>
 #include <libkleo/keygroup.h>
 #include <libkleo/keygroupconfig.h>
 #include <libkleo/keyhelpers.h>
 #include <libkleo/predicates.h>
 #include <libkleo/qtstlhelpers.h>
-#include <libkleo/stl_util.h>
 
 #include <libkleo_debug.h>
 
 #include <KSharedConfig>
 
 #include <QGpgME/CryptoConfig>
+#include <QGpgME/KeyListJob>
 #include <QGpgME/ListAllKeysJob>
 #include <QGpgME/Protocol>
 
+#include <QDateTime>
+#include <QDir>
 #include <QEventLoop>
+#include <QFileInfo>
+#include <QMutex>
+#include <QPromise>
+#include <QThread>
+#include <QThreadPool>
 #include <QPointer>
 #include <QTimer>
 
-#include <gpgme++/context.h>
 #include <gpgme++/decryptionresult.h>
 #include <gpgme++/error.h>
 #include <gpgme++/key.h>
@@ -54,6 +69,10 @@
 #include <chrono>
 #include <functional>
 #include <iterator>
+#include <list>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
 
 using namespace std::chrono_literals;
@@ -68,13 +87,6 @@ static const unsigned int hours2ms = 1000 * 60 * 60;
 //
 //
 
-namespace
-{
-
-make_comparator_str(ByEMail, .first.c_str());
-
-}
-
 class Kleo::KeyCacheAutoRefreshSuspension
 {
     KeyCacheAutoRefreshSuspension()
@@ -131,6 +143,10 @@ public:
         connect(&m_autoKeyListingTimer, &QTimer::timeout, q, [this]() {
             q->startKeyListing();
         });
+        connect(q, &KeyCache::keysMayHaveChanged, q, [this]() {
+            scheduleSnapshotUpdate();
+            m_searchIndex.reset();
+        });
         updateAutoKeyListingTimer();
     }
 
@@ -141,71 +157,37 @@ public:
         }
     }
 
-    template<template<template<typename U> class Op> class Comp>
-    std::vector<Key>::const_iterator find(const std::vector<Key> &keys, const char *key) const
-    {
-        ensureCachePopulated();
-        const auto it = std::lower_bound(keys.begin(), keys.end(), key, Comp<std::less>());
-        if (it == keys.end() || Comp<std::equal_to>()(*it, key)) {
-            return it;
-        } else {
-            return keys.end();
-        }
-    }
-
-    template<template<template<typename U> class Op> class Comp>
-    std::vector<Subkey>::const_iterator find(const std::vector<Subkey> &keys, const char *key) const
-    {
-        ensureCachePopulated();
-        const auto it = std::lower_bound(keys.begin(), keys.end(), key, Comp<std::less>());
-        if (it == keys.end() || Comp<std::equal_to>()(*it, key)) {
-            return it;
-        } else {
-            return keys.end();
-        }
-    }
-
-    std::vector<Key>::const_iterator find_fpr(const char *fpr) const
-    {
-        return find<_detail::ByFingerprint>(by.fpr, fpr);
-    }
-
-    std::pair<std::vector<std::pair<std::string, Key>>::const_iterator, std::vector<std::pair<std::string, Key>>::const_iterator>
-    find_email(const char *email) const
-    {
-        ensureCachePopulated();
-        return std::equal_range(by.email.begin(), by.email.end(), email, ByEMail<std::less>());
-    }
-
     std::vector<Key> find_mailbox(const QString &email, bool sign) const;
 
-    std::vector<Subkey>::const_iterator find_subkeyfpr(const char *subkeyfpr) const
-    {
-        return find<_detail::BySubkeyFingerprint>(by.subkeyfpr, subkeyfpr);
-    }
-
-    std::vector<Subkey>::const_iterator find_keygrip(const char *keygrip) const
-    {
-        return find<_detail::ByKeyGrip>(by.keygrip, keygrip);
-    }
-
-    std::vector<Subkey>::const_iterator find_subkeyid(const char *subkeyid) const
-    {
-        return find<_detail::ByKeyID>(by.subkeyid, subkeyid);
-    }
-
-    std::vector<Key>::const_iterator find_keyid(const char *keyid) const
-    {
-        return find<_detail::ByKeyID>(by.keyid, keyid);
-    }
+    void refreshJobDone(const KeyListResult &result);
 
-    std::pair<std::vector<Key>::const_iterator, std::vector<Key>::const_iterator> find_subjects(const char *chain_id) const
+    bool answersFromIndexFile() const
     {
-        ensureCachePopulated();
-        return std::equal_range(by.chainid.begin(), by.chainid.end(), chain_id, _detail::ByChainID<std::less>());
-    }
-
-    void refreshJobDone(const KeyListResult &result);
+        return !m_initalized && m_indexFile.isOpen();
+    }
+    void keyringsMayHaveChanged();
+    std::vector<std::pair<qint64, qint64>> keyringStamp() const;
+    void updateKeys(const std::vector<Key> &removedKeys, const std::vector<Key> &changedKeys);
+    void replaceIndex(KeyCacheIndex &&index);
+    void emitKeysMayHaveChanged();
+    void removeKeys(const std::vector<Key> &keys);
+    void replaceLightIndex(KeyCacheLightIndex &&lightIndex, const std::vector<Key> &keys);
+    void ensureDetailedKeys(KeyCacheLightIndex::Kind kind, const char *value);
+    void ensureDetailedKeys(KeyCacheLightIndex::Kind kind, const std::vector<std::string> &values);
+    void touchDetailedKeys(const std::vector<std::string> &fingerprints);
+    void evictDetailedKeys(std::size_t limit);
+    void scheduleEviction();
+    void forgetDetailedKeys(const std::vector<Key> &keys);
+    const Key &handOut(const Key &key);
+    const Subkey &handOut(const Subkey &subkey);
+    void scheduleSnapshotUpdate();
+    void publishSnapshot();
+    void updateCardsAndProtocols(const std::vector<Key> &keys);
+
+    const Key &findByFingerprintInIndexFile(const char *fpr);
+    std::vector<Key> findByEMailAddressInIndexFile(const char *email);
+    void fetchKeysFromIndexFile(const std::vector<KeyCacheIndexFile::KeyReference> &references);
+    void writeIndexFile();
 
     void setRefreshInterval(int interval)
     {
@@ -232,6 +214,9 @@ public:
     }
 
     void ensureCachePopulated() const;
+    void finishReadyPromises();
+    template<typename F>
+    auto whenReadyThen(F f) const -> QFuture<std::invoke_result_t<F>>;
 
     void readGroupsFromGpgConf()
     {
@@ -263,10 +248,27 @@ public:
             fingerprints[groupName].push_back(fingerprint);
         }
 
+        // fetch the keys of all groups at once
+        std::vector<std::string> allFingerprints;
+        for (const QStringList &groupFingerprints : std::as_const(fingerprints)) {
+            const auto stdFingerprints = toStdStrings(groupFingerprints);
+            allFingerprints.insert(allFingerprints.end(), stdFingerprints.begin(), stdFingerprints.end());
+        }
+        ensureDetailedKeys(KeyCacheLightIndex::Fingerprint, allFingerprints);
+
         // add all groups read from the configuration to the list of groups
         for (auto it = fingerprints.cbegin(); it != fingerprints.cend(); ++it) {
             const QString groupName = it.key();
-            const std::vector<Key> groupKeys = q->findByFingerprint(toStdStrings(it.value()));
+            std::vector<Key> groupKeys;
+            groupKeys.reserve(it.value().size());
+            for (const QString &fingerprint : it.value()) {
+                const Key &key = m_index.findByFingerprint(fingerprint.toLatin1().constData());
+                if (key.isNull()) {
+                    qCDebug(LIBKLEO_LOG) << __func__ << "Ignoring unknown key with fingerprint:" << fingerprint;
+                    continue;
+                }
+                groupKeys.push_back(key);
+            }
             KeyGroup g(groupName, groupName, groupKeys, KeyGroup::GnuPGConfig);
             m_groups.push_back(g);
         }
@@ -330,6 +332,23 @@ public:
             readGroupsFromGpgConf();
             readGroupsFromGroupsConfig();
         }
+        m_groupIndex.rebuild(m_groups);
+    }
+
+    // replaces the old versions of @p keys in the groups
+    void updateGroupKeys(const std::vector<Key> &keys)
+    {
+        if (m_groups.empty()) {
+            return;
+        }
+        for (const Key &key : keys) {
+            for (const std::size_t position : m_groupIndex.groupsContaining(key.primaryFingerprint())) {
+                KeyGroup &group = m_groups[position];
+                group.erase(key);
+                group.insert(key);
+                m_groupIndex.updateSummary(position, group);
+            }
+        }
     }
 
     bool insert(const KeyGroup &group)
@@ -355,6 +374,7 @@ public:
         }
 
         m_groups.push_back(savedGroup);
+        m_groupIndex.rebuild(m_groups);
 
         Q_EMIT q->groupAdded(savedGroup);
 
@@ -385,6 +405,7 @@ public:
         }
 
         m_groups[groupIndex] = savedGroup;
+        m_groupIndex.rebuild(m_groups);
 
         Q_EMIT q->groupUpdated(savedGroup);
 
@@ -414,6 +435,7 @@ public:
         }
 
         m_groups.erase(it);
+        m_groupIndex.rebuild(m_groups);
 
         Q_EMIT q->groupRemoved(group);
 
@@ -426,18 +448,45 @@ private:
     QTimer m_autoKeyListingTimer;
     int m_refreshInterval;
 
-    struct By {
-        std::vector<Key> fpr, keyid, chainid;
-        std::vector<std::pair<std::string, Key>> email;
-        std::vector<Subkey> subkeyfpr, subkeyid, keygrip;
-    } by;
+    KeyCacheIndex m_index;
     bool m_initalized;
     bool m_pgpOnly;
     bool m_remarks_enabled;
     bool m_groupsEnabled = false;
     std::shared_ptr<KeyGroupConfig> m_groupConfig;
     std::vector<KeyGroup> m_groups;
+    KeyGroupIndex m_groupIndex;
     std::unordered_map<QByteArray, std::vector<CardKeyStorageInfo>> m_cards;
+    // modification times and sizes of the keyrings at the start of the last key listing
+    std::vector<std::pair<qint64, qint64>> m_keyringStamp;
+    QString m_indexFileName;
+    KeyCacheIndexFile m_indexFile;
+    // keys fetched with the help of the index file (or null keys if gpg didn't find them);
+    // used until the first key listing has finished
+    std::unordered_map<std::string, Key> m_keysFromIndexFile;
+    std::vector<std::shared_ptr<QPromise<void>>> m_readyPromises;
+    mutable QMutex m_snapshotMutex; // guards m_snapshot
+    std::shared_ptr<const KeyCacheSnapshot> m_snapshot = std::make_shared<const KeyCacheSnapshot>(std::vector<Key>{});
+    bool m_snapshotUpdatePending = false;
+    std::unique_ptr<KeyCacheSearchIndex> m_searchIndex; // built on demand
+    bool m_lightMode = false;
+    std::size_t m_detailedKeysLimit = 1000;
+    KeyCacheLightIndex m_lightIndex;
+    // fingerprints of the keys held in full in light mode; the most recently used key comes first
+    std::list<std::string> m_detailedKeys;
+    std::unordered_map<std::string, std::list<std::string>::iterator> m_detailedKeysPositions;
+    // copies of the keys of the working set which have been returned by reference in light mode;
+    // the elements of the map do not move, so that the references stay valid until the keys are
+    // evicted (never in the event loop iteration in which they were looked up) or updated
+    struct HandedOutKey {
+        Key key;
+        std::vector<Subkey> subkeys;
+    };
+    std::unordered_map<std::string, HandedOutKey> m_handedOutKeys;
+    bool m_evictionPending = false;
+    // the keys added, updated or removed since the last emission of keysMayHaveChanged()
+    std::vector<Key> m_changedKeys;
+    bool m_allKeysChanged = false;
 };
 
 std::shared_ptr<const KeyCache> KeyCache::instance()
@@ -519,6 +568,7 @@ void KeyCache::reload(GpgME::Protocol /*proto*/, ReloadOption option)
     d->updateAutoKeyListingTimer();
 
     enableFileSystemWatcher(false);
+    d->m_keyringStamp = d->keyringStamp();
     d->m_refreshJob = new RefreshKeysJob(this);
     connect(d->m_refreshJob.data(), &RefreshKeysJob::done, this, [this](const GpgME::KeyListResult &r) {
         qCDebug(LIBKLEO_LOG) << d->m_refreshJob.data() << "RefreshKeysJob::done";
@@ -546,10 +596,10 @@ void KeyCache::addFileSystemWatcher(const std::shared_ptr<FileSystemWatcher> &wa
     }
     d->m_fsWatchers.push_back(watcher);
     connect(watcher.get(), &FileSystemWatcher::directoryChanged, this, [this]() {
-        startKeyListing();
+        d->keyringsMayHaveChanged();
     });
     connect(watcher.get(), &FileSystemWatcher::fileChanged, this, [this]() {
-        startKeyListing();
+        d->keyringsMayHaveChanged();
     });
 
     watcher->setEnabled(d->m_refreshJob.isNull());
@@ -557,15 +607,8 @@ void KeyCache::addFileSystemWatcher(const std::shared_ptr<FileSystemWatcher> &wa
 
 void KeyCache::enableRemarks(bool value)
 {
-    if (!d->m_remarks_enabled && value) {
-        d->m_remarks_enabled = value;
-        if (d->m_initalized && !d->m_refreshJob) {
-            qCDebug(LIBKLEO_LOG) << "Reloading keycache with remarks enabled";
-            reload();
-        }
-    } else {
-        d->m_remarks_enabled = value;
-    }
+    // the key list models load the remarks of the displayed keys on demand
+    d->m_remarks_enabled = value;
 }
 
 bool KeyCache::remarksEnabled() const
@@ -573,34 +616,407 @@ bool KeyCache::remarksEnabled() const
     return d->m_remarks_enabled;
 }
 
+void KeyCache::setIndexFileName(const QString &fileName)
+{
+    d->m_indexFileName = fileName;
+    d->m_indexFile.close();
+    d->m_keysFromIndexFile.clear();
+    if (!d->m_initalized && !fileName.isEmpty()) {
+        if (d->m_indexFile.open(fileName)) {
+            qCDebug(LIBKLEO_LOG) << __func__ << "Using key index file" << fileName << "until the first key listing has finished";
+        }
+    }
+}
+
 void KeyCache::Private::refreshJobDone(const KeyListResult &result)
 {
     m_refreshJob.clear();
     q->enableFileSystemWatcher(true);
-    if (!m_initalized && q->remarksEnabled()) {
-        // trigger another key listing to read signatures and signature notations
-        QMetaObject::invokeMethod(
-            q,
-            [this]() {
-                qCDebug(LIBKLEO_LOG) << "Reloading keycache with remarks enabled";
-                q->reload();
-            },
-            Qt::QueuedConnection);
-    }
     m_initalized = true;
+    m_indexFile.close();
+    m_keysFromIndexFile.clear();
+    // only write the index file if the cache contains the complete result of the key listing
+    if (!result.error() && !result.error().isCanceled() && !m_lightMode) {
+        writeIndexFile();
+    }
     updateGroupCache();
+    finishReadyPromises();
     Q_EMIT q->keyListingDone(result);
 }
 
-const Key &KeyCache::findByFingerprint(const char *fpr) const
+std::vector<std::pair<qint64, qint64>> KeyCache::Private::keyringStamp() const
+{
+    // the files (and directories) of the GnuPG home whose changes affect the result of a key listing
+    static const QStringList keyringFiles = {
+        QStringLiteral("pubring.kbx"),
+        QStringLiteral("pubring.gpg"),
+        QStringLiteral("public-keys.d/pubring.db"),
+        // keyboxd writes the changes to the write-ahead log of the database first
+        QStringLiteral("public-keys.d/pubring.db-wal"),
+        QStringLiteral("public-keys.d/pubring.db-shm"),
+        QStringLiteral("trustdb.gpg"),
+        QStringLiteral("trustlist.txt"),
+        QStringLiteral("private-keys-v1.d"),
+    };
+    const QDir gnupgHome{gnupgHomeDirectory()};
+    std::vector<std::pair<qint64, qint64>> stamp;
+    stamp.reserve(keyringFiles.size());
+    for (const auto &fileName : keyringFiles) {
+        const QFileInfo fi{gnupgHome.filePath(fileName)};
+        stamp.emplace_back(fi.exists() ? fi.lastModified().toMSecsSinceEpoch() : -1, fi.exists() ? fi.size() : -1);
+    }
+    // the modification time of the directory with the secret keys only changes if key files
+    // are added, removed or renamed, but not if an existing key file is rewritten
+    const QDir privateKeysDir{gnupgHome.filePath(QStringLiteral("private-keys-v1.d"))};
+    const auto privateKeyFiles = privateKeysDir.entryInfoList(QDir::Files | QDir::Hidden, QDir::Name);
+    for (const QFileInfo &fi : privateKeyFiles) {
+        stamp.emplace_back(fi.lastModified().toMSecsSinceEpoch(), fi.size());
+    }
+    return stamp;
+}
+
+void KeyCache::Private::keyringsMayHaveChanged()
+{
+    // the file system watchers also report changes of unrelated files in the GnuPG home
+    // (e.g. random_seed or sockets); only relist the keys if one of the keyrings has changed
+    if (m_initalized && !m_refreshJob && keyringStamp() == m_keyringStamp) {
+        qCDebug(LIBKLEO_LOG) << __func__ << "Keyrings are unchanged. Skipping key listing.";
+        return;
+    }
+    q->startKeyListing();
+}
+
+void KeyCache::Private::updateKeys(const std::vector<Key> &removedKeys, const std::vector<Key> &changedKeys)
 {
-    const std::vector<Key>::const_iterator it = d->find_fpr(fpr);
-    if (it == d->by.fpr.end()) {
-        static const Key null;
-        return null;
+    qCDebug(LIBKLEO_LOG) << __func__ << "removed keys:" << removedKeys.size() << "new or changed keys:" << changedKeys.size();
+    if (removedKeys.empty() && changedKeys.empty()) {
+        return;
+    }
+    // emit only one notification for the removed and the changed keys
+    removeKeys(removedKeys);
+    if (!changedKeys.empty()) {
+        q->insert(changedKeys);
     } else {
-        return *it;
+        emitKeysMayHaveChanged();
+    }
+}
+
+void KeyCache::Private::replaceIndex(KeyCacheIndex &&index)
+{
+    m_index = std::move(index);
+    m_cards.clear();
+    KeyState::clear();
+    KeyState::update(m_index.keys());
+    updateCardsAndProtocols(m_index.keys());
+    m_allKeysChanged = true;
+    emitKeysMayHaveChanged();
+}
+
+void KeyCache::Private::emitKeysMayHaveChanged()
+{
+    if (!m_allKeysChanged) {
+        Q_EMIT q->keysChanged(m_changedKeys);
+    }
+    m_changedKeys.clear();
+    m_allKeysChanged = false;
+    Q_EMIT q->keysMayHaveChanged();
+}
+
+namespace
+{
+// Lists the keys with the given fingerprints synchronously, i.e. this blocks the calling thread
+// (usually the GUI thread) until gpg has listed the keys. It's only used for the few keys needed
+// to answer a lookup from the index file or in light mode.
+std::vector<Key> listKeysByFingerprint(GpgME::Protocol proto, const QStringList &fingerprints)
+{
+    const auto *const protocol = (proto == GpgME::OpenPGP) ? QGpgME::openpgp() : QGpgME::smime();
+    if (fingerprints.empty() || !protocol) {
+        return {};
+    }
+    const std::unique_ptr<QGpgME::KeyListJob> job{protocol->keyListJob(/*remote*/ false, /*includeSigs*/ false, /*validate*/ true)};
+    if (!job) {
+        return {};
+    }
+    std::vector<Key> keys;
+    const KeyListResult result = job->exec(fingerprints, /*secretOnly*/ false, keys);
+    if (result.error()) {
+        qCDebug(LIBKLEO_LOG) << __func__ << "Listing keys by fingerprint failed:" << Formatting::errorAsString(result.error());
+    }
+    return keys;
+}
+}
+
+void KeyCache::Private::replaceLightIndex(KeyCacheLightIndex &&lightIndex, const std::vector<Key> &keys)
+{
+    m_lightIndex = std::move(lightIndex);
+    // keep the full keys of the working set which are still there
+    std::vector<Key> detailedKeys;
+    for (const Key &key : keys) {
+        const char *fpr = key.primaryFingerprint();
+        if (fpr && m_detailedKeysPositions.find(fpr) != m_detailedKeysPositions.end()) {
+            detailedKeys.push_back(key);
+        }
+    }
+    if (detailedKeys.size() != m_detailedKeys.size()) {
+        m_detailedKeys.remove_if([this](const std::string &fpr) {
+            return m_lightIndex.find(KeyCacheLightIndex::PrimaryFingerprint, fpr.c_str()).empty();
+        });
+        m_detailedKeysPositions.clear();
+        for (auto it = m_detailedKeys.begin(); it != m_detailedKeys.end(); ++it) {
+            m_detailedKeysPositions.emplace(*it, it);
+        }
+    }
+    KeyCacheIndex index;
+    index.insert(detailedKeys);
+    replaceIndex(std::move(index));
+    m_handedOutKeys.clear();
+}
+
+void KeyCache::Private::ensureDetailedKeys(KeyCacheLightIndex::Kind kind, const char *value)
+{
+    if (!m_lightMode || !value || !*value) {
+        return;
+    }
+    ensureDetailedKeys(kind, std::vector<std::string>{value});
+}
+
+void KeyCache::Private::ensureDetailedKeys(KeyCacheLightIndex::Kind kind, const std::vector<std::string> &values)
+{
+    if (!m_lightMode) {
+        return;
+    }
+    std::vector<std::string> usedKeys;
+    QStringList missingKeys[2];
+    for (const std::string &value : values) {
+        for (const KeySummary *summary : m_lightIndex.find(kind, value.c_str())) {
+            usedKeys.push_back(summary->fingerprint);
+            if (m_index.findByFingerprint(summary->fingerprint.c_str()).isNull()) {
+                missingKeys[summary->protocol == GpgME::CMS ? 1 : 0].push_back(QString::fromStdString(summary->fingerprint));
+            }
+        }
+    }
+    std::vector<Key> fetchedKeys;
+    for (const auto proto : {GpgME::OpenPGP, GpgME::CMS}) {
+        QStringList &fingerprints = missingKeys[proto == GpgME::CMS ? 1 : 0];
+        fingerprints.removeDuplicates();
+        const auto keys = listKeysByFingerprint(proto, fingerprints);
+        fetchedKeys.insert(fetchedKeys.end(), keys.begin(), keys.end());
+    }
+    if (!fetchedKeys.empty()) {
+        qCDebug(LIBKLEO_LOG) << __func__ << "Fetched" << fetchedKeys.size() << "keys";
+        // the cache contents do not change; only the full keys are now at hand
+        m_index.insert(fetchedKeys);
+        KeyState::update(fetchedKeys);
+        updateCardsAndProtocols(fetchedKeys);
+    }
+    touchDetailedKeys(usedKeys);
+    // the references returned by the current lookup must stay valid for now
+    scheduleEviction();
+}
+
+void KeyCache::Private::touchDetailedKeys(const std::vector<std::string> &fingerprints)
+{
+    for (const std::string &fpr : fingerprints) {
+        const auto it = m_detailedKeysPositions.find(fpr);
+        if (it != m_detailedKeysPositions.end()) {
+            m_detailedKeys.splice(m_detailedKeys.begin(), m_detailedKeys, it->second);
+        } else if (!m_index.findByFingerprint(fpr.c_str()).isNull()) {
+            m_detailedKeys.push_front(fpr);
+            m_detailedKeysPositions.emplace(fpr, m_detailedKeys.begin());
+        }
+    }
+}
+
+void KeyCache::Private::evictDetailedKeys(std::size_t limit)
+{
+    std::vector<Key> evictedKeys;
+    while (m_detailedKeys.size() > limit) {
+        const std::string &fpr = m_detailedKeys.back();
+        const Key &key = m_index.findByFingerprint(fpr.c_str());
+        if (!key.isNull()) {
+            evictedKeys.push_back(key);
+        }
+        m_detailedKeysPositions.erase(fpr);
+        m_handedOutKeys.erase(fpr);
+        m_detailedKeys.pop_back();
+    }
+    if (!evictedKeys.empty()) {
+        m_index.remove(evictedKeys);
+        KeyState::forget(evictedKeys);
+    }
+}
+
+void KeyCache::Private::scheduleEviction()
+{
+    // evict the surplus keys in the next event loop iteration, so that the keys
+    // handed out by reference in the current iteration are not destroyed
+    if (m_evictionPending || m_detailedKeys.size() <= m_detailedKeysLimit) {
+        return;
+    }
+    m_evictionPending = true;
+    QMetaObject::invokeMethod(
+        q,
+        [this]() {
+            if (m_evictionPending) {
+                m_evictionPending = false;
+                evictDetailedKeys(m_detailedKeysLimit);
+            }
+        },
+        Qt::QueuedConnection);
+}
+
+void KeyCache::Private::forgetDetailedKeys(const std::vector<Key> &keys)
+{
+    for (const Key &key : keys) {
+        if (!key.primaryFingerprint()) {
+            continue;
+        }
+        m_handedOutKeys.erase(key.primaryFingerprint());
+        const auto it = m_detailedKeysPositions.find(key.primaryFingerprint());
+        if (it != m_detailedKeysPositions.end()) {
+            m_detailedKeys.erase(it->second);
+            m_detailedKeysPositions.erase(it);
+        }
+    }
+}
+
+const Key &KeyCache::Private::handOut(const Key &key)
+{
+    // in light mode, lookups may insert keys into m_index which invalidates
+    // the references into m_index returned by earlier lookups
+    if (!m_lightMode || key.isNull() || !key.primaryFingerprint()) {
+        return key;
+    }
+    auto [it, inserted] = m_handedOutKeys.try_emplace(key.primaryFingerprint());
+    if (inserted) {
+        it->second.key = key;
+        it->second.subkeys = key.subkeys();
+    }
+    return it->second.key;
+}
+
+const Subkey &KeyCache::Private::handOut(const Subkey &subkey)
+{
+    if (!m_lightMode || subkey.isNull()) {
+        return subkey;
+    }
+    const Key &key = handOut(subkey.parent());
+    if (key.isNull()) {
+        return subkey;
+    }
+    const auto &subkeys = m_handedOutKeys[key.primaryFingerprint()].subkeys;
+    const auto it = std::find_if(subkeys.begin(), subkeys.end(), [&subkey](const Subkey &candidate) {
+        return qstrcmp(candidate.fingerprint(), subkey.fingerprint()) == 0 && qstrcmp(candidate.keyID(), subkey.keyID()) == 0;
+    });
+    return it != subkeys.end() ? *it : subkey;
+}
+
+void KeyCache::Private::scheduleSnapshotUpdate()
+{
+    // coalesce the updates of the key cache, e.g. while inserting many keys one by one
+    if (m_snapshotUpdatePending) {
+        return;
     }
+    m_snapshotUpdatePending = true;
+    QMetaObject::invokeMethod(
+        q,
+        [this]() {
+            if (m_snapshotUpdatePending) {
+                publishSnapshot();
+            }
+        },
+        Qt::QueuedConnection);
+}
+
+void KeyCache::Private::publishSnapshot()
+{
+    m_snapshotUpdatePending = false;
+    auto snapshot = std::make_shared<const KeyCacheSnapshot>(m_index.keys());
+    const QMutexLocker locker{&m_snapshotMutex};
+    // the previous snapshot is released after the mutex has been unlocked
+    m_snapshot.swap(snapshot);
+}
+
+std::shared_ptr<const KeyCacheSnapshot> KeyCache::snapshot() const
+{
+    if (thread() == QThread::currentThread() && d->m_snapshotUpdatePending) {
+        d->publishSnapshot();
+    }
+    const QMutexLocker locker{&d->m_snapshotMutex};
+    return d->m_snapshot;
+}
+
+void KeyCache::Private::fetchKeysFromIndexFile(const std::vector<KeyCacheIndexFile::KeyReference> &references)
+{
+    QStringList patterns[2];
+    for (const auto &ref : references) {
+        if (m_keysFromIndexFile.find(ref.fingerprint.toStdString()) != m_keysFromIndexFile.end()) {
+            continue;
+        }
+        patterns[ref.protocol == GpgME::CMS ? 1 : 0].push_back(QString::fromLatin1(ref.fingerprint));
+    }
+    for (const auto &ref : references) {
+        // remember the key as unknown until gpg tells us otherwise
+        m_keysFromIndexFile.emplace(ref.fingerprint.toStdString(), Key{});
+    }
+    for (const auto proto : {GpgME::OpenPGP, GpgME::CMS}) {
+        const auto keys = listKeysByFingerprint(proto, patterns[proto == GpgME::CMS ? 1 : 0]);
+        for (const auto &key : keys) {
+            if (const char *fpr = key.primaryFingerprint()) {
+                m_keysFromIndexFile[QByteArray{fpr}.toUpper().toStdString()] = key;
+            }
+        }
+    }
+}
+
+const Key &KeyCache::Private::findByFingerprintInIndexFile(const char *fpr)
+{
+    static const Key null;
+    // make sure that the real key listing is running while we answer from the index file
+    if (!m_refreshJob) {
+        q->startKeyListing();
+    }
+    const std::string normalizedFpr = QByteArray{fpr}.toUpper().toStdString();
+    auto it = m_keysFromIndexFile.find(normalizedFpr);
+    if (it == m_keysFromIndexFile.end()) {
+        auto references = m_indexFile.find(KeyCacheIndexFile::Fingerprint, fpr);
+        if (references.empty()) {
+            // the key may have been added after the index file was written; ask gpg directly
+            const QByteArray fingerprint{normalizedFpr.c_str()};
+            references = {{fingerprint, GpgME::OpenPGP}, {fingerprint, GpgME::CMS}};
+        }
+        fetchKeysFromIndexFile(references);
+        it = m_keysFromIndexFile.find(normalizedFpr);
+    }
+    return it != m_keysFromIndexFile.end() ? it->second : null;
+}
+
+std::vector<Key> KeyCache::Private::findByEMailAddressInIndexFile(const char *email)
+{
+    if (!m_refreshJob) {
+        q->startKeyListing();
+    }
+    const auto references = m_indexFile.find(KeyCacheIndexFile::EMail, email);
+    fetchKeysFromIndexFile(references);
+    std::vector<Key> result;
+    result.reserve(references.size());
+    for (const auto &ref : references) {
+        const auto it = m_keysFromIndexFile.find(ref.fingerprint.toStdString());
+        if (it != m_keysFromIndexFile.end() && !it->second.isNull()) {
+            result.push_back(it->second);
+        }
+    }
+    return result;
+}
+
+const Key &KeyCache::findByFingerprint(const char *fpr) const
+{
+    if (fpr && d->answersFromIndexFile()) {
+        return d->findByFingerprintInIndexFile(fpr);
+    }
+    d->ensureCachePopulated();
+    d->ensureDetailedKeys(KeyCacheLightIndex::Fingerprint, fpr);
+    return d->handOut(d->m_index.findByFingerprint(fpr));
 }
 
 const Key &KeyCache::findByFingerprint(const std::string &fpr) const
@@ -610,10 +1026,15 @@ const Key &KeyCache::findByFingerprint(const std::string &fpr) const
 
 std::vector<GpgME::Key> KeyCache::findByFingerprint(const std::vector<std::string> &fprs) const
 {
+    const bool fromIndexFile = d->answersFromIndexFile();
+    if (!fromIndexFile) {
+        d->ensureCachePopulated();
+        d->ensureDetailedKeys(KeyCacheLightIndex::Fingerprint, fprs);
+    }
     std::vector<Key> keys;
     keys.reserve(fprs.size());
     for (const auto &fpr : fprs) {
-        const Key key = findByFingerprint(fpr.c_str());
+        const Key key = fromIndexFile ? findByFingerprint(fpr.c_str()) : d->m_index.findByFingerprint(fpr.c_str());
         if (key.isNull()) {
             qCDebug(LIBKLEO_LOG) << __func__ << "Ignoring unknown key with fingerprint:" << fpr.c_str();
             continue;
@@ -625,13 +1046,12 @@ std::vector<GpgME::Key> KeyCache::findByFingerprint(const std::vector<std::strin
 
 std::vector<Key> KeyCache::findByEMailAddress(const char *email) const
 {
-    const auto pair = d->find_email(email);
-    std::vector<Key> result;
-    result.reserve(std::distance(pair.first, pair.second));
-    std::transform(pair.first, pair.second, std::back_inserter(result), [](const std::pair<std::string, Key> &pair) {
-        return pair.second;
-    });
-    return result;
+    if (email && d->answersFromIndexFile()) {
+        return d->findByEMailAddressInIndexFile(email);
+    }
+    d->ensureCachePopulated();
+    d->ensureDetailedKeys(KeyCacheLightIndex::EMail, email);
+    return d->m_index.findByEMailAddress(email);
 }
 
 std::vector<Key> KeyCache::findByEMailAddress(const std::string &email) const
@@ -639,24 +1059,27 @@ std::vector<Key> KeyCache::findByEMailAddress(const std::string &email) const
     return findByEMailAddress(email.c_str());
 }
 
-const Key &KeyCache::findByKeyIDOrFingerprint(const char *id) const
+std::vector<Key> KeyCache::search(QStringView text, std::size_t limit) const
 {
-    {
-        // try by.fpr first:
-        const std::vector<Key>::const_iterator it = d->find_fpr(id);
-        if (it != d->by.fpr.end()) {
-            return *it;
-        }
+    d->ensureCachePopulated();
+    if (!d->m_searchIndex) {
+        d->m_searchIndex = std::make_unique<KeyCacheSearchIndex>(d->m_index.keys());
     }
-    {
-        // try by.keyid next:
-        const std::vector<Key>::const_iterator it = d->find_keyid(id);
-        if (it != d->by.keyid.end()) {
-            return *it;
-        }
+    return d->m_searchIndex->search(text, limit);
+}
+
+const Key &KeyCache::findByKeyIDOrFingerprint(const char *id) const
+{
+    d->ensureCachePopulated();
+    d->ensureDetailedKeys(KeyCacheLightIndex::Fingerprint, id);
+    d->ensureDetailedKeys(KeyCacheLightIndex::KeyID, id);
+    // try fingerprint first:
+    const Key &key = d->m_index.findByFingerprint(id);
+    if (!key.isNull()) {
+        return d->handOut(key);
     }
-    static const Key null;
-    return null;
+    // try key ID next:
+    return d->handOut(d->m_index.findByKeyID(id));
 }
 
 const Key &KeyCache::findByKeyIDOrFingerprint(const std::string &id) const
@@ -666,33 +1089,21 @@ const Key &KeyCache::findByKeyIDOrFingerprint(const std::string &id) const
 
 std::vector<Key> KeyCache::findByKeyIDOrFingerprint(const std::vector<std::string> &ids) const
 {
-    std::vector<std::string> keyids;
-    std::remove_copy_if(ids.begin(), ids.end(), std::back_inserter(keyids), [](const std::string &str) {
-        return !str.c_str() || !*str.c_str();
-    });
-
-    // this is just case-insensitive string search:
-    std::sort(keyids.begin(), keyids.end(), _detail::ByFingerprint<std::less>());
-
     std::vector<Key> result;
-    result.reserve(keyids.size()); // dups shouldn't happen
+    result.reserve(ids.size()); // dups shouldn't happen
     d->ensureCachePopulated();
+    d->ensureDetailedKeys(KeyCacheLightIndex::Fingerprint, ids);
+    d->ensureDetailedKeys(KeyCacheLightIndex::KeyID, ids);
 
-    kdtools::set_intersection(d->by.fpr.begin(),
-                              d->by.fpr.end(),
-                              keyids.begin(),
-                              keyids.end(),
-                              std::back_inserter(result),
-                              _detail::ByFingerprint<std::less>());
-    if (result.size() < keyids.size()) {
-        // note that By{Fingerprint,KeyID} define the same
-        // order for _strings_
-        kdtools::set_intersection(d->by.keyid.begin(),
-                                  d->by.keyid.end(),
-                                  keyids.begin(),
-                                  keyids.end(),
-                                  std::back_inserter(result),
-                                  _detail::ByKeyID<std::less>());
+    for (const std::string &id : ids) {
+        if (id.empty()) {
+            continue;
+        }
+        const Key &keyByFingerprint = d->m_index.findByFingerprint(id.c_str());
+        const Key &key = keyByFingerprint.isNull() ? d->m_index.findByKeyID(id.c_str()) : keyByFingerprint;
+        if (!key.isNull()) {
+            result.push_back(key);
+        }
     }
     // duplicates shouldn't happen, but make sure nonetheless:
     std::sort(result.begin(), result.end(), _detail::ByFingerprint<std::less>());
@@ -708,16 +1119,10 @@ const Subkey &KeyCache::findSubkeyByKeyGrip(const char *grip, Protocol protocol)
 {
     static const Subkey null;
     d->ensureCachePopulated();
-    const auto range = std::equal_range(d->by.keygrip.begin(), d->by.keygrip.end(), grip, _detail::ByKeyGrip<std::less>());
-    if (range.first == range.second) {
-        return null;
-    } else if (protocol == UnknownProtocol) {
-        return *range.first;
-    } else {
-        for (auto it = range.first; it != range.second; ++it) {
-            if (it->parent().protocol() == protocol) {
-                return *it;
-            }
+    d->ensureDetailedKeys(KeyCacheLightIndex::KeyGrip, grip);
+    for (const Subkey *subkey : d->m_index.findSubkeysByKeyGrip(grip)) {
+        if (protocol == UnknownProtocol || subkey->parent().protocol() == protocol) {
+            return d->handOut(*subkey);
         }
     }
     return null;
@@ -731,16 +1136,13 @@ const Subkey &KeyCache::findSubkeyByKeyGrip(const std::string &grip, Protocol pr
 std::vector<GpgME::Subkey> Kleo::KeyCache::findSubkeysByKeyGrip(const char *grip, GpgME::Protocol protocol) const
 {
     d->ensureCachePopulated();
+    d->ensureDetailedKeys(KeyCacheLightIndex::KeyGrip, grip);
 
     std::vector<GpgME::Subkey> subkeys;
-    const auto range = std::equal_range(d->by.keygrip.begin(), d->by.keygrip.end(), grip, _detail::ByKeyGrip<std::less>());
-    subkeys.reserve(std::distance(range.first, range.second));
-    if (protocol == UnknownProtocol) {
-        std::copy(range.first, range.second, std::back_inserter(subkeys));
-    } else {
-        std::copy_if(range.first, range.second, std::back_inserter(subkeys), [protocol](const auto &subkey) {
-            return subkey.parent().protocol() == protocol;
-        });
+    for (const Subkey *subkey : d->m_index.findSubkeysByKeyGrip(grip)) {
+        if (protocol == UnknownProtocol || subkey->parent().protocol() == protocol) {
+            subkeys.push_back(*subkey);
+        }
     }
     return subkeys;
 }
@@ -752,34 +1154,21 @@ std::vector<GpgME::Subkey> Kleo::KeyCache::findSubkeysByKeyGrip(const std::strin
 
 std::vector<Subkey> KeyCache::findSubkeysByKeyID(const std::vector<std::string> &ids) const
 {
-    std::vector<std::string> sorted;
-    sorted.reserve(ids.size());
-    std::remove_copy_if(ids.begin(), ids.end(), std::back_inserter(sorted), [](const std::string &str) {
-        return !str.c_str() || !*str.c_str();
-    });
-
-    std::sort(sorted.begin(), sorted.end(), _detail::ByKeyID<std::less>());
-
     std::vector<Subkey> result;
     d->ensureCachePopulated();
-    kdtools::set_intersection(d->by.subkeyid.begin(),
-                              d->by.subkeyid.end(),
-                              sorted.begin(),
-                              sorted.end(),
-                              std::back_inserter(result),
-                              _detail::ByKeyID<std::less>());
+    d->ensureDetailedKeys(KeyCacheLightIndex::KeyID, ids);
+    for (const std::string &id : ids) {
+        const auto subkeys = d->m_index.findSubkeysByKeyID(id.c_str());
+        result.insert(result.end(), subkeys.begin(), subkeys.end());
+    }
     return result;
 }
 
 const GpgME::Subkey &KeyCache::findSubkeyByFingerprint(const std::string &fpr) const
 {
-    static const Subkey null;
-
-    const auto it = d->find_subkeyfpr(fpr.c_str());
-    if (it != d->by.subkeyfpr.end()) {
-        return *it;
-    }
-    return null;
+    d->ensureCachePopulated();
+    d->ensureDetailedKeys(KeyCacheLightIndex::Fingerprint, fpr.c_str());
+    return d->handOut(d->m_index.findSubkeyByFingerprint(fpr.c_str()));
 }
 
 std::vector<Key> KeyCache::findRecipients(const DecryptionResult &res) const
@@ -835,11 +1224,15 @@ std::vector<Key> KeyCache::findSigners(const VerificationResult &res) const
 
 std::vector<Key> KeyCache::findSigningKeysByMailbox(const QString &mb) const
 {
+    d->ensureCachePopulated();
+    d->ensureDetailedKeys(KeyCacheLightIndex::EMail, mb.toUtf8().constData());
     return d->find_mailbox(mb, true);
 }
 
 std::vector<Key> KeyCache::findEncryptionKeysByMailbox(const QString &mb) const
 {
+    d->ensureCachePopulated();
+    d->ensureDetailedKeys(KeyCacheLightIndex::EMail, mb.toUtf8().constData());
     return d->find_mailbox(mb, false);
 }
 
@@ -895,13 +1288,14 @@ std::vector<Key> KeyCache::Private::find_mailbox(const QString &email, bool sign
         return std::vector<Key>();
     }
 
-    const auto pair = find_email(email.toUtf8().constData());
+    ensureCachePopulated();
+    const std::vector<Key> keys = m_index.findByEMailAddress(email.toUtf8().constData());
     std::vector<Key> result;
-    result.reserve(std::distance(pair.first, pair.second));
+    result.reserve(keys.size());
     if (sign) {
-        kdtools::copy_2nd_if(pair.first, pair.second, std::back_inserter(result), ready_for_signing());
+        std::copy_if(keys.begin(), keys.end(), std::back_inserter(result), ready_for_signing());
     } else {
-        kdtools::copy_2nd_if(pair.first, pair.second, std::back_inserter(result), ready_for_encryption());
+        std::copy_if(keys.begin(), keys.end(), std::back_inserter(result), ready_for_encryption());
     }
 
     return result;
@@ -925,9 +1319,10 @@ std::vector<Key> KeyCache::findSubjects(const std::vector<Key> &keys, Options op
     }
 
     // get the immediate subjects
+    d->ensureCachePopulated();
     for (const auto &key : keys) {
-        const auto firstAndLastSubject = d->find_subjects(key.primaryFingerprint());
-        result.insert(result.end(), firstAndLastSubject.first, firstAndLastSubject.second);
+        const auto subjects = d->m_index.findSubjects(key.primaryFingerprint());
+        result.insert(result.end(), subjects.begin(), subjects.end());
     }
     // remove duplicates
     _detail::sort_by_fpr(result);
@@ -1005,37 +1400,30 @@ std::vector<Key> KeyCache::findIssuers(const Key &key, Options options) const
     return result;
 }
 
-static std::string email(const UserID &uid)
+void KeyCache::Private::writeIndexFile()
 {
-    // Prefer the gnupg normalized one
-    const std::string addr = uid.addrSpec();
-    if (!addr.empty()) {
-        return addr;
-    }
-    const std::string email = uid.email();
-    if (email.empty()) {
-        return DN(uid.id())[QStringLiteral("EMAIL")].trimmed().toUtf8().constData();
-    }
-    if (email[0] == '<' && email[email.size() - 1] == '>') {
-        return email.substr(1, email.size() - 2);
-    } else {
-        return email;
+    if (m_indexFileName.isEmpty()) {
+        return;
     }
-}
-
-static std::vector<std::string> emails(const Key &key)
-{
-    std::vector<std::string> emails;
-    const auto userIDs = key.userIDs();
-    for (const UserID &uid : userIDs) {
-        const std::string e = email(uid);
-        if (!e.empty()) {
-            emails.push_back(e);
+    KeyCacheIndexFile::Writer writer;
+    for (const Key &key : m_index.keys()) {
+        const auto k = writer.addKey(key.primaryFingerprint(), key.protocol());
+        writer.addEntry(KeyCacheIndexFile::Fingerprint, key.primaryFingerprint(), k);
+        writer.addEntry(KeyCacheIndexFile::KeyID, key.keyID(), k);
+        for (const std::string &email : KeyCacheIndex::emails(key)) {
+            writer.addEntry(KeyCacheIndexFile::EMail, email.c_str(), k);
         }
+        for (const Subkey &subkey : key.subkeys()) {
+            if (subkey.canRenc()) {
+                continue;
+            }
+            writer.addEntry(KeyCacheIndexFile::SubkeyID, subkey.keyID(), k);
+            writer.addEntry(KeyCacheIndexFile::KeyGrip, subkey.keyGrip(), k);
+        }
+    }
+    if (!writer.write(m_indexFileName)) {
+        qCDebug(LIBKLEO_LOG) << __func__ << "Failed to write key index file" << m_indexFileName;
     }
-    std::sort(emails.begin(), emails.end(), ByEMail<std::less>());
-    emails.erase(std::unique(emails.begin(), emails.end(), ByEMail<std::equal_to>()), emails.end());
-    return emails;
 }
 
 void KeyCache::remove(const Key &key)
@@ -1044,76 +1432,33 @@ void KeyCache::remove(const Key &key)
         return;
     }
 
-    const char *fpr = key.primaryFingerprint();
-    if (!fpr) {
-        return;
-    }
-
-    {
-        const auto range = std::equal_range(d->by.fpr.begin(), d->by.fpr.end(), fpr, _detail::ByFingerprint<std::less>());
-        d->by.fpr.erase(range.first, range.second);
-    }
-
-    if (const char *keyid = key.keyID()) {
-        const auto range = std::equal_range(d->by.keyid.begin(), d->by.keyid.end(), keyid, _detail::ByKeyID<std::less>());
-        const auto it = std::remove_if(range.first, range.second, [fpr](const GpgME::Key &key) {
-            return _detail::ByFingerprint<std::equal_to>()(fpr, key);
-        });
-        d->by.keyid.erase(it, range.second);
-    }
-
-    if (const char *chainid = key.chainID()) {
-        const auto range = std::equal_range(d->by.chainid.begin(), d->by.chainid.end(), chainid, _detail::ByChainID<std::less>());
-        const auto range2 = std::equal_range(range.first, range.second, fpr, _detail::ByFingerprint<std::less>());
-        d->by.chainid.erase(range2.first, range2.second);
-    }
-
-    const auto emailsKey{emails(key)};
-    for (const std::string &email : emailsKey) {
-        const auto range = std::equal_range(d->by.email.begin(), d->by.email.end(), email, ByEMail<std::less>());
-        const auto it = std::remove_if(range.first, range.second, [fpr](const std::pair<std::string, Key> &pair) {
-            return qstricmp(fpr, pair.second.primaryFingerprint()) == 0;
-        });
-        d->by.email.erase(it, range.second);
-    }
+    remove(std::vector<Key>{key});
+}
 
-    const auto keySubKeys{key.subkeys()};
-    for (const Subkey &subkey : keySubKeys) {
-        if (const char *subkeyfpr = subkey.fingerprint()) {
-            const auto range = std::equal_range(d->by.subkeyfpr.begin(), d->by.subkeyfpr.end(), subkeyfpr, _detail::BySubkeyFingerprint<std::less>());
-            const auto it = std::remove_if(range.first, range.second, [fpr](const Subkey &subkey) {
-                return !qstricmp(fpr, subkey.parent().primaryFingerprint());
-            });
-            d->by.subkeyfpr.erase(it, range.second);
-        }
-        if (const char *keyid = subkey.keyID()) {
-            const auto range = std::equal_range(d->by.subkeyid.begin(), d->by.subkeyid.end(), keyid, _detail::ByKeyID<std::less>());
-            const auto it = std::remove_if(range.first, range.second, [fpr](const Subkey &subkey) {
-                return !qstricmp(fpr, subkey.parent().primaryFingerprint());
-            });
-            d->by.subkeyid.erase(it, range.second);
-        }
-        if (const char *keygrip = subkey.keyGrip()) {
-            const auto range = std::equal_range(d->by.keygrip.begin(), d->by.keygrip.end(), keygrip, _detail::ByKeyGrip<std::less>());
-            const auto it = std::remove_if(range.first, range.second, [fpr](const Subkey &subkey) {
-                return !qstricmp(fpr, subkey.parent().primaryFingerprint());
-            });
-            d->by.keygrip.erase(it, range.second);
-        }
+void KeyCache::remove(const std::vector<Key> &keys)
+{
+    if (keys.empty()) {
+        return;
     }
+    d->removeKeys(keys);
+    d->emitKeysMayHaveChanged();
 }
 
-void KeyCache::remove(const std::vector<Key> &keys)
+void KeyCache::Private::removeKeys(const std::vector<Key> &keys)
 {
-    for (const Key &key : keys) {
-        remove(key);
+    if (m_lightMode) {
+        m_lightIndex.remove(keys);
+        forgetDetailedKeys(keys);
     }
+    m_index.remove(keys);
+    KeyState::forget(keys);
+    m_changedKeys.insert(m_changedKeys.end(), keys.begin(), keys.end());
 }
 
 const std::vector<GpgME::Key> &KeyCache::keys() const
 {
     d->ensureCachePopulated();
-    return d->by.fpr;
+    return d->m_index.keys();
 }
 
 std::vector<Key> KeyCache::secretKeys() const
@@ -1248,23 +1593,6 @@ void KeyCache::insert(const Key &key)
     insert(std::vector<Key>(1, key));
 }
 
-namespace
-{
-
-template<template<template<typename T> class Op> class T1, template<template<typename T> class Op> class T2>
-struct lexicographically {
-    using result_type = bool;
-
-    template<typename U, typename V>
-    bool operator()(const U &lhs, const V &rhs) const
-    {
-        return T1<std::less>()(lhs, rhs) //
-            || (T1<std::equal_to>()(lhs, rhs) && T2<std::less>()(lhs, rhs));
-    }
-};
-
-}
-
 void KeyCache::insert(const std::vector<Key> &keys)
 {
     // 1. filter out keys with empty fingerprints:
@@ -1275,120 +1603,47 @@ void KeyCache::insert(const std::vector<Key> &keys)
         return fp && *fp;
     });
 
-    // this is sub-optimal, but makes implementation from here on much easier
-    remove(sorted);
+    // 2. insert into the indexes (replacing older versions of the keys):
+    d->m_index.insert(sorted);
+    KeyState::update(sorted);
 
-    // 2. sort by fingerprint:
-    std::sort(sorted.begin(), sorted.end(), _detail::ByFingerprint<std::less>());
+    d->updateCardsAndProtocols(sorted);
 
-    // 2a. insert into fpr index:
-    std::vector<Key> by_fpr;
-    by_fpr.reserve(sorted.size() + d->by.fpr.size());
-    std::merge(sorted.begin(), sorted.end(), d->by.fpr.begin(), d->by.fpr.end(), std::back_inserter(by_fpr), _detail::ByFingerprint<std::less>());
-
-    // 3. build email index:
-    std::vector<std::pair<std::string, Key>> pairs;
-    pairs.reserve(sorted.size());
-    for (const Key &key : std::as_const(sorted)) {
-        const std::vector<std::string> emails = ::emails(key);
-        for (const std::string &e : emails) {
-            pairs.push_back(std::make_pair(e, key));
+    if (d->m_lightMode) {
+        d->m_lightIndex.insert(sorted);
+        for (const Key &key : sorted) {
+            d->m_handedOutKeys.erase(key.primaryFingerprint());
         }
+        std::vector<std::string> fingerprints;
+        fingerprints.reserve(sorted.size());
+        std::transform(sorted.begin(), sorted.end(), std::back_inserter(fingerprints), std::mem_fn(&Key::primaryFingerprint));
+        d->touchDetailedKeys(fingerprints);
+        d->evictDetailedKeys(d->m_detailedKeysLimit);
     }
-    std::sort(pairs.begin(), pairs.end(), ByEMail<std::less>());
 
-    // 3a. insert into email index:
-    std::vector<std::pair<std::string, Key>> by_email;
-    by_email.reserve(pairs.size() + d->by.email.size());
-    std::merge(pairs.begin(), pairs.end(), d->by.email.begin(), d->by.email.end(), std::back_inserter(by_email), ByEMail<std::less>());
+    d->updateGroupKeys(sorted);
 
-    // 3.5: stable-sort by chain-id (effectively lexicographically<ByChainID,ByFingerprint>)
-    std::stable_sort(sorted.begin(), sorted.end(), _detail::ByChainID<std::less>());
+    d->m_changedKeys.insert(d->m_changedKeys.end(), sorted.begin(), sorted.end());
+    d->emitKeysMayHaveChanged();
+}
 
-    // 3.5a: insert into chain-id index:
-    std::vector<Key> nonroot;
-    nonroot.reserve(sorted.size());
-    std::vector<Key> by_chainid;
-    by_chainid.reserve(sorted.size() + d->by.chainid.size());
-    std::copy_if(sorted.cbegin(), sorted.cend(), std::back_inserter(nonroot), [](const Key &key) {
-        return !key.isRoot();
-    });
-    std::merge(nonroot.cbegin(),
-               nonroot.cend(),
-               d->by.chainid.cbegin(),
-               d->by.chainid.cend(),
-               std::back_inserter(by_chainid),
-               lexicographically<_detail::ByChainID, _detail::ByFingerprint>());
-
-    // 4. sort by key id:
-    std::sort(sorted.begin(), sorted.end(), _detail::ByKeyID<std::less>());
-
-    // 4a. insert into keyid index:
-    std::vector<Key> by_keyid;
-    by_keyid.reserve(sorted.size() + d->by.keyid.size());
-    std::merge(sorted.begin(), sorted.end(), d->by.keyid.begin(), d->by.keyid.end(), std::back_inserter(by_keyid), _detail::ByKeyID<std::less>());
-
-    // 5. has been removed
-
-    // 6. build subkey ID index:
-    std::vector<Subkey> subkeys;
-    subkeys.reserve(sorted.size());
-    for (const Key &key : std::as_const(sorted)) {
-        const auto keySubkeys{key.subkeys()};
-        for (const Subkey &subkey : keySubkeys) {
-            if (subkey.canRenc()) {
-                continue;
-            }
-            subkeys.push_back(subkey);
-        }
+void KeyCache::Private::updateCardsAndProtocols(const std::vector<Key> &keys)
+{
+    for (const Key &key : keys) {
+        m_pgpOnly &= key.protocol() == GpgME::OpenPGP;
     }
 
-    // 6a sort by key id:
-    std::sort(subkeys.begin(), subkeys.end(), _detail::ByKeyID<std::less>());
-
-    // 6b. insert into subkey ID index:
-    std::vector<Subkey> by_subkeyid;
-    by_subkeyid.reserve(subkeys.size() + d->by.subkeyid.size());
-    std::merge(subkeys.begin(), subkeys.end(), d->by.subkeyid.begin(), d->by.subkeyid.end(), std::back_inserter(by_subkeyid), _detail::ByKeyID<std::less>());
-
-    // 6c. sort by key grip
-    std::sort(subkeys.begin(), subkeys.end(), _detail::ByKeyGrip<std::less>());
-
-    // 6d. insert into subkey keygrip index:
-    std::vector<Subkey> by_keygrip;
-    by_keygrip.reserve(subkeys.size() + d->by.keygrip.size());
-    std::merge(subkeys.begin(), subkeys.end(), d->by.keygrip.begin(), d->by.keygrip.end(), std::back_inserter(by_keygrip), _detail::ByKeyGrip<std::less>());
-
-    // 6e sort by fingerprint:
-    std::sort(subkeys.begin(), subkeys.end(), _detail::BySubkeyFingerprint<std::less>());
-
-    // 6f. insert into subkey fingerprint index:
-    std::vector<Subkey> by_subkeyfpr;
-    by_subkeyfpr.reserve(subkeys.size() + d->by.subkeyfpr.size());
-    std::merge(subkeys.begin(),
-               subkeys.end(),
-               d->by.subkeyfpr.begin(),
-               d->by.subkeyfpr.end(),
-               std::back_inserter(by_subkeyfpr),
-               _detail::BySubkeyFingerprint<std::less>());
-
-    // now commit (well, we already removed keys...)
-    by_fpr.swap(d->by.fpr);
-    by_keyid.swap(d->by.keyid);
-    by_email.swap(d->by.email);
-    by_subkeyfpr.swap(d->by.subkeyfpr);
-    by_subkeyid.swap(d->by.subkeyid);
-    by_keygrip.swap(d->by.keygrip);
-    by_chainid.swap(d->by.chainid);
-
-    for (const Key &key : std::as_const(sorted)) {
-        d->m_pgpOnly &= key.protocol() == GpgME::OpenPGP;
+    // only reread the card information of the given keys
+    for (const auto &key : keys) {
+        for (const auto &subkey : key.subkeys()) {
+            if (subkey.keyGrip()) {
+                m_cards.erase(QByteArray(subkey.keyGrip()));
+            }
+        }
     }
-
-    d->m_cards.clear();
     for (const auto &key : keys) {
         for (const auto &subkey : key.subkeys()) {
-            if (!subkey.isSecret() || !d->m_cards[QByteArray(subkey.keyGrip())].empty()) {
+            if (!subkey.isSecret() || !m_cards[QByteArray(subkey.keyGrip())].empty()) {
                 continue;
             }
             const auto data = readSecretKeyFile(QString::fromLatin1(subkey.keyGrip()));
@@ -1397,7 +1652,7 @@ void KeyCache::insert(const std::vector<Key> &keys)
                     const auto split = line.split(' ');
                     if (split.size() > 2) {
                         const auto keyRef = QString::fromUtf8(split[2]).trimmed();
-                        d->m_cards[QByteArray(subkey.keyGrip())].push_back(CardKeyStorageInfo{
+                        m_cards[QByteArray(subkey.keyGrip())].push_back(CardKeyStorageInfo{
                             QString::fromUtf8(split[1]),
                             split.size() > 4 ? QString::fromLatin1(
                                 QString::fromUtf8(split[4]).trimmed().replace(QLatin1Char('+'), QLatin1Char(' ')).toUtf8().percentDecoded())
@@ -1409,13 +1664,20 @@ void KeyCache::insert(const std::vector<Key> &keys)
             }
         }
     }
-
-    Q_EMIT keysMayHaveChanged();
 }
 
 void KeyCache::clear()
 {
-    d->by = Private::By();
+    d->m_index.clear();
+    KeyState::clear();
+    d->m_lightIndex.clear();
+    d->m_detailedKeys.clear();
+    d->m_detailedKeysPositions.clear();
+    d->m_handedOutKeys.clear();
+    d->m_cards.clear();
+    d->m_searchIndex.reset();
+    d->m_changedKeys.clear();
+    d->m_allKeysChanged = true;
 }
 
 //
@@ -1424,6 +1686,117 @@ void KeyCache::clear()
 //
 //
 
+namespace
+{
+bool subkeyHasChanged(const Subkey &oldSubkey, const Subkey &newSubkey)
+{
+    return qstrcmp(oldSubkey.fingerprint(), newSubkey.fingerprint()) != 0 //
+        || qstrcmp(oldSubkey.keyGrip(), newSubkey.keyGrip()) != 0 //
+        || oldSubkey.isRevoked() != newSubkey.isRevoked() //
+        || oldSubkey.isExpired() != newSubkey.isExpired() //
+        || oldSubkey.isDisabled() != newSubkey.isDisabled() //
+        || oldSubkey.isInvalid() != newSubkey.isInvalid() //
+        || oldSubkey.canEncrypt() != newSubkey.canEncrypt() //
+        || oldSubkey.canSign() != newSubkey.canSign() //
+        || oldSubkey.canCertify() != newSubkey.canCertify() //
+        || oldSubkey.canAuthenticate() != newSubkey.canAuthenticate() //
+        || oldSubkey.canRenc() != newSubkey.canRenc() //
+        || oldSubkey.isQualified() != newSubkey.isQualified() //
+        || oldSubkey.isDeVs() != newSubkey.isDeVs() //
+        || oldSubkey.isGroupOwned() != newSubkey.isGroupOwned() //
+        || oldSubkey.isSecret() != newSubkey.isSecret() //
+        || oldSubkey.isCardKey() != newSubkey.isCardKey() //
+        || qstrcmp(oldSubkey.cardSerialNumber(), newSubkey.cardSerialNumber()) != 0 //
+        || oldSubkey.expirationTime() != newSubkey.expirationTime();
+}
+
+bool userIDHasChanged(const UserID &oldUserID, const UserID &newUserID)
+{
+    return qstrcmp(oldUserID.id(), newUserID.id()) != 0 //
+        || oldUserID.validity() != newUserID.validity() //
+        || oldUserID.isRevoked() != newUserID.isRevoked() //
+        || oldUserID.isInvalid() != newUserID.isInvalid() //
+        || oldUserID.numSignatures() != newUserID.numSignatures();
+}
+
+// Compares the properties of two versions of a key that are reported by a key listing.
+bool keyHasChanged(const Key &oldKey, const Key &newKey)
+{
+    if (oldKey.keyListMode() != newKey.keyListMode() //
+        || oldKey.ownerTrust() != newKey.ownerTrust() //
+        || oldKey.isRevoked() != newKey.isRevoked() //
+        || oldKey.isExpired() != newKey.isExpired() //
+        || oldKey.isDisabled() != newKey.isDisabled() //
+        || oldKey.isInvalid() != newKey.isInvalid() //
+        || oldKey.hasSecret() != newKey.hasSecret() //
+        || oldKey.canEncrypt() != newKey.canEncrypt() //
+        || oldKey.canSign() != newKey.canSign() //
+        || oldKey.canCertify() != newKey.canCertify() //
+        || oldKey.canAuthenticate() != newKey.canAuthenticate() //
+        || oldKey.hasEncrypt() != newKey.hasEncrypt() //
+        || oldKey.hasSign() != newKey.hasSign() //
+        || oldKey.hasCertify() != newKey.hasCertify() //
+        || oldKey.hasAuthenticate() != newKey.hasAuthenticate() //
+        || oldKey.isQualified() != newKey.isQualified() //
+        || oldKey.isDeVs() != newKey.isDeVs() //
+        || oldKey.origin() != newKey.origin() //
+        || oldKey.lastUpdate() != newKey.lastUpdate() //
+        || qstrcmp(oldKey.chainID(), newKey.chainID()) != 0 //
+        || oldKey.numSubkeys() != newKey.numSubkeys() //
+        || oldKey.numUserIDs() != newKey.numUserIDs()) {
+        return true;
+    }
+    for (unsigned int i = 0; i < oldKey.numSubkeys(); ++i) {
+        if (subkeyHasChanged(oldKey.subkey(i), newKey.subkey(i))) {
+            return true;
+        }
+    }
+    for (unsigned int i = 0; i < oldKey.numUserIDs(); ++i) {
+        if (userIDHasChanged(oldKey.userID(i), newKey.userID(i))) {
+            return true;
+        }
+    }
+    return false;
+}
+}
+
+namespace
+{
+struct PreparedKeys {
+    std::vector<Key> keys; // sorted by fingerprint
+    std::shared_ptr<KeyCacheIndex> index; // only built for the initial key listing
+    std::shared_ptr<KeyCacheLightIndex> lightIndex; // only built in light mode
+};
+
+// Sorts the key listing results of the different protocols and merges them.
+// If requested, also builds the lookup indexes for the keys.
+PreparedKeys sortAndMergeKeys(std::vector<std::vector<Key>> batches, bool buildIndex, bool buildLightIndex)
+{
+    const _detail::ByFingerprint<std::less> less;
+    PreparedKeys prepared;
+    std::size_t count = 0;
+    for (auto &batch : batches) {
+        // gpg does not list the keys sorted by fingerprint
+        std::sort(batch.begin(), batch.end(), less);
+        count += batch.size();
+    }
+    prepared.keys.reserve(count);
+    for (auto &batch : batches) {
+        const auto middle = prepared.keys.insert(prepared.keys.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+        std::inplace_merge(prepared.keys.begin(), middle, prepared.keys.end(), less);
+    }
+    if (buildIndex) {
+        prepared.index = std::make_shared<KeyCacheIndex>();
+        prepared.index->insert(prepared.keys);
+    }
+    if (buildLightIndex) {
+        prepared.lightIndex = std::make_shared<KeyCacheLightIndex>();
+        prepared.lightIndex->insert(prepared.keys);
+    }
+    return prepared;
+}
+}
+
 class KeyCache::RefreshKeysJob::Private
 {
     RefreshKeysJob *const q;
@@ -1435,23 +1808,18 @@ public:
     void listAllKeysJobDone(const KeyListResult &res, const std::vector<Key> &nextKeys)
     {
         if (!nextKeys.empty()) {
-            std::vector<Key> keys;
-            keys.reserve(m_keys.size() + nextKeys.size());
-            if (m_keys.empty()) {
-                keys = nextKeys;
-            } else {
-                std::merge(m_keys.begin(), m_keys.end(), nextKeys.begin(), nextKeys.end(), std::back_inserter(keys), _detail::ByFingerprint<std::less>());
-            }
-            m_keys.swap(keys);
+            m_batches.push_back(nextKeys);
         }
         jobDone(res);
     }
     void emitDone(const KeyListResult &result);
-    void updateKeyCache();
+    void prepareKeys();
+    bool updateKeyCache(const PreparedKeys &prepared);
 
     QPointer<KeyCache> m_cache;
     QList<QGpgME::ListAllKeysJob *> m_jobsPending;
-    std::vector<Key> m_keys;
+    // the unsorted results of the key listings of the different protocols
+    std::vector<std::vector<Key>> m_batches;
     KeyListResult m_mergedResult;
     bool m_canceled;
 
@@ -1484,8 +1852,7 @@ void KeyCache::RefreshKeysJob::Private::jobDone(const KeyListResult &result)
     if (!m_jobsPending.empty()) {
         return;
     }
-    updateKeyCache();
-    emitDone(m_mergedResult);
+    prepareKeys();
 }
 
 void KeyCache::RefreshKeysJob::Private::emitDone(const KeyListResult &res)
@@ -1539,24 +1906,80 @@ void KeyCache::RefreshKeysJob::Private::doStart()
     emitDone(hasError ? m_mergedResult : KeyListResult(Error(GPG_ERR_UNSUPPORTED_OPERATION)));
 }
 
-void KeyCache::RefreshKeysJob::Private::updateKeyCache()
+void KeyCache::RefreshKeysJob::Private::prepareKeys()
 {
     if (!m_cache || m_canceled) {
         q->deleteLater();
         return;
     }
 
-    std::vector<Key> cachedKeys = m_cache->initialized() ? m_cache->keys() : std::vector<Key>();
-    std::sort(cachedKeys.begin(), cachedKeys.end(), _detail::ByFingerprint<std::less>());
-    std::vector<Key> keysToRemove;
-    std::set_difference(cachedKeys.begin(),
-                        cachedKeys.end(),
-                        m_keys.begin(),
-                        m_keys.end(),
-                        std::back_inserter(keysToRemove),
-                        _detail::ByFingerprint<std::less>());
-    m_cache->remove(keysToRemove);
-    m_cache->refresh(m_keys);
+    // sort and merge the keys and build the indexes for the initial key listing in a worker thread;
+    // the key cache is only updated in the GUI thread when everything is ready
+    auto promise = std::make_shared<QPromise<PreparedKeys>>();
+    QFuture<PreparedKeys> future = promise->future();
+    const bool lightMode = m_cache->lightModeEnabled();
+    QThreadPool::globalInstance()->start([promise, batches = std::move(m_batches), buildIndex = !m_cache->initialized() && !lightMode, lightMode]() mutable {
+        promise->start();
+        promise->addResult(sortAndMergeKeys(std::move(batches), buildIndex, lightMode));
+        promise->finish();
+    });
+    m_batches.clear();
+    future.then(q, [this](const PreparedKeys &prepared) {
+        // the job may have been canceled while the keys were prepared
+        if (updateKeyCache(prepared)) {
+            emitDone(m_mergedResult);
+        }
+    });
+}
+
+// Returns false if the key cache wasn't updated because the job was canceled.
+bool KeyCache::RefreshKeysJob::Private::updateKeyCache(const PreparedKeys &prepared)
+{
+    if (!m_cache || m_canceled) {
+        q->deleteLater();
+        return false;
+    }
+
+    if (prepared.lightIndex && m_cache->lightModeEnabled()) {
+        // in light mode the listed keys are not kept; they are summarized
+        m_cache->d->replaceLightIndex(std::move(*prepared.lightIndex), prepared.keys);
+        return true;
+    }
+
+    if (!m_cache->initialized()) {
+        if (prepared.index) {
+            m_cache->d->replaceIndex(std::move(*prepared.index));
+        } else {
+            m_cache->refresh(prepared.keys);
+        }
+        return true;
+    }
+
+    // only touch the keys that were added, removed, or changed since the last key listing
+    const std::vector<Key> &cachedKeys = m_cache->keys(); // sorted by fingerprint
+    const std::vector<Key> &newKeys = prepared.keys;
+    std::vector<Key> removedKeys;
+    std::vector<Key> changedKeys;
+    auto oldIt = cachedKeys.begin();
+    auto newIt = newKeys.begin();
+    const _detail::ByFingerprint<std::less> less;
+    while (oldIt != cachedKeys.end() || newIt != newKeys.end()) {
+        if (newIt == newKeys.end() || (oldIt != cachedKeys.end() && less(*oldIt, *newIt))) {
+            removedKeys.push_back(*oldIt);
+            ++oldIt;
+        } else if (oldIt == cachedKeys.end() || less(*newIt, *oldIt)) {
+            changedKeys.push_back(*newIt);
+            ++newIt;
+        } else {
+            if (keyHasChanged(*oldIt, *newIt)) {
+                changedKeys.push_back(*newIt);
+            }
+            ++oldIt;
+            ++newIt;
+        }
+    }
+    m_cache->d->updateKeys(removedKeys, changedKeys);
+    return true;
 }
 
 Error KeyCache::RefreshKeysJob::Private::startKeyListing(GpgME::Protocol proto)
@@ -1598,15 +2021,6 @@ Error KeyCache::RefreshKeysJob::Private::startKeyListing(GpgME::Protocol proto)
 
     connect(q, &RefreshKeysJob::canceled, job, &QGpgME::Job::slotCancel);
 
-    // Only do this for initialized keycaches to avoid huge waits for
-    // signature notations during initial keylisting.
-    if (proto == GpgME::OpenPGP && m_cache->remarksEnabled() && m_cache->initialized()) {
-        auto ctx = QGpgME::Job::context(job);
-        if (ctx) {
-            ctx->addKeyListMode(KeyListMode::Signatures | KeyListMode::SignatureNotations);
-        }
-    }
-
     const Error error = job->start(true);
 
     if (!error && !error.isCanceled()) {
@@ -1632,6 +2046,81 @@ void KeyCache::Private::ensureCachePopulated() const
     }
 }
 
+void KeyCache::Private::finishReadyPromises()
+{
+    // the promises are moved out first because the continuations may call whenReady()
+    const auto promises = std::move(m_readyPromises);
+    m_readyPromises.clear();
+    for (const auto &promise : promises) {
+        promise->finish();
+    }
+}
+
+template<typename F>
+auto KeyCache::Private::whenReadyThen(F f) const -> QFuture<std::invoke_result_t<F>>
+{
+    if (m_initalized) {
+        return QtFuture::makeReadyValueFuture(f());
+    }
+    return q->whenReady().then(q, std::move(f));
+}
+
+QFuture<void> KeyCache::whenReady() const
+{
+    if (d->m_initalized) {
+        return QtFuture::makeReadyVoidFuture();
+    }
+    auto promise = std::make_shared<QPromise<void>>();
+    promise->start();
+    d->m_readyPromises.push_back(promise);
+    if (!d->m_refreshJob) {
+        d->q->startKeyListing();
+    }
+    return promise->future();
+}
+
+QFuture<std::vector<Key>> KeyCache::keysAsync() const
+{
+    return d->whenReadyThen([this]() {
+        return keys();
+    });
+}
+
+QFuture<std::vector<KeyGroup>> KeyCache::groupsAsync() const
+{
+    return d->whenReadyThen([this]() {
+        return groups();
+    });
+}
+
+QFuture<Key> KeyCache::findByFingerprintAsync(const std::string &fpr) const
+{
+    return d->whenReadyThen([this, fpr]() {
+        return findByFingerprint(fpr);
+    });
+}
+
+QFuture<std::vector<Key>> KeyCache::findByEMailAddressAsync(const std::string &email) const
+{
+    return d->whenReadyThen([this, email]() {
+        return findByEMailAddress(email);
+    });
+}
+
+QFuture<std::vector<Key>> KeyCache::findByKeyIDOrFingerprintAsync(const std::vector<std::string> &ids) const
+{
+    return d->whenReadyThen([this, ids]() {
+        return findByKeyIDOrFingerprint(ids);
+    });
+}
+
+QFuture<std::vector<Subkey>> KeyCache::findSubkeysByKeyIDAsync(const std::vector<std::string> &ids) const
+{
+    return d->whenReadyThen([this, ids]() {
+        return findSubkeysByKeyID(ids);
+    });
+}
+
 bool KeyCache::pgpOnly() const
 {
     return d->m_pgpOnly;
@@ -1679,31 +2168,43 @@ struct BestMatch {
     UserID uid;
     time_t creationTime = 0;
 };
-}
 
-GpgME::Key KeyCache::findBestByMailBox(const char *addr, GpgME::Protocol proto, KeyUsage usage) const
+// Returns @p addr without enclosing angle brackets and with ASCII letters converted to lower case.
+std::string normalizedMailBox(const char *addr)
 {
-    d->ensureCachePopulated();
-    if (!addr) {
-        return {};
-    }
-
+    std::string_view address{addr};
     // support lookup of email addresses enclosed in angle brackets
-    QByteArray address(addr);
-    if (address.size() > 1 && address[0] == '<' && address[address.size() - 1] == '>') {
-        address = address.mid(1, address.size() - 2);
+    if (address.size() > 1 && address.front() == '<' && address.back() == '>') {
+        address = address.substr(1, address.size() - 2);
+    }
+    std::string result{address};
+    for (char &c : result) {
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
     }
-    address = address.toLower();
+    return result;
+}
 
+// Returns whether @p addrSpec is equal to the normalized address @p address ignoring the case of ASCII letters.
+bool addrSpecMatches(const std::string &addrSpec, const std::string &address)
+{
+    return std::equal(addrSpec.begin(), addrSpec.end(), address.begin(), address.end(), [](char c, char normalized) {
+        return ((c >= 'A' && c <= 'Z') ? char(c + ('a' - 'A')) : c) == normalized;
+    });
+}
+
+Key bestKeyForMailBox(const std::vector<Key> &keys, const std::string &address, Protocol proto, KeyCache::KeyUsage usage)
+{
     BestMatch best;
-    for (const Key &k : findByEMailAddress(address.constData())) {
+    for (const Key &k : keys) {
         if (proto != Protocol::UnknownProtocol && k.protocol() != proto) {
             continue;
         }
-        if (usage == KeyUsage::Encrypt && !keyHasEncrypt(k)) {
+        if (usage == KeyCache::KeyUsage::Encrypt && !keyHasEncrypt(k)) {
             continue;
         }
-        if (usage == KeyUsage::Sign && (!keyHasSign(k) || !k.hasSecret())) {
+        if (usage == KeyCache::KeyUsage::Sign && (!keyHasSign(k) || !k.hasSecret())) {
             continue;
         }
         const time_t creationTime = creationTimeOfNewestSuitableSubKey(k, usage);
@@ -1712,7 +2213,7 @@ GpgME::Key KeyCache::findBestByMailBox(const char *addr, GpgME::Protocol proto,
             continue;
         }
         for (const UserID &u : k.userIDs()) {
-            if (QByteArray::fromStdString(u.addrSpec()).toLower() != address) {
+            if (!addrSpecMatches(u.addrSpec(), address)) {
                 // user ID does not match the given email address
                 continue;
             }
@@ -1734,30 +2235,42 @@ GpgME::Key KeyCache::findBestByMailBox(const char *addr, GpgME::Protocol proto,
             }
         }
     }
-
     return best.key;
 }
 
-namespace
-{
-template<typename T>
-bool allKeysAllowUsage(const T &keys, KeyCache::KeyUsage usage)
+}
+
+GpgME::Key KeyCache::findBestByMailBox(const char *addr, GpgME::Protocol proto, KeyUsage usage) const
 {
-    switch (usage) {
-    case KeyCache::KeyUsage::AnyUsage:
-        return true;
-    case KeyCache::KeyUsage::Sign:
-        return std::all_of(std::begin(keys), std::end(keys), std::mem_fn(&Key::hasSign));
-    case KeyCache::KeyUsage::Encrypt:
-        return std::all_of(std::begin(keys), std::end(keys), std::mem_fn(&Key::hasEncrypt));
-    case KeyCache::KeyUsage::Certify:
-        return std::all_of(std::begin(keys), std::end(keys), std::mem_fn(&Key::hasCertify));
-    case KeyCache::KeyUsage::Authenticate:
-        return std::all_of(std::begin(keys), std::end(keys), std::mem_fn(&Key::hasAuthenticate));
-    }
-    qCDebug(LIBKLEO_LOG) << __func__ << "called with invalid usage" << int(usage);
-    return false;
+    d->ensureCachePopulated();
+    if (!addr) {
+        return {};
+    }
+
+    const std::string address = normalizedMailBox(addr);
+    return bestKeyForMailBox(findByEMailAddress(address), address, proto, usage);
 }
+
+std::vector<GpgME::Key> KeyCache::findBestByMailBoxes(const std::vector<std::string> &addrs, GpgME::Protocol proto, KeyUsage usage) const
+{
+    d->ensureCachePopulated();
+
+    std::vector<std::string> addresses;
+    addresses.reserve(addrs.size());
+    std::transform(addrs.begin(), addrs.end(), std::back_inserter(addresses), [](const std::string &addr) {
+        return normalizedMailBox(addr.c_str());
+    });
+    d->ensureDetailedKeys(KeyCacheLightIndex::EMail, addresses);
+    const std::vector<std::vector<Key>> candidates = d->m_index.findByEMailAddresses(addresses);
+
+    // the addresses are independent of each other
+    std::vector<Key> result(addresses.size());
+    forEachChunkInParallel(addresses.size(), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            result[i] = bestKeyForMailBox(candidates[i], addresses[i], proto, usage);
+        }
+    });
+    return result;
 }
 
 KeyGroup KeyCache::findGroup(const QString &name, Protocol protocol, KeyUsage usage) const
@@ -1765,13 +2278,8 @@ KeyGroup KeyCache::findGroup(const QString &name, Protocol protocol, KeyUsage us
     d->ensureCachePopulated();
 
     Q_ASSERT(usage == KeyUsage::Sign || usage == KeyUsage::Encrypt);
-    for (const auto &group : std::as_const(d->m_groups)) {
-        if (group.name() == name) {
-            const KeyGroup::Keys &keys = group.keys();
-            if (allKeysAllowUsage(keys, usage) && (protocol == UnknownProtocol || allKeysHaveProtocol(keys, protocol))) {
-                return group;
-            }
-        }
+    if (const auto position = d->m_groupIndex.findGroup(name, protocol, usage)) {
+        return d->m_groups[*position];
     }
 
     return {};
@@ -1780,17 +2288,56 @@ KeyGroup KeyCache::findGroup(const QString &name, Protocol protocol, KeyUsage us
 std::vector<Key> KeyCache::getGroupKeys(const QString &groupName) const
 {
     std::vector<Key> result;
-    for (const KeyGroup &g : std::as_const(d->m_groups)) {
-        if (g.name() == groupName) {
-            const KeyGroup::Keys &keys = g.keys();
-            std::copy(keys.cbegin(), keys.cend(), std::back_inserter(result));
-        }
+    for (const std::size_t position : d->m_groupIndex.groupsNamed(groupName)) {
+        const KeyGroup::Keys &keys = d->m_groups[position].keys();
+        std::copy(keys.cbegin(), keys.cend(), std::back_inserter(result));
     }
     _detail::sort_by_fpr(result);
     _detail::remove_duplicates_by_fpr(result);
     return result;
 }
 
+std::vector<KeyGroup> KeyCache::findGroupsContaining(const Key &key) const
+{
+    d->ensureCachePopulated();
+
+    std::vector<KeyGroup> result;
+    for (const std::size_t position : d->m_groupIndex.groupsContaining(key.primaryFingerprint())) {
+        result.push_back(d->m_groups[position]);
+    }
+    return result;
+}
+
+void KeyCache::enableLightMode(bool enable, std::size_t detailedKeysLimit)
+{
+    d->m_detailedKeysLimit = std::max<std::size_t>(detailedKeysLimit, 1);
+    if (d->m_lightMode == enable) {
+        if (enable) {
+            d->evictDetailedKeys(d->m_detailedKeysLimit);
+        }
+        return;
+    }
+    d->m_lightMode = enable;
+    d->m_lightIndex.clear();
+    d->m_detailedKeys.clear();
+    d->m_detailedKeysPositions.clear();
+    d->m_handedOutKeys.clear();
+    if (d->m_initalized) {
+        reload();
+    }
+}
+
+bool KeyCache::lightModeEnabled() const
+{
+    return d->m_lightMode;
+}
+
+std::vector<KeySummary> KeyCache::keySummaries() const
+{
+    d->ensureCachePopulated();
+    return d->m_lightIndex.summaries();
+}
+
 void KeyCache::setKeys(const std::vector<GpgME::Key> &keys)
 {
     // disable regular key listing and cancel running key listing
@@ -1799,6 +2346,7 @@ void KeyCache::setKeys(const std::vector<GpgME::Key> &keys)
     clear();
     insert(keys);
     d->m_initalized = true;
+    d->finishReadyPromises();
     Q_EMIT keyListingDone(KeyListResult());
 }
 
@@ -1806,6 +2354,7 @@ void KeyCache::setGroups(const std::vector<KeyGroup> &groups)
 {
     Q_ASSERT(d->m_initalized && "Call setKeys() before setting groups");
     d->m_groups = groups;
+    d->m_groupIndex.rebuild(d->m_groups);
     Q_EMIT keysMayHaveChanged();
 }
 
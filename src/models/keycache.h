@@ -11,7 +11,9 @@
 
 #include "kleo_export.h"
 
+#include <QFuture>
 #include <QObject>
+#include <QStringView>
 
 #include <gpgme++/global.h>
 
@@ -37,6 +39,8 @@ class KeyGroup;
 class KeyGroupConfig;
 
 class KeyCacheAutoRefreshSuspension;
+class KeyCacheSnapshot;
+struct KeySummary;
 
 struct CardKeyStorageInfo {
     QString serialNumber;
@@ -96,6 +100,45 @@ public:
     void enableRemarks(bool enable);
     bool remarksEnabled() const;
 
+    /**
+     * Sets the name of the file used to persist the lookup indexes of the cache.
+     *
+     * If the file exists when the cache is not yet initialized, then findByFingerprint()
+     * and findByEMailAddress() look up the keys in this file and fetch only the matching
+     * keys from gpg instead of waiting for the full key listing. Keys which are missing
+     * in the file, e.g. because they were added after the file was written, are looked up
+     * in gpg by fingerprint. The keys are fetched synchronously, i.e. the lookup blocks the
+     * calling thread until gpg has listed the keys. The file is rewritten whenever a full
+     * key listing has finished. An empty @a fileName disables the index file.
+     */
+    void setIndexFileName(const QString &fileName);
+
+    /**
+     * Enables or disables the light mode.
+     *
+     * In light mode the cache keeps a compact KeySummary of each key and the
+     * full keys of only the @a detailedKeysLimit most recently used keys. The
+     * functions looking up keys by fingerprint, key ID, keygrip or email address
+     * still find all keys; full keys which are not held by the cache are fetched
+     * from gpg on demand. All other functions, e.g. keys(), search(), snapshot()
+     * or findSubjects(), only consider the keys held in full. Use keySummaries()
+     * to get a summary of all keys.
+     *
+     * Fetching the missing keys runs gpg synchronously, i.e. the lookup blocks
+     * the calling thread until gpg has listed the keys. Since lookups may add
+     * fetched keys to the cache, the reference returned by keys() is invalidated
+     * by any lookup. The keys and subkeys returned by reference by the lookup
+     * functions stay valid at least until control returns to the event loop;
+     * the cache evicts surplus keys only in a later event loop iteration.
+     *
+     * Changing the mode reloads the cache.
+     */
+    void enableLightMode(bool enable, std::size_t detailedKeysLimit = 1000);
+    bool lightModeEnabled() const;
+
+    /** Returns the summaries of all keys sorted by fingerprint. Only available in light mode. */
+    std::vector<KeySummary> keySummaries() const;
+
     const std::vector<GpgME::Key> &keys() const;
     std::vector<GpgME::Key> secretKeys() const;
 
@@ -112,6 +155,18 @@ public:
     std::vector<GpgME::Key> findByEMailAddress(const char *email) const;
     std::vector<GpgME::Key> findByEMailAddress(const std::string &email) const;
 
+    /**
+     * Returns up to @a limit keys with an email address, a name, or a fingerprint
+     * starting with or containing @a text. The comparison is case-insensitive.
+     * Keys with an email address, a name, or a fingerprint starting with @a text
+     * are returned first. Substrings are only matched if @a text has at least
+     * three characters.
+     *
+     * This is meant for type-ahead search. The search index is (re)built on the
+     * first search after the keys of the cache have changed.
+     */
+    std::vector<GpgME::Key> search(QStringView text, std::size_t limit) const;
+
     /** Look through the cache and search for the best key for a mailbox.
      *
      * The best key is the key with a UID for the provided mailbox that
@@ -123,6 +178,17 @@ public:
      * @returns the "best" key for the mailbox. */
     GpgME::Key findBestByMailBox(const char *addr, GpgME::Protocol proto, KeyUsage usage) const;
 
+    /**
+     * Looks for the best keys for many mailboxes at once.
+     *
+     * Returns the same keys as calling findBestByMailBox() for each of the
+     * addresses @p addrs, but normalizes the addresses once and looks them
+     * up in a single pass over the index of the email addresses. The best
+     * keys of large numbers of addresses are determined in parallel.
+     *
+     * @returns the "best" key for each of the mailboxes (or a null key). */
+    std::vector<GpgME::Key> findBestByMailBoxes(const std::vector<std::string> &addrs, GpgME::Protocol proto, KeyUsage usage) const;
+
     /**
      * Looks for a group named @a name which contains keys with protocol @a protocol
      * that are suitable for the usage @a usage.
@@ -172,6 +238,9 @@ public:
      * @returns A list of keys configured for groupName. Empty if no group cached.*/
     std::vector<GpgME::Key> getGroupKeys(const QString &groupName) const;
 
+    /** Returns the groups containing @p key. */
+    std::vector<KeyGroup> findGroupsContaining(const GpgME::Key &key) const;
+
     enum Option {
         // clang-format off
         NoOption        = 0,
@@ -189,6 +258,40 @@ public:
     /** Check if at least one keylisting was finished. */
     bool initialized() const;
 
+    /**
+     * Returns a future which finishes when the first key listing has finished.
+     *
+     * If the cache is not yet initialized, then this starts the key listing
+     * unless it is already running. Unlike the synchronous find functions,
+     * this never runs a nested event loop.
+     */
+    QFuture<void> whenReady() const;
+
+    /**
+     * Asynchronous variants of the corresponding functions. They return
+     * futures which finish with the result of the synchronous function once
+     * the cache is initialized. The results are computed in the thread of
+     * the key cache. If the cache is already initialized, then the returned
+     * futures are already finished.
+     */
+    QFuture<std::vector<GpgME::Key>> keysAsync() const;
+    QFuture<std::vector<KeyGroup>> groupsAsync() const;
+    QFuture<GpgME::Key> findByFingerprintAsync(const std::string &fpr) const;
+    QFuture<std::vector<GpgME::Key>> findByEMailAddressAsync(const std::string &email) const;
+    QFuture<std::vector<GpgME::Key>> findByKeyIDOrFingerprintAsync(const std::vector<std::string> &ids) const;
+    QFuture<std::vector<GpgME::Subkey>> findSubkeysByKeyIDAsync(const std::vector<std::string> &ids) const;
+
+    /**
+     * Returns the most recent snapshot of the keys of the cache.
+     *
+     * Unlike all other functions of the key cache, this function can be called
+     * from any thread. The returned snapshot is immutable and can be queried
+     * from any thread. After the keys of the cache have changed, a new snapshot
+     * is published when control returns to the event loop of the thread of the
+     * key cache; calling this function from this thread publishes it immediately.
+     */
+    std::shared_ptr<const KeyCacheSnapshot> snapshot() const;
+
     /** Check if all keys have OpenPGP Protocol. */
     bool pgpOnly() const;
 
@@ -209,6 +312,13 @@ public Q_SLOTS:
 Q_SIGNALS:
     void keyListingDone(const GpgME::KeyListResult &result);
     void keysMayHaveChanged();
+    /**
+     * Emitted right before keysMayHaveChanged() if only the keys @p keys have
+     * been added, updated or removed since the last emission of
+     * keysMayHaveChanged(). If keysMayHaveChanged() is emitted without this
+     * signal, then any key or group may have changed.
+     */
+    void keysChanged(const std::vector<GpgME::Key> &keys);
     void groupAdded(const Kleo::KeyGroup &group);
     void groupUpdated(const Kleo::KeyGroup &group);
     void groupRemoved(const Kleo::KeyGroup &group);
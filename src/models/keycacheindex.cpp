@@ -0,0 +1,794 @@
+/*
+    models/keycacheindex.cpp
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-libkleo.h>
+
+#include "keycacheindex_p.h"
+
+#include <libkleo/dn.h>
+#include <libkleo/predicates.h>
+
+#include <QString>
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <numeric>
+
+using namespace Kleo;
+using namespace GpgME;
+
+namespace
+{
+constexpr quint32 npos = std::numeric_limits<quint32>::max();
+
+char toAsciiLower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// Returns the first 8 bytes of @p s (padded with zeros) as big-endian number,
+// i.e. comparing the prefixes of two strings gives the same result as strcmp
+// unless the prefixes are equal.
+quint64 prefixOf(const char *s, bool foldCase)
+{
+    quint64 prefix = 0;
+    if (s) {
+        for (int i = 0; i < 8 && s[i]; ++i) {
+            const char c = foldCase ? toAsciiLower(s[i]) : s[i];
+            prefix |= quint64(uchar(c)) << (56 - 8 * i);
+        }
+    }
+    return prefix;
+}
+
+int compareCaseInsensitive(const char *lhs, const char *rhs)
+{
+    if (!lhs || !rhs) {
+        return _detail::mystrcmp(lhs, rhs);
+    }
+    for (;; ++lhs, ++rhs) {
+        const uchar l = toAsciiLower(*lhs);
+        const uchar r = toAsciiLower(*rhs);
+        if (l != r || !l) {
+            return int(l) - int(r);
+        }
+    }
+}
+
+int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c = toAsciiLower(c);
+    return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+// FNV-1a over the binary form of the hex string @p s; strings which are not
+// hex encoded are hashed as they are
+quint64 hashOf(const char *s)
+{
+    constexpr quint64 offsetBasis = 0xcbf29ce484222325ULL;
+    constexpr quint64 prime = 0x100000001b3ULL;
+    quint64 hash = offsetBasis;
+    const char *p = s;
+    for (; p[0] && p[1]; p += 2) {
+        const int high = hexDigit(p[0]);
+        const int low = hexDigit(p[1]);
+        if (high < 0 || low < 0) {
+            break;
+        }
+        hash = (hash ^ quint64((high << 4) | low)) * prime;
+    }
+    if (*p) {
+        // not hex encoded (or of odd length)
+        hash = offsetBasis;
+        for (p = s; *p; ++p) {
+            hash = (hash ^ uchar(*p)) * prime;
+        }
+    }
+    return hash;
+}
+
+std::string email(const UserID &uid)
+{
+    // Prefer the gnupg normalized one
+    const std::string addr = uid.addrSpec();
+    if (!addr.empty()) {
+        return addr;
+    }
+    const std::string email = uid.email();
+    if (email.empty()) {
+        return DN(uid.id())[QStringLiteral("EMAIL")].trimmed().toUtf8().constData();
+    }
+    if (email[0] == '<' && email[email.size() - 1] == '>') {
+        return email.substr(1, email.size() - 2);
+    } else {
+        return email;
+    }
+}
+}
+
+void KeyCacheIndex::HashTable::clear()
+{
+    m_slots.clear();
+}
+
+template<typename ValueOf>
+void KeyCacheIndex::HashTable::build(quint32 count, ValueOf valueOf)
+{
+    // keep the load factor at or below 1/2 so that the probe sequences stay short
+    std::size_t capacity = 16;
+    while (capacity < 2 * std::size_t(count)) {
+        capacity *= 2;
+    }
+    m_slots.assign(capacity, Slot{0, 0});
+    const std::size_t mask = capacity - 1;
+    for (quint32 row = 0; row < count; ++row) {
+        const char *const value = valueOf(row);
+        if (!value || !*value) {
+            continue;
+        }
+        const quint64 hash = hashOf(value);
+        std::size_t slot = hash & mask;
+        while (m_slots[slot].row) {
+            slot = (slot + 1) & mask;
+        }
+        m_slots[slot] = {row + 1, quint32(hash >> 32)};
+    }
+}
+
+template<typename ValueOf, typename F>
+void KeyCacheIndex::HashTable::find(const char *value, ValueOf valueOf, F f) const
+{
+    if (!value || !*value || m_slots.empty()) {
+        return;
+    }
+    // the rows were inserted in ascending order, so equal values are found in ascending order
+    const quint64 hash = hashOf(value);
+    const std::size_t mask = m_slots.size() - 1;
+    for (std::size_t slot = hash & mask; m_slots[slot].row; slot = (slot + 1) & mask) {
+        const Slot &s = m_slots[slot];
+        if (s.hash == quint32(hash >> 32) && _detail::mystrcmp(valueOf(s.row - 1), value) == 0) {
+            if (!f(s.row - 1)) {
+                return;
+            }
+        }
+    }
+}
+
+KeyCacheIndex::Level::Level()
+{
+    clear();
+}
+
+std::vector<std::string> KeyCacheIndex::emails(const Key &key)
+{
+    std::vector<std::string> emails;
+    const auto userIDs = key.userIDs();
+    for (const UserID &uid : userIDs) {
+        std::string e = email(uid);
+        if (!e.empty()) {
+            emails.push_back(std::move(e));
+        }
+    }
+    std::sort(emails.begin(), emails.end(), [](const auto &lhs, const auto &rhs) {
+        return compareCaseInsensitive(lhs.c_str(), rhs.c_str()) < 0;
+    });
+    emails.erase(std::unique(emails.begin(),
+                             emails.end(),
+                             [](const auto &lhs, const auto &rhs) {
+                                 return compareCaseInsensitive(lhs.c_str(), rhs.c_str()) == 0;
+                             }),
+                 emails.end());
+    return emails;
+}
+
+void KeyCacheIndex::Level::clear()
+{
+    m_keys.clear();
+    m_firstSubkey = {0};
+    m_subkeys.clear();
+    m_firstEMail = {0};
+    m_emailOffsets.clear();
+    m_emailKeys.clear();
+    m_emailData.clear();
+    for (auto &index : m_indexes) {
+        index.clear();
+    }
+    m_fingerprintHash.clear();
+    m_keyIDHash.clear();
+    m_subkeyFingerprintHash.clear();
+    m_subkeyIDHash.clear();
+    m_keyGripHash.clear();
+}
+
+void KeyCacheIndex::Level::rebuildHashTables()
+{
+    m_fingerprintHash.build(m_keys.size(), [this](quint32 row) {
+        return m_keys[row].primaryFingerprint();
+    });
+    m_keyIDHash.build(m_keys.size(), [this](quint32 row) {
+        return m_keys[row].keyID();
+    });
+    m_subkeyFingerprintHash.build(m_subkeys.size(), [this](quint32 row) {
+        return m_subkeys[row].fingerprint();
+    });
+    m_subkeyIDHash.build(m_subkeys.size(), [this](quint32 row) {
+        return m_subkeys[row].keyID();
+    });
+    m_keyGripHash.build(m_subkeys.size(), [this](quint32 row) {
+        return m_subkeys[row].keyGrip();
+    });
+}
+
+const char *KeyCacheIndex::Level::value(Index index, quint32 row) const
+{
+    switch (index) {
+    case ChainIDIndex:
+        return m_keys[row].chainID();
+    case EMailIndex:
+        return m_emailData.c_str() + m_emailOffsets[row];
+    case NumIndexes:
+        break;
+    }
+    return nullptr;
+}
+
+bool KeyCacheIndex::Level::less(Index index, const Entry &lhs, const Entry &rhs) const
+{
+    if (lhs.prefixHigh != rhs.prefixHigh) {
+        return lhs.prefixHigh < rhs.prefixHigh;
+    }
+    if (lhs.prefixLow != rhs.prefixLow) {
+        return lhs.prefixLow < rhs.prefixLow;
+    }
+    const char *const l = value(index, lhs.row);
+    const char *const r = value(index, rhs.row);
+    const int result = index == EMailIndex ? compareCaseInsensitive(l, r) : _detail::mystrcmp(l, r);
+    if (result == 0 && index == ChainIDIndex) {
+        return _detail::mystrcmp(m_keys[lhs.row].primaryFingerprint(), m_keys[rhs.row].primaryFingerprint()) < 0;
+    }
+    return result < 0;
+}
+
+int KeyCacheIndex::Level::compare(Index index, const Entry &e, const char *value, quint64 prefix) const
+{
+    const quint64 entryPrefix = (quint64(e.prefixHigh) << 32) | e.prefixLow;
+    if (entryPrefix != prefix) {
+        return entryPrefix < prefix ? -1 : 1;
+    }
+    const char *const entryValue = this->value(index, e.row);
+    return index == EMailIndex ? compareCaseInsensitive(entryValue, value) : _detail::mystrcmp(entryValue, value);
+}
+
+std::pair<const KeyCacheIndex::Level::Entry *, const KeyCacheIndex::Level::Entry *> KeyCacheIndex::Level::equalRange(Index index, const char *value) const
+{
+    const auto &entries = m_indexes[index];
+    if (!value || !*value || entries.empty()) {
+        return {};
+    }
+    const quint64 prefix = prefixOf(value, index == EMailIndex);
+    const auto compare = [this, index, value, prefix](const Entry &e) {
+        return this->compare(index, e, value, prefix);
+    };
+    const Entry *const begin = entries.data();
+    const Entry *const end = begin + entries.size();
+    const Entry *const first = std::partition_point(begin, end, [compare](const Entry &e) {
+        return compare(e) < 0;
+    });
+    const Entry *const last = std::partition_point(first, end, [compare](const Entry &e) {
+        return compare(e) == 0;
+    });
+    return {first, last};
+}
+
+quint32 KeyCacheIndex::Level::keyOfSubkey(quint32 subkeyRow) const
+{
+    return std::distance(m_firstSubkey.begin(), std::upper_bound(m_firstSubkey.begin(), m_firstSubkey.end(), subkeyRow)) - 1;
+}
+
+quint32 KeyCacheIndex::Level::findByFingerprint(const char *fpr) const
+{
+    quint32 result = npos;
+    m_fingerprintHash.find(
+        fpr,
+        [this](quint32 row) {
+            return m_keys[row].primaryFingerprint();
+        },
+        [&result](quint32 row) {
+            result = row;
+            return false;
+        });
+    return result;
+}
+
+quint32 KeyCacheIndex::Level::findByKeyID(const char *keyid) const
+{
+    quint32 result = npos;
+    m_keyIDHash.find(
+        keyid,
+        [this](quint32 row) {
+            return m_keys[row].keyID();
+        },
+        [&result](quint32 row) {
+            result = row;
+            return false;
+        });
+    return result;
+}
+
+std::vector<quint32> KeyCacheIndex::Level::findByEMailAddress(const char *email) const
+{
+    const auto range = equalRange(EMailIndex, email);
+    std::vector<quint32> result;
+    result.reserve(std::distance(range.first, range.second));
+    std::transform(range.first, range.second, std::back_inserter(result), [this](const Entry &e) {
+        return m_emailKeys[e.row];
+    });
+    return result;
+}
+
+std::vector<std::vector<quint32>> KeyCacheIndex::Level::findByEMailAddresses(const std::vector<const char *> &emails) const
+{
+    std::vector<std::vector<quint32>> result(emails.size());
+    const auto &entries = m_indexes[EMailIndex];
+    const Entry *first = entries.data();
+    const Entry *const end = first + entries.size();
+    for (std::size_t i = 0; i < emails.size() && first != end; ++i) {
+        const char *const email = emails[i];
+        if (!email || !*email) {
+            continue;
+        }
+        const quint64 prefix = prefixOf(email, true);
+        const auto isBefore = [this, email, prefix](const Entry &e) {
+            return compare(EMailIndex, e, email, prefix) < 0;
+        };
+        // the addresses are sorted, so that the search continues where the previous search stopped;
+        // gallop ahead to find the range containing the first entry not before the address
+        std::ptrdiff_t step = 1;
+        while (step < end - first && isBefore(first[step])) {
+            first += step;
+            step *= 2;
+        }
+        first = std::partition_point(first, first + std::min<std::ptrdiff_t>(step + 1, end - first), isBefore);
+        for (const Entry *e = first; e != end && compare(EMailIndex, *e, email, prefix) == 0; ++e) {
+            result[i].push_back(m_emailKeys[e->row]);
+        }
+    }
+    return result;
+}
+
+std::vector<quint32> KeyCacheIndex::Level::findSubjects(const char *chainID) const
+{
+    const auto range = equalRange(ChainIDIndex, chainID);
+    std::vector<quint32> result;
+    result.reserve(std::distance(range.first, range.second));
+    std::transform(range.first, range.second, std::back_inserter(result), [](const Entry &e) {
+        return e.row;
+    });
+    return result;
+}
+
+quint32 KeyCacheIndex::Level::findSubkeyByFingerprint(const char *fpr) const
+{
+    quint32 result = npos;
+    m_subkeyFingerprintHash.find(
+        fpr,
+        [this](quint32 row) {
+            return m_subkeys[row].fingerprint();
+        },
+        [&result](quint32 row) {
+            result = row;
+            return false;
+        });
+    return result;
+}
+
+std::vector<quint32> KeyCacheIndex::Level::findSubkeysByKeyID(const char *keyid) const
+{
+    std::vector<quint32> result;
+    m_subkeyIDHash.find(
+        keyid,
+        [this](quint32 row) {
+            return m_subkeys[row].keyID();
+        },
+        [&result](quint32 row) {
+            result.push_back(row);
+            return true;
+        });
+    return result;
+}
+
+std::vector<quint32> KeyCacheIndex::Level::findSubkeysByKeyGrip(const char *grip) const
+{
+    std::vector<quint32> result;
+    m_keyGripHash.find(
+        grip,
+        [this](quint32 row) {
+            return m_subkeys[row].keyGrip();
+        },
+        [&result](quint32 row) {
+            result.push_back(row);
+            return true;
+        });
+    return result;
+}
+
+namespace
+{
+std::vector<Key> sortedByFingerprint(const std::vector<Key> &keys)
+{
+    std::vector<Key> sorted;
+    sorted.reserve(keys.size());
+    std::copy_if(keys.begin(), keys.end(), std::back_inserter(sorted), [](const Key &key) {
+        auto fp = key.primaryFingerprint();
+        return fp && *fp;
+    });
+    _detail::sort_by_fpr(sorted);
+    _detail::remove_duplicates_by_fpr(sorted);
+    return sorted;
+}
+}
+
+
+void KeyCacheIndex::Level::update(const std::vector<Key> &removedKeys, const std::vector<Key> &addedKeys)
+{
+    // 1. merge the added keys into the key table; added keys replace existing keys with the same fingerprint
+    struct Source {
+        bool added;
+        quint32 row;
+    };
+    const _detail::ByFingerprint<std::less> byFingerprint;
+    const std::size_t oldCount = m_keys.size();
+    std::vector<quint32> newRowOfOldKey(oldCount, npos);
+    std::vector<Source> sources;
+    std::vector<Key> keys;
+    sources.reserve(oldCount + addedKeys.size());
+    keys.reserve(oldCount + addedKeys.size());
+    auto removedIt = removedKeys.begin();
+    for (std::size_t i = 0, k = 0; i < oldCount || k < addedKeys.size();) {
+        if (k == addedKeys.size() || (i < oldCount && byFingerprint(m_keys[i], addedKeys[k]))) {
+            removedIt = std::lower_bound(removedIt, removedKeys.end(), m_keys[i], byFingerprint);
+            if (removedIt == removedKeys.end() || byFingerprint(m_keys[i], *removedIt)) {
+                newRowOfOldKey[i] = keys.size();
+                sources.push_back({false, quint32(i)});
+                keys.push_back(m_keys[i]);
+            }
+            ++i;
+        } else {
+            if (i < oldCount && !byFingerprint(addedKeys[k], m_keys[i])) {
+                // the old key is replaced by the added key
+                ++i;
+            }
+            sources.push_back({true, quint32(k)});
+            keys.push_back(addedKeys[k]);
+            ++k;
+        }
+    }
+
+    // 2. rebuild the subkey and email tables in the new order and collect the index entries of the added keys
+    std::vector<quint32> newRowOfOldEMail(m_emailOffsets.size(), npos);
+    std::vector<quint32> firstSubkey{0};
+    std::vector<Subkey> subkeys;
+    std::vector<quint32> firstEMail{0};
+    std::vector<quint32> emailOffsets;
+    std::vector<quint32> emailKeys;
+    std::string emailData;
+    firstSubkey.reserve(keys.size() + 1);
+    firstEMail.reserve(keys.size() + 1);
+    subkeys.reserve(m_subkeys.size() + 2 * addedKeys.size());
+    emailOffsets.reserve(m_emailOffsets.size() + addedKeys.size());
+    emailKeys.reserve(m_emailKeys.size() + addedKeys.size());
+    emailData.reserve(m_emailData.size());
+
+    std::array<std::vector<Entry>, NumIndexes> newEntries;
+    const auto addEntry = [&newEntries](Index index, const char *value, quint32 row) {
+        if (value && *value) {
+            const quint64 prefix = prefixOf(value, index == EMailIndex);
+            newEntries[index].push_back({quint32(prefix >> 32), quint32(prefix), row});
+        }
+    };
+
+    for (quint32 row = 0; row < keys.size(); ++row) {
+        const Source &source = sources[row];
+        if (!source.added) {
+            for (quint32 s = m_firstSubkey[source.row]; s < m_firstSubkey[source.row + 1]; ++s) {
+                subkeys.push_back(m_subkeys[s]);
+            }
+            for (quint32 e = m_firstEMail[source.row]; e < m_firstEMail[source.row + 1]; ++e) {
+                newRowOfOldEMail[e] = emailOffsets.size();
+                emailOffsets.push_back(emailData.size());
+                emailKeys.push_back(row);
+                emailData.append(m_emailData.c_str() + m_emailOffsets[e]);
+                emailData.push_back('\0');
+            }
+        } else {
+            const Key &key = keys[row];
+            if (!key.isRoot()) {
+                addEntry(ChainIDIndex, key.chainID(), row);
+            }
+            for (const Subkey &subkey : key.subkeys()) {
+                if (!subkey.canRenc()) {
+                    subkeys.push_back(subkey);
+                }
+            }
+            for (const std::string &email : emails(key)) {
+                const quint32 emailRow = emailOffsets.size();
+                emailOffsets.push_back(emailData.size());
+                emailKeys.push_back(row);
+                emailData.append(email);
+                emailData.push_back('\0');
+                addEntry(EMailIndex, email.c_str(), emailRow);
+            }
+        }
+        firstSubkey.push_back(subkeys.size());
+        firstEMail.push_back(emailOffsets.size());
+    }
+
+    m_keys.swap(keys);
+    m_firstSubkey.swap(firstSubkey);
+    m_subkeys.swap(subkeys);
+    m_firstEMail.swap(firstEMail);
+    m_emailOffsets.swap(emailOffsets);
+    m_emailKeys.swap(emailKeys);
+    m_emailData.swap(emailData);
+
+    // 3. renumber the entries of the kept keys (this doesn't change their order) and merge the new entries
+    for (int i = 0; i < NumIndexes; ++i) {
+        const auto index = static_cast<Index>(i);
+        const std::vector<quint32> &newRows = index == EMailIndex ? newRowOfOldEMail : newRowOfOldKey;
+        std::vector<Entry> kept;
+        kept.reserve(m_indexes[index].size());
+        for (const Entry &e : m_indexes[index]) {
+            if (const quint32 row = newRows[e.row]; row != npos) {
+                kept.push_back({e.prefixHigh, e.prefixLow, row});
+            }
+        }
+        const auto entryLess = [this, index](const Entry &lhs, const Entry &rhs) {
+            return less(index, lhs, rhs);
+        };
+        std::sort(newEntries[index].begin(), newEntries[index].end(), entryLess);
+        std::vector<Entry> merged;
+        merged.reserve(kept.size() + newEntries[index].size());
+        std::merge(kept.begin(), kept.end(), newEntries[index].begin(), newEntries[index].end(), std::back_inserter(merged), entryLess);
+        m_indexes[index].swap(merged);
+    }
+
+    // 4. the hash tables are cheap to build and are therefore rebuilt from scratch
+    rebuildHashTables();
+}
+
+KeyCacheIndex::KeyCacheIndex() = default;
+
+KeyCacheIndex::~KeyCacheIndex() = default;
+
+KeyCacheIndex::KeyCacheIndex(KeyCacheIndex &&other) = default;
+
+KeyCacheIndex &KeyCacheIndex::operator=(KeyCacheIndex &&other) = default;
+
+const std::vector<Key> &KeyCacheIndex::keys() const
+{
+    if (m_delta.keys().empty() && m_removedCount == 0) {
+        return m_base.keys();
+    }
+    if (!m_allKeysValid) {
+        m_allKeys.clear();
+        m_allKeys.reserve(size());
+        const auto &baseKeys = m_base.keys();
+        const auto &deltaKeys = m_delta.keys();
+        const _detail::ByFingerprint<std::less> byFingerprint;
+        for (std::size_t i = 0, k = 0; i < baseKeys.size() || k < deltaKeys.size();) {
+            if (k == deltaKeys.size() || (i < baseKeys.size() && byFingerprint(baseKeys[i], deltaKeys[k]))) {
+                if (!isRemovedFromBase(i)) {
+                    m_allKeys.push_back(baseKeys[i]);
+                }
+                ++i;
+            } else {
+                // keys of the base level with the same fingerprint as a key of the delta level are marked as removed
+                m_allKeys.push_back(deltaKeys[k]);
+                ++k;
+            }
+        }
+        m_allKeysValid = true;
+    }
+    return m_allKeys;
+}
+
+std::size_t KeyCacheIndex::size() const
+{
+    return m_base.keys().size() - m_removedCount + m_delta.keys().size();
+}
+
+void KeyCacheIndex::clear()
+{
+    m_base.clear();
+    m_delta.clear();
+    m_removedFromBase.clear();
+    m_removedCount = 0;
+    m_allKeys.clear();
+    m_allKeysValid = true;
+}
+
+void KeyCacheIndex::insert(const std::vector<Key> &keys)
+{
+    const auto sorted = sortedByFingerprint(keys);
+    if (sorted.empty()) {
+        return;
+    }
+    removeFromBase(sorted);
+    m_delta.update({}, sorted);
+    m_allKeysValid = false;
+    mergeIfNeeded();
+}
+
+void KeyCacheIndex::remove(const std::vector<Key> &keys)
+{
+    const auto sorted = sortedByFingerprint(keys);
+    if (sorted.empty()) {
+        return;
+    }
+    removeFromBase(sorted);
+    m_delta.update(sorted, {});
+    m_allKeysValid = false;
+    mergeIfNeeded();
+}
+
+void KeyCacheIndex::removeFromBase(const std::vector<Key> &keys)
+{
+    for (const Key &key : keys) {
+        const quint32 row = m_base.findByFingerprint(key.primaryFingerprint());
+        if (row == npos || isRemovedFromBase(row)) {
+            continue;
+        }
+        if (m_removedFromBase.empty()) {
+            m_removedFromBase.resize(m_base.keys().size());
+        }
+        m_removedFromBase[row] = true;
+        ++m_removedCount;
+    }
+}
+
+void KeyCacheIndex::mergeIfNeeded()
+{
+    // updating the delta level costs O(size of delta level), merging costs O(size of base level);
+    // a limit of about the square root of the size of the base level minimizes the total cost
+    static constexpr std::size_t minimumLimit = 256;
+    const auto limit = std::max(minimumLimit, std::size_t(2 * std::sqrt(double(m_base.keys().size()))));
+    if (m_delta.keys().size() > limit || m_removedCount > limit) {
+        merge();
+    }
+}
+
+void KeyCacheIndex::merge()
+{
+    std::vector<Key> removedKeys;
+    removedKeys.reserve(m_removedCount);
+    for (quint32 row = 0; row < m_removedFromBase.size(); ++row) {
+        if (m_removedFromBase[row]) {
+            removedKeys.push_back(m_base.keys()[row]);
+        }
+    }
+    // keys which are removed and re-added are replaced by the keys of the delta level
+    m_base.update(removedKeys, m_delta.keys());
+    m_delta.clear();
+    m_removedFromBase.clear();
+    m_removedCount = 0;
+    m_allKeys.clear();
+    m_allKeysValid = true;
+}
+
+const Key &KeyCacheIndex::findByFingerprint(const char *fpr) const
+{
+    static const Key null;
+    if (const quint32 row = m_delta.findByFingerprint(fpr); row != npos) {
+        return m_delta.keys()[row];
+    }
+    const quint32 row = m_base.findByFingerprint(fpr);
+    return (row != npos && !isRemovedFromBase(row)) ? m_base.keys()[row] : null;
+}
+
+const Key &KeyCacheIndex::findByKeyID(const char *keyid) const
+{
+    static const Key null;
+    if (const quint32 row = m_delta.findByKeyID(keyid); row != npos) {
+        return m_delta.keys()[row];
+    }
+    const quint32 row = m_base.findByKeyID(keyid);
+    return (row != npos && !isRemovedFromBase(row)) ? m_base.keys()[row] : null;
+}
+
+std::vector<Key> KeyCacheIndex::keysOfRows(const std::vector<quint32> &deltaRows, const std::vector<quint32> &baseRows) const
+{
+    std::vector<Key> result;
+    result.reserve(baseRows.size() + deltaRows.size());
+    for (const quint32 row : baseRows) {
+        if (!isRemovedFromBase(row)) {
+            result.push_back(m_base.keys()[row]);
+        }
+    }
+    if (!deltaRows.empty()) {
+        for (const quint32 row : deltaRows) {
+            result.push_back(m_delta.keys()[row]);
+        }
+        _detail::sort_by_fpr(result);
+    }
+    return result;
+}
+
+std::vector<Key> KeyCacheIndex::findByEMailAddress(const char *email) const
+{
+    return keysOfRows(m_delta.findByEMailAddress(email), m_base.findByEMailAddress(email));
+}
+
+std::vector<std::vector<Key>> KeyCacheIndex::findByEMailAddresses(const std::vector<std::string> &emails) const
+{
+    std::vector<std::size_t> order(emails.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&emails](std::size_t lhs, std::size_t rhs) {
+        return compareCaseInsensitive(emails[lhs].c_str(), emails[rhs].c_str()) < 0;
+    });
+    std::vector<const char *> sortedEmails;
+    sortedEmails.reserve(emails.size());
+    for (const std::size_t i : order) {
+        sortedEmails.push_back(emails[i].c_str());
+    }
+    const auto deltaRows = m_delta.findByEMailAddresses(sortedEmails);
+    const auto baseRows = m_base.findByEMailAddresses(sortedEmails);
+    std::vector<std::vector<Key>> result(emails.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        result[order[i]] = keysOfRows(deltaRows[i], baseRows[i]);
+    }
+    return result;
+}
+
+std::vector<Key> KeyCacheIndex::findSubjects(const char *chainID) const
+{
+    return keysOfRows(m_delta.findSubjects(chainID), m_base.findSubjects(chainID));
+}
+
+const Subkey &KeyCacheIndex::findSubkeyByFingerprint(const char *fpr) const
+{
+    static const Subkey null;
+    if (const quint32 row = m_delta.findSubkeyByFingerprint(fpr); row != npos) {
+        return m_delta.subkey(row);
+    }
+    const quint32 row = m_base.findSubkeyByFingerprint(fpr);
+    return (row != npos && !isRemovedFromBase(m_base.keyOfSubkey(row))) ? m_base.subkey(row) : null;
+}
+
+std::vector<Subkey> KeyCacheIndex::findSubkeysByKeyID(const char *keyid) const
+{
+    std::vector<Subkey> result;
+    for (const quint32 row : m_delta.findSubkeysByKeyID(keyid)) {
+        result.push_back(m_delta.subkey(row));
+    }
+    for (const quint32 row : m_base.findSubkeysByKeyID(keyid)) {
+        if (!isRemovedFromBase(m_base.keyOfSubkey(row))) {
+            result.push_back(m_base.subkey(row));
+        }
+    }
+    return result;
+}
+
+std::vector<const Subkey *> KeyCacheIndex::findSubkeysByKeyGrip(const char *grip) const
+{
+    std::vector<const Subkey *> result;
+    for (const quint32 row : m_delta.findSubkeysByKeyGrip(grip)) {
+        result.push_back(&m_delta.subkey(row));
+    }
+    for (const quint32 row : m_base.findSubkeysByKeyGrip(grip)) {
+        if (!isRemovedFromBase(m_base.keyOfSubkey(row))) {
+            result.push_back(&m_base.subkey(row));
+        }
+    }
+    return result;
+}
@@ -0,0 +1,212 @@
+/*
+    models/keycacheindex_p.h
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <QtGlobal>
+
+#include <gpgme++/key.h>
+
+#include <array>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Kleo
+{
+
+/**
+ * The lookup indexes of the key cache.
+ *
+ * The index is a small log-structured merge tree with two levels. The base
+ * level holds the bulk of the keys. Keys inserted later go into a small
+ * delta level; removed or replaced keys of the base level are only marked
+ * as removed. Small updates therefore only touch the delta level. The delta
+ * level is merged into the base level once it (or the number of removed
+ * keys) exceeds a limit growing with the square root of the size of the
+ * base level, so that the cost of the merges is amortized over many updates.
+ * Lookups consult the delta level first and skip removed base keys.
+ *
+ * In each level every key is stored exactly once in the key table which is
+ * sorted by fingerprint. The indexable subkeys and the email addresses of
+ * the keys are stored in tables grouped by key.
+ *
+ * Fingerprints, key IDs and keygrips of keys and subkeys are indexed by
+ * hash tables using open addressing which are keyed on the binary form of
+ * these hex strings. A lookup usually touches a single slot of the table
+ * and compares a single string.
+ *
+ * Email addresses and chain IDs, which may belong to many keys, are indexed
+ * by sorted arrays of compact entries consisting of the first bytes of the
+ * indexed value and the 32-bit row of the key or email address in the
+ * corresponding table. Most comparisons during a lookup therefore only look
+ * at the inline prefixes; the full values are only compared if the prefixes
+ * are equal.
+ *
+ * References returned by the lookup functions and by keys() are invalidated
+ * by insert(), remove() and clear().
+ */
+class KeyCacheIndex
+{
+public:
+    KeyCacheIndex();
+    ~KeyCacheIndex();
+    KeyCacheIndex(KeyCacheIndex &&other);
+    KeyCacheIndex &operator=(KeyCacheIndex &&other);
+
+    /**
+     * Returns all keys sorted by fingerprint.
+     *
+     * If the delta level is not empty, then the list of all keys is created
+     * on the first call after an update.
+     */
+    const std::vector<GpgME::Key> &keys() const;
+    std::size_t size() const;
+
+    void clear();
+
+    /** Adds @p keys to the index replacing keys with the same fingerprint. */
+    void insert(const std::vector<GpgME::Key> &keys);
+    void remove(const std::vector<GpgME::Key> &keys);
+
+    /**
+     * Merges the delta level into the base level. Afterwards, the const
+     * functions do not modify the index until the next update, so that the
+     * index can be queried concurrently from multiple threads.
+     */
+    void merge();
+
+    const GpgME::Key &findByFingerprint(const char *fpr) const;
+    const GpgME::Key &findByKeyID(const char *keyid) const;
+    /** Returns the keys with a user ID with the email address @p email (compared case-insensitively). */
+    std::vector<GpgME::Key> findByEMailAddress(const char *email) const;
+    /**
+     * Returns the keys with a user ID with the email address for each of the
+     * email addresses @p emails. The addresses are sorted once and then looked
+     * up with a single pass over the email index.
+     */
+    std::vector<std::vector<GpgME::Key>> findByEMailAddresses(const std::vector<std::string> &emails) const;
+    /** Returns the keys issued by the key with the fingerprint @p chainID sorted by fingerprint. */
+    std::vector<GpgME::Key> findSubjects(const char *chainID) const;
+
+    const GpgME::Subkey &findSubkeyByFingerprint(const char *fpr) const;
+    std::vector<GpgME::Subkey> findSubkeysByKeyID(const char *keyid) const;
+    /** Returns pointers to the subkeys with the keygrip @p grip. */
+    std::vector<const GpgME::Subkey *> findSubkeysByKeyGrip(const char *grip) const;
+
+    /** Returns the normalized email addresses of the user IDs of @p key. */
+    static std::vector<std::string> emails(const GpgME::Key &key);
+
+private:
+    class HashTable
+    {
+    public:
+        void clear();
+        /** Builds the table for the values of the rows 0 to @p count - 1. */
+        template<typename ValueOf>
+        void build(quint32 count, ValueOf valueOf);
+        /** Calls @p f with the rows whose value is equal to @p value (in ascending order) until @p f returns false. */
+        template<typename ValueOf, typename F>
+        void find(const char *value, ValueOf valueOf, F f) const;
+
+    private:
+        struct Slot {
+            quint32 row; // row + 1 or 0 for empty slots
+            quint32 hash; // upper bits of the hash of the value to skip most string comparisons
+        };
+        std::vector<Slot> m_slots;
+    };
+
+    /** One level of the index. The lookup functions return rows of the key table or the subkey table. */
+    class Level
+    {
+    public:
+        Level();
+
+        const std::vector<GpgME::Key> &keys() const
+        {
+            return m_keys;
+        }
+        const GpgME::Subkey &subkey(quint32 row) const
+        {
+            return m_subkeys[row];
+        }
+        /** Returns the row of the key the subkey in row @p subkeyRow belongs to. */
+        quint32 keyOfSubkey(quint32 subkeyRow) const;
+
+        void clear();
+        /** Removes @p removedKeys and adds @p addedKeys. Both must be sorted by fingerprint. */
+        void update(const std::vector<GpgME::Key> &removedKeys, const std::vector<GpgME::Key> &addedKeys);
+
+        quint32 findByFingerprint(const char *fpr) const;
+        quint32 findByKeyID(const char *keyid) const;
+        std::vector<quint32> findByEMailAddress(const char *email) const;
+        /** Returns the rows for each of the email addresses @p emails which must be sorted case-insensitively. */
+        std::vector<std::vector<quint32>> findByEMailAddresses(const std::vector<const char *> &emails) const;
+        std::vector<quint32> findSubjects(const char *chainID) const;
+        quint32 findSubkeyByFingerprint(const char *fpr) const;
+        std::vector<quint32> findSubkeysByKeyID(const char *keyid) const;
+        std::vector<quint32> findSubkeysByKeyGrip(const char *grip) const;
+
+    private:
+        enum Index {
+            ChainIDIndex,
+            EMailIndex,
+            NumIndexes,
+        };
+
+        // 12 bytes; the prefix is split so that the entries do not need 8-byte alignment
+        struct Entry {
+            quint32 prefixHigh;
+            quint32 prefixLow;
+            quint32 row; // row in the key table or the email table
+        };
+
+        const char *value(Index index, quint32 row) const;
+        bool less(Index index, const Entry &lhs, const Entry &rhs) const;
+        /** Compares the value of @p e with @p value whose prefix is @p prefix. */
+        int compare(Index index, const Entry &e, const char *value, quint64 prefix) const;
+        std::pair<const Entry *, const Entry *> equalRange(Index index, const char *value) const;
+        void rebuildHashTables();
+
+    private:
+        std::vector<GpgME::Key> m_keys;
+        // the subkeys/emails of the key in row r are in the rows [m_first...[r], m_first...[r + 1])
+        std::vector<quint32> m_firstSubkey;
+        std::vector<GpgME::Subkey> m_subkeys;
+        std::vector<quint32> m_firstEMail;
+        std::vector<quint32> m_emailOffsets; // offsets of the NUL-terminated email addresses in m_emailData
+        std::vector<quint32> m_emailKeys; // row of the key an email address belongs to
+        std::string m_emailData;
+        std::array<std::vector<Entry>, NumIndexes> m_indexes;
+        HashTable m_fingerprintHash;
+        HashTable m_keyIDHash;
+        HashTable m_subkeyFingerprintHash;
+        HashTable m_subkeyIDHash;
+        HashTable m_keyGripHash;
+    };
+
+    bool isRemovedFromBase(quint32 row) const
+    {
+        return !m_removedFromBase.empty() && m_removedFromBase[row];
+    }
+    void removeFromBase(const std::vector<GpgME::Key> &keys);
+    void mergeIfNeeded();
+    std::vector<GpgME::Key> keysOfRows(const std::vector<quint32> &deltaRows, const std::vector<quint32> &baseRows) const;
+
+private:
+    Level m_base;
+    Level m_delta;
+    std::vector<bool> m_removedFromBase; // parallel to the key table of m_base; empty if no key was removed
+    std::size_t m_removedCount = 0;
+    mutable std::vector<GpgME::Key> m_allKeys;
+    mutable bool m_allKeysValid = true;
+};
+
+}
@@ -0,0 +1,253 @@
+/*
+    models/keycacheindexfile.cpp
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-libkleo.h>
+
+#include "keycacheindexfile_p.h"
+
+#include <libkleo_debug.h>
+
+#include <QSaveFile>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+
+using namespace Kleo;
+
+namespace
+{
+// The file consists of a header followed by the key table, the entry table
+// (sorted by index and value) and the string pool. All numbers are stored
+// in host byte order; a file written on a machine with different byte order
+// is rejected because of the version check.
+constexpr char magic[8] = {'K', 'L', 'E', 'O', 'I', 'D', 'X', '1'};
+constexpr quint32 formatVersion = 1;
+
+struct FileHeader {
+    char magic[8];
+    quint32 version;
+    quint32 keyCount;
+    quint32 entryCount;
+    quint32 stringsSize;
+    quint32 reserved[2];
+};
+
+struct KeyRecord {
+    quint32 offset;
+    quint32 length;
+    quint32 protocol;
+};
+
+struct EntryRecord {
+    quint32 index;
+    quint32 offset;
+    quint32 length;
+    quint32 key;
+};
+
+static_assert(sizeof(FileHeader) == 32);
+static_assert(sizeof(KeyRecord) == 12);
+static_assert(sizeof(EntryRecord) == 16);
+
+QByteArray normalized(KeyCacheIndexFile::Index index, std::string_view value)
+{
+    const auto bytes = QByteArray::fromRawData(value.data(), value.size());
+    return index == KeyCacheIndexFile::EMail ? bytes.toLower() : bytes.toUpper();
+}
+
+const FileHeader *header(const uchar *data)
+{
+    return reinterpret_cast<const FileHeader *>(data);
+}
+
+const KeyRecord *keyRecords(const uchar *data)
+{
+    return reinterpret_cast<const KeyRecord *>(data + sizeof(FileHeader));
+}
+
+const EntryRecord *entryRecords(const uchar *data)
+{
+    return reinterpret_cast<const EntryRecord *>(data + sizeof(FileHeader) + header(data)->keyCount * sizeof(KeyRecord));
+}
+
+const char *strings(const uchar *data)
+{
+    const auto h = header(data);
+    return reinterpret_cast<const char *>(data + sizeof(FileHeader) + h->keyCount * sizeof(KeyRecord) + h->entryCount * sizeof(EntryRecord));
+}
+}
+
+quint32 KeyCacheIndexFile::Writer::addKey(const char *fingerprint, GpgME::Protocol protocol)
+{
+    m_keys.push_back({QByteArray{fingerprint}.toUpper(), protocol});
+    return m_keys.size() - 1;
+}
+
+void KeyCacheIndexFile::Writer::addEntry(Index index, const char *value, quint32 key)
+{
+    if (!value || !*value) {
+        return;
+    }
+    m_entries.push_back({index, normalized(index, value), key});
+}
+
+bool KeyCacheIndexFile::Writer::write(const QString &fileName)
+{
+    std::sort(m_entries.begin(), m_entries.end(), [](const auto &lhs, const auto &rhs) {
+        return std::tie(lhs.index, lhs.value) < std::tie(rhs.index, rhs.value);
+    });
+
+    QByteArray pool;
+    std::vector<KeyRecord> keys;
+    keys.reserve(m_keys.size());
+    for (const auto &key : m_keys) {
+        keys.push_back({quint32(pool.size()), quint32(key.fingerprint.size()), quint32(key.protocol)});
+        pool += key.fingerprint;
+    }
+    std::vector<EntryRecord> entries;
+    entries.reserve(m_entries.size());
+    for (const auto &entry : m_entries) {
+        entries.push_back({entry.index, quint32(pool.size()), quint32(entry.value.size()), entry.key});
+        pool += entry.value;
+    }
+
+    FileHeader h{};
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version = formatVersion;
+    h.keyCount = keys.size();
+    h.entryCount = entries.size();
+    h.stringsSize = pool.size();
+
+    QSaveFile file{fileName};
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCDebug(LIBKLEO_LOG) << __func__ << "Failed to open" << fileName << "for writing:" << file.errorString();
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    file.write(reinterpret_cast<const char *>(keys.data()), keys.size() * sizeof(KeyRecord));
+    file.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(EntryRecord));
+    file.write(pool);
+    if (!file.commit()) {
+        qCDebug(LIBKLEO_LOG) << __func__ << "Failed to write" << fileName << ":" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+KeyCacheIndexFile::~KeyCacheIndexFile()
+{
+    close();
+}
+
+bool KeyCacheIndexFile::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const qint64 size = m_file.size();
+    const uchar *data = size >= qint64(sizeof(FileHeader)) ? m_file.map(0, size) : nullptr;
+    if (!data) {
+        qCDebug(LIBKLEO_LOG) << __func__ << "Failed to map" << fileName;
+        m_file.close();
+        return false;
+    }
+
+    const auto h = header(data);
+    const bool valid = [&]() {
+        if (std::memcmp(h->magic, magic, sizeof(magic)) != 0 || h->version != formatVersion) {
+            return false;
+        }
+        const qint64 expectedSize = qint64(sizeof(FileHeader)) + qint64(h->keyCount) * sizeof(KeyRecord) + qint64(h->entryCount) * sizeof(EntryRecord)
+            + h->stringsSize;
+        if (expectedSize != size) {
+            return false;
+        }
+        const auto inPool = [h](quint32 offset, quint32 length) {
+            return offset <= h->stringsSize && length <= h->stringsSize - offset;
+        };
+        const auto keys = keyRecords(data);
+        if (!std::all_of(keys, keys + h->keyCount, [inPool](const auto &k) {
+                return inPool(k.offset, k.length);
+            })) {
+            return false;
+        }
+        const auto entries = entryRecords(data);
+        return std::all_of(entries, entries + h->entryCount, [h, inPool](const auto &e) {
+            return e.index <= KeyGrip && e.key < h->keyCount && inPool(e.offset, e.length);
+        });
+    }();
+    if (!valid) {
+        qCDebug(LIBKLEO_LOG) << __func__ << "Ignoring invalid or outdated key index file" << fileName;
+        m_file.unmap(const_cast<uchar *>(data));
+        m_file.close();
+        return false;
+    }
+
+    m_data = data;
+    m_size = size;
+    return true;
+}
+
+void KeyCacheIndexFile::close()
+{
+    if (m_data) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+        m_data = nullptr;
+        m_size = 0;
+    }
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+bool KeyCacheIndexFile::isOpen() const
+{
+    return m_data != nullptr;
+}
+
+std::vector<KeyCacheIndexFile::KeyReference> KeyCacheIndexFile::find(Index index, std::string_view value) const
+{
+    std::vector<KeyReference> result;
+    if (!m_data || value.empty()) {
+        return result;
+    }
+
+    const QByteArray needle = normalized(index, value);
+    const std::string_view needleView{needle.constData(), std::size_t(needle.size())};
+    const char *const pool = strings(m_data);
+    const auto valueOf = [pool](const EntryRecord &e) {
+        return std::string_view{pool + e.offset, e.length};
+    };
+
+    const auto entries = entryRecords(m_data);
+    const auto range = std::equal_range(entries,
+                                        entries + header(m_data)->entryCount,
+                                        std::make_pair(quint32(index), needleView),
+                                        [valueOf](const auto &lhs, const auto &rhs) {
+                                            if constexpr (std::is_same_v<std::decay_t<decltype(lhs)>, EntryRecord>) {
+                                                return std::make_pair(lhs.index, valueOf(lhs)) < rhs;
+                                            } else {
+                                                return lhs < std::make_pair(rhs.index, valueOf(rhs));
+                                            }
+                                        });
+
+    const auto keys = keyRecords(m_data);
+    result.reserve(std::distance(range.first, range.second));
+    std::transform(range.first, range.second, std::back_inserter(result), [keys, pool](const EntryRecord &e) {
+        const KeyRecord &k = keys[e.key];
+        return KeyReference{QByteArray{pool + k.offset, qsizetype(k.length)}, GpgME::Protocol(k.protocol)};
+    });
+    return result;
+}
@@ -0,0 +1,93 @@
+/*
+    models/keycacheindexfile_p.h
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+
+#include <gpgme++/global.h>
+
+#include <string_view>
+#include <vector>
+
+class QString;
+
+namespace Kleo
+{
+
+/**
+ * A persistent snapshot of the lookup indexes of the key cache.
+ *
+ * The file contains the fingerprints and protocols of all keys together with
+ * sorted tables mapping fingerprints, key IDs, email addresses, subkey IDs
+ * and keygrips to these keys. It is memory-mapped when opened so that lookups
+ * do not need to read (or parse) the whole file.
+ *
+ * The file does not contain any key data. It only tells which keys to ask
+ * gpg for while the key cache is still waiting for the first key listing.
+ */
+class KeyCacheIndexFile
+{
+public:
+    enum Index : quint32 {
+        Fingerprint,
+        KeyID,
+        EMail,
+        SubkeyID,
+        KeyGrip,
+    };
+
+    struct KeyReference {
+        QByteArray fingerprint;
+        GpgME::Protocol protocol = GpgME::UnknownProtocol;
+    };
+
+    class Writer
+    {
+    public:
+        /** Adds a key and returns its number for use with addEntry(). */
+        quint32 addKey(const char *fingerprint, GpgME::Protocol protocol);
+        void addEntry(Index index, const char *value, quint32 key);
+
+        bool write(const QString &fileName);
+
+    private:
+        struct Entry {
+            Index index;
+            QByteArray value;
+            quint32 key;
+        };
+        std::vector<KeyReference> m_keys;
+        std::vector<Entry> m_entries;
+    };
+
+    KeyCacheIndexFile() = default;
+    ~KeyCacheIndexFile();
+
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const;
+
+    /**
+     * Returns the keys stored for @p value in the index @p index.
+     *
+     * Fingerprints, key IDs and keygrips are compared case-insensitively.
+     * Email addresses are compared ASCII-case-insensitively like the
+     * email index of the key cache.
+     */
+    std::vector<KeyReference> find(Index index, std::string_view value) const;
+
+private:
+    QFile m_file;
+    const uchar *m_data = nullptr;
+    qint64 m_size = 0;
+};
+
+}
@@ -0,0 +1,163 @@
+/*
+    models/keycachelightindex.cpp
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-libkleo.h>
+
+#include "keycachelightindex_p.h"
+
+#include <libkleo/predicates.h>
+
+#include <QByteArray>
+
+#include <algorithm>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+
+using namespace Kleo;
+using namespace GpgME;
+
+namespace
+{
+std::string normalized(KeyCacheLightIndex::Kind kind, const char *value)
+{
+    const QByteArray bytes{value};
+    return (kind == KeyCacheLightIndex::EMail ? bytes.toLower() : bytes.toUpper()).toStdString();
+}
+}
+
+std::vector<KeySummary> KeyCacheLightIndex::summaries() const
+{
+    std::vector<KeySummary> result;
+    result.reserve(size());
+    std::copy_if(m_summaries.begin(), m_summaries.end(), std::back_inserter(result), [](const KeySummary &summary) {
+        return !summary.fingerprint.empty();
+    });
+    std::sort(result.begin(), result.end(), [](const KeySummary &lhs, const KeySummary &rhs) {
+        return lhs.fingerprint < rhs.fingerprint;
+    });
+    return result;
+}
+
+std::size_t KeyCacheLightIndex::size() const
+{
+    return m_summaries.size() - m_freeRows.size();
+}
+
+void KeyCacheLightIndex::clear()
+{
+    m_summaries.clear();
+    m_freeRows.clear();
+    m_entries.clear();
+}
+
+void KeyCacheLightIndex::insert(const std::vector<Key> &unsortedKeys)
+{
+    std::vector<Key> keys = unsortedKeys;
+    _detail::sort_by_fpr(keys);
+    _detail::remove_duplicates_by_fpr(keys);
+    remove(keys);
+
+    std::vector<Entry> newEntries;
+    const auto addEntry = [&newEntries](Kind kind, const char *value, quint32 row) {
+        if (value && *value) {
+            newEntries.push_back({normalized(kind, value), row, kind});
+        }
+    };
+    for (const Key &key : keys) {
+        if (!key.primaryFingerprint() || !*key.primaryFingerprint()) {
+            continue;
+        }
+        quint32 row;
+        if (!m_freeRows.empty()) {
+            row = m_freeRows.back();
+            m_freeRows.pop_back();
+            m_summaries[row] = KeySummary::fromKey(key);
+        } else {
+            row = m_summaries.size();
+            m_summaries.push_back(KeySummary::fromKey(key));
+        }
+        addEntry(PrimaryFingerprint, key.primaryFingerprint(), row);
+        for (const Subkey &subkey : key.subkeys()) {
+            addEntry(Fingerprint, subkey.fingerprint(), row);
+            addEntry(KeyID, subkey.keyID(), row);
+            addEntry(KeyGrip, subkey.keyGrip(), row);
+        }
+        for (const std::string &email : m_summaries[row].emails) {
+            addEntry(EMail, email.c_str(), row);
+        }
+    }
+
+    const auto less = [](const Entry &lhs, const Entry &rhs) {
+        return std::tie(lhs.kind, lhs.value) < std::tie(rhs.kind, rhs.value);
+    };
+    std::sort(newEntries.begin(), newEntries.end(), less);
+    std::vector<Entry> merged;
+    merged.reserve(m_entries.size() + newEntries.size());
+    std::merge(std::make_move_iterator(m_entries.begin()),
+               std::make_move_iterator(m_entries.end()),
+               std::make_move_iterator(newEntries.begin()),
+               std::make_move_iterator(newEntries.end()),
+               std::back_inserter(merged),
+               less);
+    m_entries.swap(merged);
+}
+
+void KeyCacheLightIndex::remove(const std::vector<Key> &keys)
+{
+    std::vector<bool> removedRows;
+    for (const Key &key : keys) {
+        for (const KeySummary *summary : find(PrimaryFingerprint, key.primaryFingerprint())) {
+            const quint32 row = summary - m_summaries.data();
+            if (removedRows.empty()) {
+                removedRows.resize(m_summaries.size());
+            }
+            removedRows[row] = true;
+        }
+    }
+    if (removedRows.empty()) {
+        return;
+    }
+    for (quint32 row = 0; row < removedRows.size(); ++row) {
+        if (removedRows[row]) {
+            m_summaries[row] = KeySummary{};
+            m_freeRows.push_back(row);
+        }
+    }
+    m_entries.erase(std::remove_if(m_entries.begin(),
+                                   m_entries.end(),
+                                   [&removedRows](const Entry &entry) {
+                                       return removedRows[entry.row];
+                                   }),
+                    m_entries.end());
+}
+
+std::vector<const KeySummary *> KeyCacheLightIndex::find(Kind kind, const char *value) const
+{
+    std::vector<const KeySummary *> result;
+    if (!value || !*value) {
+        return result;
+    }
+    const std::string needle = normalized(kind, value);
+    const auto range = std::equal_range(m_entries.begin(), m_entries.end(), std::tie(kind, needle), [](const auto &lhs, const auto &rhs) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(lhs)>, Entry>) {
+            return std::tie(lhs.kind, lhs.value) < rhs;
+        } else {
+            return lhs < std::tie(rhs.kind, rhs.value);
+        }
+    });
+    for (auto it = range.first; it != range.second; ++it) {
+        const KeySummary *summary = &m_summaries[it->row];
+        // a key may have several subkeys with the same keygrip
+        if (std::find(result.begin(), result.end(), summary) == result.end()) {
+            result.push_back(summary);
+        }
+    }
+    return result;
+}
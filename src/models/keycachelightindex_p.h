@@ -0,0 +1,66 @@
+/*
+    models/keycachelightindex_p.h
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include "keysummary.h"
+
+#include <QtGlobal>
+
+#include <string>
+#include <vector>
+
+namespace Kleo
+{
+
+/**
+ * The lookup index of the key cache in light mode.
+ *
+ * Instead of the keys the index stores a KeySummary per key and a sorted
+ * table mapping the fingerprints, key IDs and keygrips of the keys and
+ * their subkeys, and the email addresses of the keys to the summaries.
+ * The rows of the summaries do not change when keys are added or removed;
+ * the rows of removed keys are reused.
+ */
+class KeyCacheLightIndex
+{
+public:
+    enum Kind : quint8 {
+        PrimaryFingerprint,
+        Fingerprint, //< fingerprints of keys and subkeys
+        KeyID, //< key IDs of keys and subkeys
+        KeyGrip,
+        EMail,
+    };
+
+    /** Returns the summaries of all keys sorted by fingerprint. */
+    std::vector<KeySummary> summaries() const;
+    std::size_t size() const;
+
+    void clear();
+    /** Adds @p keys to the index replacing keys with the same fingerprint. */
+    void insert(const std::vector<GpgME::Key> &keys);
+    void remove(const std::vector<GpgME::Key> &keys);
+
+    /** Returns the summaries of the keys matching @p value. Email addresses are compared case-insensitively. */
+    std::vector<const KeySummary *> find(Kind kind, const char *value) const;
+
+private:
+    struct Entry {
+        std::string value;
+        quint32 row;
+        Kind kind;
+    };
+
+    std::vector<KeySummary> m_summaries; // summaries with empty fingerprint are unused
+    std::vector<quint32> m_freeRows;
+    std::vector<Entry> m_entries; // sorted by kind and value
+};
+
+}
@@ -0,0 +1,173 @@
+/*
+    models/keycachesearchindex.cpp
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-libkleo.h>
+
+#include "keycachesearchindex_p.h"
+
+#include "keycacheindex_p.h"
+
+#include <libkleo/dn.h>
+
+#include <QString>
+#include <QStringView>
+
+#include <algorithm>
+#include <unordered_set>
+
+using namespace Kleo;
+using namespace GpgME;
+
+namespace
+{
+quint32 trigramAt(std::string_view s, std::size_t pos)
+{
+    return (quint32(uchar(s[pos])) << 16) | (quint32(uchar(s[pos + 1])) << 8) | quint32(uchar(s[pos + 2]));
+}
+
+std::string nameOf(const UserID &uid)
+{
+    if (uid.parent().protocol() == GpgME::CMS) {
+        return DN(uid.id())[QStringLiteral("CN")].trimmed().toStdString();
+    }
+    return uid.name() ? uid.name() : std::string{};
+}
+}
+
+KeyCacheSearchIndex::KeyCacheSearchIndex(const std::vector<Key> &keys)
+    : m_keys{keys}
+{
+    for (quint32 row = 0; row < m_keys.size(); ++row) {
+        const Key &key = m_keys[row];
+        if (const char *fpr = key.primaryFingerprint()) {
+            addTerm(normalized(QString::fromLatin1(fpr)), row);
+        }
+        for (const std::string &email : KeyCacheIndex::emails(key)) {
+            addTerm(normalized(QString::fromStdString(email)), row);
+        }
+        const auto userIDs = key.userIDs();
+        for (const UserID &uid : userIDs) {
+            addTerm(normalized(QString::fromStdString(nameOf(uid))), row);
+        }
+    }
+    buildIndexes();
+}
+
+std::string KeyCacheSearchIndex::normalized(QStringView text)
+{
+    return text.trimmed().toString().toCaseFolded().toStdString();
+}
+
+std::string_view KeyCacheSearchIndex::term(quint32 termId) const
+{
+    return std::string_view{m_termData.c_str() + m_termOffsets[termId]};
+}
+
+void KeyCacheSearchIndex::addTerm(std::string_view term, quint32 keyRow)
+{
+    if (term.empty()) {
+        return;
+    }
+    m_termOffsets.push_back(m_termData.size());
+    m_termKeys.push_back(keyRow);
+    m_termData.append(term);
+    m_termData.push_back('\0');
+}
+
+void KeyCacheSearchIndex::buildIndexes()
+{
+    const quint32 termCount = m_termOffsets.size();
+
+    m_sortedTerms.resize(termCount);
+    for (quint32 id = 0; id < termCount; ++id) {
+        m_sortedTerms[id] = id;
+    }
+    std::sort(m_sortedTerms.begin(), m_sortedTerms.end(), [this](quint32 lhs, quint32 rhs) {
+        return term(lhs) < term(rhs);
+    });
+
+    std::vector<std::pair<quint32, quint32>> pairs; // (trigram, term ID)
+    pairs.reserve(m_termData.size());
+    for (quint32 id = 0; id < termCount; ++id) {
+        const std::string_view t = term(id);
+        for (std::size_t pos = 0; pos + 3 <= t.size(); ++pos) {
+            pairs.emplace_back(trigramAt(t, pos), id);
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+    m_trigrams.clear();
+    m_postingOffsets.clear();
+    m_postings.clear();
+    m_postings.reserve(pairs.size());
+    for (const auto &[trigram, id] : pairs) {
+        if (m_trigrams.empty() || m_trigrams.back() != trigram) {
+            m_trigrams.push_back(trigram);
+            m_postingOffsets.push_back(m_postings.size());
+        }
+        m_postings.push_back(id);
+    }
+    m_postingOffsets.push_back(m_postings.size());
+}
+
+std::vector<Key> KeyCacheSearchIndex::search(QStringView text, std::size_t limit) const
+{
+    std::vector<Key> result;
+    const std::string needle = normalized(text);
+    if (needle.empty() || limit == 0) {
+        return result;
+    }
+
+    std::unordered_set<quint32> seenKeys;
+    const auto addKeyOfTerm = [this, &result, &seenKeys](quint32 termId) {
+        const quint32 row = m_termKeys[termId];
+        if (seenKeys.insert(row).second) {
+            result.push_back(m_keys[row]);
+        }
+    };
+
+    // 1. terms starting with the search text
+    auto it = std::lower_bound(m_sortedTerms.begin(), m_sortedTerms.end(), needle, [this](quint32 id, const std::string &value) {
+        return term(id) < value;
+    });
+    for (; it != m_sortedTerms.end() && result.size() < limit; ++it) {
+        if (term(*it).substr(0, needle.size()) != needle) {
+            break;
+        }
+        addKeyOfTerm(*it);
+    }
+
+    // 2. terms containing the search text; the terms listed for the rarest trigram of the search text are candidates
+    if (needle.size() < 3 || result.size() >= limit) {
+        return result;
+    }
+    const quint32 *candidates = nullptr;
+    const quint32 *candidatesEnd = nullptr;
+    for (std::size_t pos = 0; pos + 3 <= needle.size(); ++pos) {
+        const auto trigramIt = std::lower_bound(m_trigrams.begin(), m_trigrams.end(), trigramAt(needle, pos));
+        if (trigramIt == m_trigrams.end() || *trigramIt != trigramAt(needle, pos)) {
+            // no term contains this trigram
+            return result;
+        }
+        const auto i = std::distance(m_trigrams.begin(), trigramIt);
+        const quint32 *const begin = m_postings.data() + m_postingOffsets[i];
+        const quint32 *const end = m_postings.data() + m_postingOffsets[i + 1];
+        if (!candidates || end - begin < candidatesEnd - candidates) {
+            candidates = begin;
+            candidatesEnd = end;
+        }
+    }
+    for (const quint32 *id = candidates; id != candidatesEnd && result.size() < limit; ++id) {
+        if (term(*id).find(needle) != std::string_view::npos) {
+            addKeyOfTerm(*id);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,68 @@
+/*
+    models/keycachesearchindex_p.h
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <QtGlobal>
+
+#include <gpgme++/key.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+class QStringView;
+
+namespace Kleo
+{
+
+/**
+ * The type-ahead search index of the key cache.
+ *
+ * The index contains the case-folded email addresses, names and fingerprints
+ * (the search terms) of the keys. Prefix matches are found by binary search
+ * in the sorted list of terms. Substring matches are found with a trigram
+ * index mapping each sequence of three bytes to the terms containing it;
+ * only the terms listed for the rarest trigram of the search text are
+ * compared with the search text.
+ */
+class KeyCacheSearchIndex
+{
+public:
+    KeyCacheSearchIndex() = default;
+    explicit KeyCacheSearchIndex(const std::vector<GpgME::Key> &keys);
+
+    /**
+     * Returns up to @p limit keys with a term starting with or containing
+     * @p text. Keys with a term starting with @p text come first. Substrings
+     * are only matched if @p text has at least three characters.
+     */
+    std::vector<GpgME::Key> search(QStringView text, std::size_t limit) const;
+
+    /** Returns the normalized form of @p text used for the terms and the search text. */
+    static std::string normalized(QStringView text);
+
+private:
+    std::string_view term(quint32 termId) const;
+    void addTerm(std::string_view term, quint32 keyRow);
+    void buildIndexes();
+
+private:
+    std::vector<GpgME::Key> m_keys;
+    std::string m_termData; // the NUL-terminated terms
+    std::vector<quint32> m_termOffsets;
+    std::vector<quint32> m_termKeys; // row of the key a term belongs to
+    std::vector<quint32> m_sortedTerms; // term IDs sorted by term
+    // trigram index in compressed sparse row format
+    std::vector<quint32> m_trigrams; // sorted
+    std::vector<quint32> m_postingOffsets; // the terms of m_trigrams[i] are in [m_postingOffsets[i], m_postingOffsets[i + 1])
+    std::vector<quint32> m_postings; // term IDs
+};
+
+}
@@ -0,0 +1,174 @@
+/*
+    models/keycachesnapshot.cpp
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-libkleo.h>
+
+#include "keycachesnapshot.h"
+
+#include "keycacheindex_p.h"
+
+#include <libkleo/predicates.h>
+
+#include <gpgme++/decryptionresult.h>
+#include <gpgme++/key.h>
+#include <gpgme++/verificationresult.h>
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <mutex>
+
+using namespace Kleo;
+using namespace GpgME;
+
+class KeyCacheSnapshot::Private
+{
+public:
+    explicit Private(const std::vector<Key> &keys)
+        : m_keys{keys}
+    {
+    }
+
+    const KeyCacheIndex &index() const
+    {
+        std::call_once(m_indexBuilt, [this]() {
+            m_index.insert(m_keys);
+            // make sure that the const functions of the index do not modify it
+            m_index.merge();
+            m_keys.clear();
+        });
+        return m_index;
+    }
+
+private:
+    mutable std::vector<Key> m_keys; // only needed until the index has been built
+    mutable std::once_flag m_indexBuilt;
+    mutable KeyCacheIndex m_index;
+};
+
+KeyCacheSnapshot::KeyCacheSnapshot(const std::vector<Key> &keys)
+    : d{new Private{keys}}
+{
+}
+
+KeyCacheSnapshot::~KeyCacheSnapshot() = default;
+
+const std::vector<Key> &KeyCacheSnapshot::keys() const
+{
+    return d->index().keys();
+}
+
+const Key &KeyCacheSnapshot::findByFingerprint(const char *fpr) const
+{
+    return d->index().findByFingerprint(fpr);
+}
+
+std::vector<Key> KeyCacheSnapshot::findByEMailAddress(const char *email) const
+{
+    return d->index().findByEMailAddress(email);
+}
+
+const Key &KeyCacheSnapshot::findByKeyIDOrFingerprint(const char *id) const
+{
+    const Key &key = d->index().findByFingerprint(id);
+    return key.isNull() ? d->index().findByKeyID(id) : key;
+}
+
+std::vector<Key> KeyCacheSnapshot::findByKeyIDOrFingerprint(const std::vector<std::string> &ids) const
+{
+    std::vector<Key> result;
+    result.reserve(ids.size());
+    for (const std::string &id : ids) {
+        if (id.empty()) {
+            continue;
+        }
+        const Key &key = findByKeyIDOrFingerprint(id.c_str());
+        if (!key.isNull()) {
+            result.push_back(key);
+        }
+    }
+    _detail::sort_by_fpr(result);
+    _detail::remove_duplicates_by_fpr(result);
+    return result;
+}
+
+std::vector<Subkey> KeyCacheSnapshot::findSubkeysByKeyGrip(const char *grip, Protocol protocol) const
+{
+    std::vector<Subkey> subkeys;
+    for (const Subkey *subkey : d->index().findSubkeysByKeyGrip(grip)) {
+        if (protocol == UnknownProtocol || subkey->parent().protocol() == protocol) {
+            subkeys.push_back(*subkey);
+        }
+    }
+    return subkeys;
+}
+
+std::vector<Subkey> KeyCacheSnapshot::findSubkeysByKeyID(const std::vector<std::string> &ids) const
+{
+    std::vector<Subkey> result;
+    for (const std::string &id : ids) {
+        const auto subkeys = d->index().findSubkeysByKeyID(id.c_str());
+        result.insert(result.end(), subkeys.begin(), subkeys.end());
+    }
+    return result;
+}
+
+const Subkey &KeyCacheSnapshot::findSubkeyByFingerprint(const char *fpr) const
+{
+    return d->index().findSubkeyByFingerprint(fpr);
+}
+
+std::vector<Key> KeyCacheSnapshot::findRecipients(const DecryptionResult &result) const
+{
+    std::vector<std::string> keyids;
+    const auto recipients = result.recipients();
+    for (const DecryptionResult::Recipient &r : recipients) {
+        if (const char *kid = r.keyID()) {
+            keyids.push_back(kid);
+        }
+    }
+    const std::vector<Subkey> subkeys = findSubkeysByKeyID(keyids);
+    std::vector<Key> keys;
+    keys.reserve(subkeys.size());
+    std::transform(subkeys.begin(), subkeys.end(), std::back_inserter(keys), std::mem_fn(&Subkey::parent));
+    _detail::sort_by_fpr(keys);
+    _detail::remove_duplicates_by_fpr(keys);
+    return keys;
+}
+
+Key KeyCacheSnapshot::findSigner(const Signature &signature) const
+{
+    if (signature.isNull()) {
+        return {};
+    }
+
+    Key key = signature.key();
+    if (key.isNull() && signature.fingerprint()) {
+        key = findByFingerprint(signature.fingerprint());
+    }
+    if (key.isNull() && signature.fingerprint()) {
+        // try to find a subkey that was used for signing
+        const Subkey &subkey = findSubkeyByFingerprint(signature.fingerprint());
+        if (!subkey.isNull()) {
+            key = subkey.parent();
+        }
+    }
+    return key;
+}
+
+std::vector<Key> KeyCacheSnapshot::findSigners(const VerificationResult &result) const
+{
+    std::vector<Key> signers;
+    const auto signatures = result.signatures();
+    signers.reserve(signatures.size());
+    std::transform(signatures.begin(), signatures.end(), std::back_inserter(signers), [this](const Signature &signature) {
+        return findSigner(signature);
+    });
+    return signers;
+}
@@ -0,0 +1,75 @@
+/*
+    models/keycachesnapshot.h
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include "kleo_export.h"
+
+#include <gpgme++/global.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace GpgME
+{
+class DecryptionResult;
+class Key;
+class Signature;
+class Subkey;
+class VerificationResult;
+}
+
+namespace Kleo
+{
+
+/**
+ * An immutable snapshot of the keys of the KeyCache.
+ *
+ * Unlike the KeyCache, which must only be used in the GUI thread, a snapshot
+ * can be queried concurrently from any number of threads without locking.
+ * Use KeyCache::snapshot() to get the most recent snapshot. The key cache
+ * publishes a new snapshot whenever its keys have changed; snapshots which
+ * have already been handed out are not modified.
+ *
+ * The lookup indexes of a snapshot are built on the first query.
+ */
+class KLEO_EXPORT KeyCacheSnapshot
+{
+public:
+    /** Creates a snapshot of the keys @p keys. */
+    explicit KeyCacheSnapshot(const std::vector<GpgME::Key> &keys);
+    ~KeyCacheSnapshot();
+
+    KeyCacheSnapshot(const KeyCacheSnapshot &) = delete;
+    KeyCacheSnapshot &operator=(const KeyCacheSnapshot &) = delete;
+
+    /** Returns all keys sorted by fingerprint. */
+    const std::vector<GpgME::Key> &keys() const;
+
+    const GpgME::Key &findByFingerprint(const char *fpr) const;
+    std::vector<GpgME::Key> findByEMailAddress(const char *email) const;
+
+    const GpgME::Key &findByKeyIDOrFingerprint(const char *id) const;
+    std::vector<GpgME::Key> findByKeyIDOrFingerprint(const std::vector<std::string> &ids) const;
+
+    std::vector<GpgME::Subkey> findSubkeysByKeyGrip(const char *grip, GpgME::Protocol protocol = GpgME::UnknownProtocol) const;
+    std::vector<GpgME::Subkey> findSubkeysByKeyID(const std::vector<std::string> &ids) const;
+    const GpgME::Subkey &findSubkeyByFingerprint(const char *fpr) const;
+
+    std::vector<GpgME::Key> findRecipients(const GpgME::DecryptionResult &result) const;
+    GpgME::Key findSigner(const GpgME::Signature &signature) const;
+    std::vector<GpgME::Key> findSigners(const GpgME::VerificationResult &result) const;
+
+private:
+    class Private;
+    const std::unique_ptr<Private> d;
+};
+
+}
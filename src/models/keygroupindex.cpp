@@ -0,0 +1,140 @@
+/*
+    models/keygroupindex.cpp
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-libkleo.h>
+
+#include "keygroupindex_p.h"
+
+#include <libkleo_debug.h>
+
+#include <gpgme++/key.h>
+
+#include <algorithm>
+
+using namespace Kleo;
+using namespace GpgME;
+
+namespace
+{
+bool hasFlag(quint8 summary, quint8 flag)
+{
+    return (summary & flag) == flag;
+}
+}
+
+void KeyGroupIndex::rebuild(const std::vector<KeyGroup> &groups)
+{
+    clear();
+    m_summaries.reserve(groups.size());
+    for (std::size_t position = 0; position < groups.size(); ++position) {
+        const KeyGroup &group = groups[position];
+        m_summaries.push_back(summarize(group));
+        m_groupsByName[group.name()].push_back(position);
+        for (const Key &key : group.keys()) {
+            if (key.primaryFingerprint()) {
+                m_groupsByFingerprint[QByteArray{key.primaryFingerprint()}].push_back(position);
+            }
+        }
+    }
+}
+
+void KeyGroupIndex::clear()
+{
+    m_summaries.clear();
+    m_groupsByName.clear();
+    m_groupsByFingerprint.clear();
+}
+
+void KeyGroupIndex::updateSummary(std::size_t position, const KeyGroup &group)
+{
+    Q_ASSERT(position < m_summaries.size());
+    m_summaries[position] = summarize(group);
+}
+
+std::vector<std::size_t> KeyGroupIndex::groupsNamed(const QString &name) const
+{
+    return m_groupsByName.value(name);
+}
+
+std::vector<std::size_t> KeyGroupIndex::groupsContaining(const char *fpr) const
+{
+    if (!fpr || !*fpr) {
+        return {};
+    }
+    return m_groupsByFingerprint.value(QByteArray{fpr});
+}
+
+std::optional<std::size_t> KeyGroupIndex::findGroup(const QString &name, Protocol protocol, KeyCache::KeyUsage usage) const
+{
+    const auto it = m_groupsByName.constFind(name);
+    if (it == m_groupsByName.cend()) {
+        return std::nullopt;
+    }
+    const auto match = std::find_if(it->begin(), it->end(), [this, protocol, usage](std::size_t position) {
+        return matches(m_summaries[position], protocol, usage);
+    });
+    if (match == it->end()) {
+        return std::nullopt;
+    }
+    return *match;
+}
+
+KeyGroupIndex::Summary KeyGroupIndex::summarize(const KeyGroup &group)
+{
+    // the flags hold for all keys of an empty group
+    Summary summary = AllKeysHaveSign | AllKeysHaveEncrypt | AllKeysHaveCertify | AllKeysHaveAuthenticate | AllKeysAreOpenPGP | AllKeysAreCMS;
+    for (const Key &key : group.keys()) {
+        Summary keySummary = 0;
+        keySummary |= key.hasSign() ? AllKeysHaveSign : 0;
+        keySummary |= key.hasEncrypt() ? AllKeysHaveEncrypt : 0;
+        keySummary |= key.hasCertify() ? AllKeysHaveCertify : 0;
+        keySummary |= key.hasAuthenticate() ? AllKeysHaveAuthenticate : 0;
+        keySummary |= key.protocol() == OpenPGP ? AllKeysAreOpenPGP : key.protocol() == CMS ? AllKeysAreCMS : 0;
+        summary &= keySummary;
+    }
+    return summary;
+}
+
+bool KeyGroupIndex::matches(Summary summary, Protocol protocol, KeyCache::KeyUsage usage)
+{
+    switch (protocol) {
+    case OpenPGP:
+        if (!hasFlag(summary, AllKeysAreOpenPGP)) {
+            return false;
+        }
+        break;
+    case CMS:
+        if (!hasFlag(summary, AllKeysAreCMS)) {
+            return false;
+        }
+        break;
+    case UnknownProtocol:
+        break;
+    default:
+        // only the keys of an empty group all have another protocol
+        if (!hasFlag(summary, AllKeysAreOpenPGP | AllKeysAreCMS)) {
+            return false;
+        }
+        break;
+    }
+    switch (usage) {
+    case KeyCache::KeyUsage::AnyUsage:
+        return true;
+    case KeyCache::KeyUsage::Sign:
+        return hasFlag(summary, AllKeysHaveSign);
+    case KeyCache::KeyUsage::Encrypt:
+        return hasFlag(summary, AllKeysHaveEncrypt);
+    case KeyCache::KeyUsage::Certify:
+        return hasFlag(summary, AllKeysHaveCertify);
+    case KeyCache::KeyUsage::Authenticate:
+        return hasFlag(summary, AllKeysHaveAuthenticate);
+    }
+    qCDebug(LIBKLEO_LOG) << __func__ << "called with invalid usage" << int(usage);
+    return false;
+}
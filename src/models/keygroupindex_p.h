@@ -0,0 +1,79 @@
+/*
+    models/keygroupindex_p.h
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include "keycache.h"
+
+#include <libkleo/keygroup.h>
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+#include <gpgme++/global.h>
+
+#include <optional>
+#include <vector>
+
+namespace Kleo
+{
+
+/**
+ * The lookup index of the groups of the key cache.
+ *
+ * The index refers to the groups by their position in the list of groups
+ * of the key cache. It maps the names of the groups and the fingerprints
+ * of their keys to the groups, and it stores a summary of the protocols and
+ * the usages of the keys of each group, so that finding a group for a
+ * protocol and a usage does not need to look at the keys.
+ */
+class KeyGroupIndex
+{
+public:
+    /** Indexes @p groups replacing the previously indexed groups. */
+    void rebuild(const std::vector<KeyGroup> &groups);
+    void clear();
+
+    /** Updates the summary of the group at @p position after its keys have been updated. */
+    void updateSummary(std::size_t position, const KeyGroup &group);
+
+    /** Returns the positions of the groups named @p name in ascending order. */
+    std::vector<std::size_t> groupsNamed(const QString &name) const;
+    /** Returns the positions of the groups containing the key with fingerprint @p fpr in ascending order. */
+    std::vector<std::size_t> groupsContaining(const char *fpr) const;
+
+    /**
+     * Returns the position of the first group named @p name whose keys all
+     * allow @p usage and, unless @p protocol is UnknownProtocol, all have
+     * @p protocol.
+     */
+    std::optional<std::size_t> findGroup(const QString &name, GpgME::Protocol protocol, KeyCache::KeyUsage usage) const;
+
+private:
+    // flags telling which conditions hold for all keys of a group
+    enum SummaryFlag : quint8 {
+        AllKeysHaveSign = 0x01,
+        AllKeysHaveEncrypt = 0x02,
+        AllKeysHaveCertify = 0x04,
+        AllKeysHaveAuthenticate = 0x08,
+        AllKeysAreOpenPGP = 0x10,
+        AllKeysAreCMS = 0x20,
+    };
+    using Summary = quint8;
+
+    static Summary summarize(const KeyGroup &group);
+    static bool matches(Summary summary, GpgME::Protocol protocol, KeyCache::KeyUsage usage);
+
+    std::vector<Summary> m_summaries;
+    QHash<QString, std::vector<std::size_t>> m_groupsByName;
+    QHash<QByteArray, std::vector<std::size_t>> m_groupsByFingerprint;
+};
+
+}
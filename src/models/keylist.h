@@ -22,6 +22,8 @@ static const int FingerprintRole = 0xF1;
 static const int KeyRole         = 0xF2;
 static const int GroupRole       = 0xF3;
 static const int UserIDRole      = 0xF4;
+static const int SearchTextRole  = 0xF5; // the case-folded user IDs, fingerprints and remarks of a key separated by newlines
+static const int RemarksRole     = 0xF6; // the remarks of a key if they have been loaded, a null value otherwise; requesting them schedules their loading
 // clang-format on
 
 enum Columns {
@@ -0,0 +1,141 @@
+/*
+    models/keylistfilterengine.cpp
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-libkleo.h>
+
+#include "keylistfilterengine_p.h"
+
+#include <QPromise>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <atomic>
+
+using namespace Kleo;
+using namespace GpgME;
+
+namespace
+{
+static constexpr std::size_t chunkSize = 256;
+
+struct Job {
+    explicit Job(std::size_t itemCount)
+        : matches(itemCount)
+    {
+    }
+
+    std::vector<char> matches; // char instead of bool, so that the workers write to distinct memory locations
+    std::atomic<std::size_t> nextChunk = 0;
+    std::atomic<int> runningWorkers = 0;
+};
+}
+
+std::optional<QString> KeyListFilterEngine::foldedLiteral(const QRegularExpression &filter)
+{
+    const auto options = filter.patternOptions();
+    if (!(options & QRegularExpression::CaseInsensitiveOption) || (options & QRegularExpression::ExtendedPatternSyntaxOption)) {
+        return std::nullopt;
+    }
+    // undo QRegularExpression::escape()
+    static const QString metaCharacters = QStringLiteral("\\^$.|?*+()[]{}");
+    const QString pattern = filter.pattern();
+    QString literal;
+    literal.reserve(pattern.size());
+    for (qsizetype i = 0; i < pattern.size(); ++i) {
+        QChar ch = pattern[i];
+        if (ch == QLatin1Char('\\')) {
+            if (++i == pattern.size()) {
+                return std::nullopt;
+            }
+            ch = pattern[i];
+            if (ch.isLetterOrNumber() || ch == QLatin1Char('_')) {
+                // a character class or another special escape sequence
+                return std::nullopt;
+            }
+        } else if (metaCharacters.contains(ch)) {
+            return std::nullopt;
+        }
+        if (ch == QLatin1Char('\n')) {
+            // newlines separate the texts in the search texts
+            return std::nullopt;
+        }
+        literal += ch;
+    }
+    return literal.toCaseFolded();
+}
+
+bool KeyListFilterEngine::matches(const Item &item, const QRegularExpression &filter, const std::optional<QString> &literal, bool matchColumn)
+{
+    if (matchColumn) {
+        return item.text.contains(filter);
+    }
+    if (literal && !item.searchText.isNull()) {
+        return item.searchText.contains(*literal);
+    }
+    if (!item.key.isNull()) {
+        // by default match against the full uid data (name / email / comment / dn)
+        if (item.userID.isNull()) {
+            const auto userIDs = item.key.userIDs();
+            if (std::any_of(userIDs.begin(), userIDs.end(), [&filter](const UserID &uid) {
+                    return QString::fromUtf8(uid.id()).contains(filter);
+                })) {
+                return true;
+            }
+        } else if (QString::fromUtf8(item.userID.id()).contains(filter)) {
+            return true;
+        }
+        // also match against remarks (search tags)
+        if (!item.remarks.isNull() && item.remarks.contains(filter)) {
+            return true;
+        }
+        // also match against fingerprints
+        const auto subkeys = item.key.subkeys();
+        return std::any_of(subkeys.begin(), subkeys.end(), [&filter](const Subkey &subkey) {
+            return QString::fromLatin1(subkey.fingerprint()).contains(filter);
+        });
+    }
+    if (!item.group.isNull()) {
+        return item.text.contains(filter);
+    }
+    return false;
+}
+
+QFuture<std::vector<bool>> KeyListFilterEngine::match(const std::shared_ptr<const Input> &input)
+{
+    auto promise = std::make_shared<QPromise<std::vector<bool>>>();
+    QFuture<std::vector<bool>> future = promise->future();
+    promise->start();
+
+    const std::size_t itemCount = input->items->size();
+    const std::size_t chunkCount = (itemCount + chunkSize - 1) / chunkSize;
+    const int workerCount = std::clamp<int>(chunkCount, 1, std::max(1, QThreadPool::globalInstance()->maxThreadCount()));
+    auto job = std::make_shared<Job>(itemCount);
+    job->runningWorkers = workerCount;
+    for (int i = 0; i < workerCount; ++i) {
+        QThreadPool::globalInstance()->start([input, job, promise, itemCount, chunkCount]() {
+            // each worker uses its own instance of the regular expression
+            const QRegularExpression filter{input->filter.pattern(), input->filter.patternOptions()};
+            for (std::size_t chunk = job->nextChunk++; chunk < chunkCount && !promise->isCanceled(); chunk = job->nextChunk++) {
+                const std::size_t end = std::min(itemCount, (chunk + 1) * chunkSize);
+                for (std::size_t row = chunk * chunkSize; row < end; ++row) {
+                    if (input->candidates.empty() || input->candidates[row]) {
+                        job->matches[row] = matches((*input->items)[row], filter, input->literal, input->matchColumn);
+                    }
+                }
+            }
+            if (--job->runningWorkers == 0) {
+                if (!promise->isCanceled()) {
+                    promise->addResult(std::vector<bool>(job->matches.begin(), job->matches.end()));
+                }
+                promise->finish();
+            }
+        });
+    }
+    return future;
+}
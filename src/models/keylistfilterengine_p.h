@@ -0,0 +1,76 @@
+/*
+    models/keylistfilterengine_p.h
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <libkleo/keygroup.h>
+
+#include <QFuture>
+#include <QRegularExpression>
+#include <QString>
+
+#include <gpgme++/key.h>
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace Kleo
+{
+
+/**
+ * Matches the text filter of a KeyListSortFilterProxyModel against the rows
+ * of the source model in worker threads.
+ *
+ * The GUI thread copies everything needed for matching the rows into an
+ * immutable Input, so that the workers never access the source model. The
+ * rows are split into chunks which are picked by the workers until all
+ * chunks have been matched.
+ */
+class KeyListFilterEngine
+{
+public:
+    struct Item {
+        GpgME::Key key;
+        GpgME::UserID userID;
+        KeyGroup group;
+        QString text; //< the content of the filter column, or the name of the group
+        QString remarks;
+        QString searchText; //< the search text of the key, see KeyList::SearchTextRole
+        qsizetype parent = -1; //< the item of the parent row, or -1 for top-level rows
+    };
+
+    struct Input {
+        std::shared_ptr<const std::vector<Item>> items; //< the items of the children of a row are stored consecutively and after the row
+        std::vector<bool> candidates; //< the items to match; all items are matched if this is empty
+        QRegularExpression filter;
+        std::optional<QString> literal; //< the case-folded text matched by the filter if the filter matches a literal text
+        bool matchColumn = false; //< whether to match the filter against the content of the filter column
+    };
+
+    /**
+     * Matches the text filter against the items of @p input. The result has
+     * one entry per item; items which are not candidates do not match.
+     * Canceling the returned future stops the workers.
+     */
+    static QFuture<std::vector<bool>> match(const std::shared_ptr<const Input> &input);
+
+    static bool matches(const Item &item, const QRegularExpression &filter, const std::optional<QString> &literal, bool matchColumn);
+
+    /**
+     * Returns the case-folded text matched by @p filter if @p filter is a
+     * case-insensitive regular expression matching a literal text, e.g. one
+     * set with QSortFilterProxyModel::setFilterFixedString(). Such filters
+     * are matched against the search texts of the keys with a plain substring
+     * search.
+     */
+    static std::optional<QString> foldedLiteral(const QRegularExpression &filter);
+};
+
+}
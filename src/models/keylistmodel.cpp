@@ -14,8 +14,10 @@
 #include "keylistmodel.h"
 
 #include "keycache.h"
+#include "remarksloader_p.h"
 
 #include <libkleo/algorithm.h>
+#include <libkleo/compliance.h>
 #include <libkleo/formatting.h>
 #include <libkleo/keyfilter.h>
 #include <libkleo/keyfiltermanager.h>
@@ -34,14 +36,10 @@
 #include <QHash>
 #include <QIcon>
 #include <QMimeData>
+#include <QTimer>
 
 #include <gpgme++/key.h>
 
-#ifndef Q_MOC_RUN // QTBUG-22829
-#include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/topological_sort.hpp>
-#endif
-
 #include <algorithm>
 #include <iterator>
 #include <map>
@@ -66,21 +64,34 @@ public:
     void updateFromKeyCache();
 
     QString getEMail(const Key &key) const;
+    QVariant keyData(const Key &key, int row, int column, int role) const;
+    QString searchText(const Key &key) const;
+    bool hasRemarks(const Key &key) const;
+    void remarksLoaded(const std::vector<Key> &keys);
+    void removeCachedDisplayData(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void checkComplianceState() const;
 
 public:
     int m_toolTipOptions = Formatting::Validity;
     mutable QHash<const char *, QString> prettyEMailCache;
-    mutable QHash<const char *, QVariant> remarksCache;
+    struct DisplayData {
+        Key key; // the version of the key the values were computed for
+        QHash<int, QVariant> values;
+    };
+    mutable QHash<QByteArray, DisplayData> displayDataCache; // formatted values of the keys by fingerprint
+    mutable int complianceState = -1;
+    mutable bool complianceStateChecked = false;
     bool m_useKeyCache = false;
     bool m_modelResetInProgress = false;
     KeyList::Options m_keyListOptions = AllKeys;
-    std::vector<GpgME::Key> m_remarkKeys;
+    RemarksLoader *remarksLoader = nullptr;
     std::shared_ptr<DragHandler> m_dragHandler;
     std::vector<Key::Origin> extraOrigins;
 };
 
 AbstractKeyListModel::Private::Private(Kleo::AbstractKeyListModel *qq)
     : q(qq)
+    , remarksLoader(new RemarksLoader(qq))
 {
 }
 
@@ -116,6 +127,68 @@ QString AbstractKeyListModel::Private::getEMail(const Key &key) const
     return email;
 }
 
+bool AbstractKeyListModel::Private::hasRemarks(const Key &key) const
+{
+    return key.protocol() == GpgME::OpenPGP && key.numUserIDs() && !remarksLoader->remarkKeys().empty();
+}
+
+void AbstractKeyListModel::Private::remarksLoaded(const std::vector<Key> &keys)
+{
+    std::vector<QModelIndex> indexes;
+    indexes.reserve(keys.size());
+    for (const Key &key : keys) {
+        const QModelIndex idx = q->index(key, Remarks);
+        if (idx.isValid()) {
+            indexes.push_back(idx);
+        }
+    }
+    std::sort(indexes.begin(), indexes.end(), [](const QModelIndex &lhs, const QModelIndex &rhs) {
+        return lhs.parent() != rhs.parent() ? lhs.parent() < rhs.parent() : lhs.row() < rhs.row();
+    });
+    // emit one signal per range of adjacent rows instead of one per key, because every
+    // signal makes the proxy models drop their caches; also drops the cached search texts
+    auto first = indexes.begin();
+    while (first != indexes.end()) {
+        auto last = first;
+        while (std::next(last) != indexes.end() && std::next(last)->parent() == first->parent() && std::next(last)->row() == last->row() + 1) {
+            ++last;
+        }
+        Q_EMIT q->dataChanged(*first, *last);
+        first = std::next(last);
+    }
+}
+
+void AbstractKeyListModel::Private::removeCachedDisplayData(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    if (displayDataCache.isEmpty() || !topLeft.isValid()) {
+        return;
+    }
+    for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+        const Key key = q->key(q->index(row, 0, topLeft.parent()));
+        if (const char *const fpr = key.primaryFingerprint()) {
+            displayDataCache.remove(QByteArray::fromRawData(fpr, qstrlen(fpr)));
+        }
+    }
+}
+
+void AbstractKeyListModel::Private::checkComplianceState() const
+{
+    // the validity column and the tool tips depend on the compliance mode; check it
+    // at most once per event loop iteration because reading the configuration is slow
+    if (complianceStateChecked) {
+        return;
+    }
+    complianceStateChecked = true;
+    QTimer::singleShot(0, q, [this]() {
+        complianceStateChecked = false;
+    });
+    const int state = (DeVSCompliance::isActive() ? 1 : 0) | (DeVSCompliance::isCompliant() ? 2 : 0);
+    if (state != complianceState) {
+        displayDataCache.clear();
+        complianceState = state;
+    }
+}
+
 AbstractKeyListModel::AbstractKeyListModel(QObject *p)
     : QAbstractItemModel(p)
     , KeyListModelInterface()
@@ -127,6 +200,12 @@ AbstractKeyListModel::AbstractKeyListModel(QObject *p)
     connect(this, &QAbstractItemModel::modelReset, this, [this]() {
         d->m_modelResetInProgress = false;
     });
+    connect(this, &QAbstractItemModel::dataChanged, this, [this](const QModelIndex &topLeft, const QModelIndex &bottomRight) {
+        d->removeCachedDisplayData(topLeft, bottomRight);
+    });
+    connect(d->remarksLoader, &RemarksLoader::remarksLoaded, this, [this](const std::vector<Key> &keys) {
+        d->remarksLoaded(keys);
+    });
 }
 
 AbstractKeyListModel::~AbstractKeyListModel()
@@ -135,6 +214,9 @@ AbstractKeyListModel::~AbstractKeyListModel()
 
 void AbstractKeyListModel::setToolTipOptions(int opts)
 {
+    if (d->m_toolTipOptions != opts) {
+        d->displayDataCache.clear();
+    }
     d->m_toolTipOptions = opts;
 }
 
@@ -145,12 +227,14 @@ int AbstractKeyListModel::toolTipOptions() const
 
 void AbstractKeyListModel::setRemarkKeys(const std::vector<GpgME::Key> &keys)
 {
-    d->m_remarkKeys = keys;
+    // the search texts include the remarks
+    d->displayDataCache.clear();
+    d->remarksLoader->setRemarkKeys(keys);
 }
 
 std::vector<GpgME::Key> AbstractKeyListModel::remarkKeys() const
 {
-    return d->m_remarkKeys;
+    return d->remarksLoader->remarkKeys();
 }
 
 Key AbstractKeyListModel::key(const QModelIndex &idx) const
@@ -255,7 +339,8 @@ void AbstractKeyListModel::removeKey(const Key &key)
     }
     doRemoveKey(key);
     d->prettyEMailCache.remove(key.primaryFingerprint());
-    d->remarksCache.remove(key.primaryFingerprint());
+    d->remarksLoader->forget(key);
+    d->displayDataCache.remove(QByteArray{key.primaryFingerprint()});
 }
 
 QList<QModelIndex> AbstractKeyListModel::addKeys(const std::vector<Key> &keys)
@@ -305,7 +390,8 @@ void AbstractKeyListModel::clear(ItemTypes types)
     doClear(types);
     if (types & Keys) {
         d->prettyEMailCache.clear();
-        d->remarksCache.clear();
+        d->remarksLoader->clear();
+        d->displayDataCache.clear();
     }
     if (!inReset) {
         endResetModel();
@@ -394,7 +480,75 @@ QVariant AbstractKeyListModel::data(const QModelIndex &index, int role) const
     return QVariant();
 }
 
+namespace
+{
+constexpr qsizetype maximumCachedDisplayData = 10000;
+
+// Returns the slot of the cached value for the given column and role or -1 if the value is not cached.
+int displayDataSlot(int column, int role)
+{
+    if (column < 0 || column >= NumColumns) {
+        return -1;
+    }
+    if (role == Qt::ToolTipRole) {
+        // the tool tip is the same for all columns
+        return 0;
+    }
+    if (role == SearchTextRole) {
+        // the search text is the same for all columns
+        return NumColumns * 4 + 1;
+    }
+    if (column == Origin || column == Remarks) {
+        // the values of these columns do not only depend on the key
+        return -1;
+    }
+    int roleOffset;
+    switch (role) {
+    case Qt::DisplayRole:
+        roleOffset = 1;
+        break;
+    case Qt::EditRole:
+        roleOffset = 2;
+        break;
+    case Qt::AccessibleTextRole:
+        roleOffset = 3;
+        break;
+    case ClipboardRole:
+        roleOffset = 4;
+        break;
+    default:
+        return -1;
+    }
+    return column * 4 + roleOffset;
+}
+}
+
 QVariant AbstractKeyListModel::data(const Key &key, int row, int column, int role) const
+{
+    const int slot = displayDataSlot(column, role);
+    const char *const fpr = key.primaryFingerprint();
+    if (slot < 0 || !fpr) {
+        return d->keyData(key, row, column, role);
+    }
+    d->checkComplianceState();
+    auto it = d->displayDataCache.find(QByteArray::fromRawData(fpr, qstrlen(fpr)));
+    if (it == d->displayDataCache.end()) {
+        if (d->displayDataCache.size() >= maximumCachedDisplayData) {
+            d->displayDataCache.clear();
+        }
+        it = d->displayDataCache.insert(QByteArray{fpr}, Private::DisplayData{key, {}});
+    } else if (it->key.impl() != key.impl()) {
+        // the key has been updated
+        *it = Private::DisplayData{key, {}};
+    }
+    auto valueIt = it->values.constFind(slot);
+    if (valueIt == it->values.constEnd()) {
+        valueIt = it->values.insert(slot, d->keyData(key, row, column, role));
+    }
+    return *valueIt;
+}
+
+QVariant AbstractKeyListModel::Private::keyData(const Key &key, int row, int column, int role) const
 {
     if (role == Qt::DisplayRole || role == Qt::EditRole || role == Qt::AccessibleTextRole || role == ClipboardRole) {
         switch (column) {
@@ -406,7 +560,7 @@ QVariant AbstractKeyListModel::data(const Key &key, int row, int column, int rol
             return name;
         }
         case PrettyEMail: {
-            const auto email = d->getEMail(key);
+            const auto email = getEMail(key);
             if (role == Qt::AccessibleTextRole) {
                 return email.isEmpty() ? i18nc("text for screen readers for an empty email address", "no email") : email;
             }
@@ -453,8 +607,8 @@ QVariant AbstractKeyListModel::data(const Key &key, int row, int column, int rol
         case Issuer:
             return QString::fromUtf8(key.issuerName());
         case Origin:
-            if (key.origin() == Key::OriginUnknown && (int)d->extraOrigins.size() > row) {
-                return Formatting::origin(d->extraOrigins[row]);
+            if (key.origin() == Key::OriginUnknown && (int)extraOrigins.size() > row) {
+                return Formatting::origin(extraOrigins[row]);
             }
             return Formatting::origin(key.origin());
         case LastUpdate:
@@ -467,35 +621,12 @@ QVariant AbstractKeyListModel::data(const Key &key, int row, int column, int rol
             return QString::fromUtf8(key.issuerSerial());
         case OwnerTrust:
             return Formatting::ownerTrustShort(key.ownerTrust());
-        case Remarks: {
-            const char *const fpr = key.primaryFingerprint();
-            if (fpr && key.protocol() == GpgME::OpenPGP && key.numUserIDs() && d->m_remarkKeys.size()) {
-                if (!(key.keyListMode() & GpgME::SignatureNotations)) {
-                    return i18n("Loading...");
-                }
-                const QHash<const char *, QVariant>::const_iterator it = d->remarksCache.constFind(fpr);
-                if (it != d->remarksCache.constEnd()) {
-                    return *it;
-                } else {
-                    GpgME::Error err;
-                    const auto remarks = key.userID(0).remarks(d->m_remarkKeys, err);
-                    if (remarks.size() == 1) {
-                        const auto remark = QString::fromStdString(remarks[0]);
-                        return d->remarksCache[fpr] = remark;
-                    } else {
-                        QStringList remarkList;
-                        remarkList.reserve(remarks.size());
-                        for (const auto &rem : remarks) {
-                            remarkList << QString::fromStdString(rem);
-                        }
-                        const auto remark = remarkList.join(QStringLiteral("; "));
-                        return d->remarksCache[fpr] = remark;
-                    }
-                }
-            } else {
-                return QVariant();
+        case Remarks:
+            if (hasRemarks(key)) {
+                // the remarks are loaded in the background
+                const auto remarks = remarksLoader->remarks(key);
+                return remarks ? *remarks : i18n("Loading...");
             }
-        }
             return QVariant();
         case Algorithm:
             return Formatting::prettyAlgorithmName(key.subkey(0).algoName());
@@ -509,7 +640,7 @@ QVariant AbstractKeyListModel::data(const Key &key, int row, int column, int rol
             break;
         }
     } else if (role == Qt::ToolTipRole) {
-        return Formatting::toolTip(key, toolTipOptions());
+        return Formatting::toolTip(key, m_toolTipOptions);
     } else if (role == Qt::FontRole) {
         return KeyFilterManager::instance()->font(key, (column == KeyID || column == Fingerprint) ? QFont(QStringLiteral("monospace")) : QFont());
     } else if (role == Qt::DecorationRole) {
@@ -526,10 +657,45 @@ QVariant AbstractKeyListModel::data(const Key &key, int row, int column, int rol
         return QString::fromLatin1(key.primaryFingerprint());
     } else if (role == KeyRole) {
         return QVariant::fromValue(key);
+    } else if (role == SearchTextRole) {
+        return searchText(key);
+    } else if (role == RemarksRole) {
+        // unlike the Remarks column, this role does not return a placeholder while the remarks are loaded
+        if (hasRemarks(key)) {
+            if (const auto remarks = remarksLoader->remarks(key)) {
+                return *remarks;
+            }
+        }
     }
     return QVariant();
 }
 
+QString AbstractKeyListModel::Private::searchText(const Key &key) const
+{
+    // separate the texts by newlines, so that a search text cannot match across texts
+    QString text;
+    const auto append = [&text](const QString &s) {
+        if (!text.isEmpty()) {
+            text += QLatin1Char('\n');
+        }
+        text += s;
+    };
+    for (const UserID &uid : key.userIDs()) {
+        append(QString::fromUtf8(uid.id()));
+    }
+    for (const Subkey &subkey : key.subkeys()) {
+        append(QString::fromLatin1(subkey.fingerprint()));
+    }
+    if (hasRemarks(key)) {
+        // the search texts are built for all keys, so that they must not trigger the loading
+        // of the remarks; the search text is updated when the remarks have been loaded
+        if (const auto remarks = remarksLoader->loadedRemarks(key)) {
+            append(*remarks);
+        }
+    }
+    return text.toCaseFolded();
+}
+
 QVariant AbstractKeyListModel::data(const KeyGroup &group, int column, int role) const
 {
     if (role == Qt::DisplayRole || role == Qt::EditRole || role == Qt::AccessibleTextRole) {
@@ -833,6 +999,12 @@ QModelIndex FlatKeyListModel::doMapFromKey(const Key &key, int col) const
     }
 }
 
+namespace
+{
+// with more insertion points it's cheaper to merge all keys at once and reset the model
+constexpr std::size_t maxInsertionRunsWithoutReset = 16;
+}
+
 QList<QModelIndex> FlatKeyListModel::doAddKeys(const std::vector<Key> &keys)
 {
     Q_ASSERT(std::is_sorted(keys.begin(), keys.end(), _detail::ByFingerprint<std::less>()));
@@ -841,26 +1013,77 @@ QList<QModelIndex> FlatKeyListModel::doAddKeys(const std::vector<Key> &keys)
         return QList<QModelIndex>();
     }
 
-    for (auto it = keys.begin(), end = keys.end(); it != end; ++it) {
-        // find an insertion point:
-        const std::vector<Key>::iterator pos = std::upper_bound(mKeysByFingerprint.begin(), mKeysByFingerprint.end(), *it, _detail::ByFingerprint<std::less>());
-        const unsigned int idx = std::distance(mKeysByFingerprint.begin(), pos);
-
-        if (idx > 0 && qstrcmp(mKeysByFingerprint[idx - 1].primaryFingerprint(), it->primaryFingerprint()) == 0) {
+    // 1. replace the keys which existed before and collect the new keys together with
+    //    the rows of the old list before which they have to be inserted
+    const _detail::ByFingerprint<std::less> less;
+    std::vector<Key> newKeys;
+    std::vector<int> insertionRows;
+    std::vector<int> changedRows;
+    auto pos = mKeysByFingerprint.begin();
+    for (const Key &key : keys) {
+        pos = std::lower_bound(pos, mKeysByFingerprint.end(), key, less);
+        if (pos != mKeysByFingerprint.end() && !less(key, *pos)) {
             // key existed before - replace with new one:
-            mKeysByFingerprint[idx - 1] = *it;
-            if (!modelResetInProgress()) {
-                Q_EMIT dataChanged(createIndex(idx - 1, 0), createIndex(idx - 1, NumColumns - 1));
+            *pos = key;
+            const int row = std::distance(mKeysByFingerprint.begin(), pos);
+            if (changedRows.empty() || changedRows.back() != row) {
+                changedRows.push_back(row);
             }
+        } else if (!newKeys.empty() && !less(newKeys.back(), key)) {
+            // duplicate new key - the last one wins
+            newKeys.back() = key;
         } else {
-            // new key - insert:
-            if (!modelResetInProgress()) {
-                beginInsertRows(QModelIndex(), idx, idx);
-            }
-            mKeysByFingerprint.insert(pos, *it);
-            if (!modelResetInProgress()) {
-                endInsertRows();
+            newKeys.push_back(key);
+            insertionRows.push_back(std::distance(mKeysByFingerprint.begin(), pos));
+        }
+    }
+
+    if (!modelResetInProgress()) {
+        for (auto first = changedRows.begin(); first != changedRows.end();) {
+            auto last = first;
+            while (std::next(last) != changedRows.end() && *std::next(last) == *last + 1) {
+                ++last;
             }
+            Q_EMIT dataChanged(createIndex(*first, 0), createIndex(*last, NumColumns - 1));
+            first = std::next(last);
+        }
+    }
+
+    if (newKeys.empty()) {
+        return indexes(keys);
+    }
+
+    // 2. insert the new keys; keys with the same insertion row form a contiguous run of rows
+    std::vector<std::pair<std::size_t, std::size_t>> runs; // [begin, end) in newKeys
+    for (std::size_t i = 0; i < newKeys.size(); ++i) {
+        if (runs.empty() || insertionRows[runs.back().first] != insertionRows[i]) {
+            runs.emplace_back(i, i + 1);
+        } else {
+            runs.back().second = i + 1;
+        }
+    }
+
+    if (modelResetInProgress() || runs.size() > maxInsertionRunsWithoutReset) {
+        // a layout change must not change the number of rows; therefore, reset the model
+        // instead of announcing each insertion if the new keys are spread over many rows
+        const bool announceReset = !modelResetInProgress();
+        if (announceReset) {
+            beginResetModel();
+        }
+        std::vector<Key> merged;
+        merged.reserve(mKeysByFingerprint.size() + newKeys.size());
+        std::merge(mKeysByFingerprint.begin(), mKeysByFingerprint.end(), newKeys.begin(), newKeys.end(), std::back_inserter(merged), less);
+        mKeysByFingerprint.swap(merged);
+        if (announceReset) {
+            endResetModel();
+        }
+    } else {
+        // insert the runs back to front so that the insertion rows of the other runs stay valid
+        for (auto run = runs.rbegin(); run != runs.rend(); ++run) {
+            const int row = insertionRows[run->first];
+            beginInsertRows(QModelIndex(), row, row + (run->second - run->first) - 1);
+            mKeysByFingerprint.insert(mKeysByFingerprint.begin() + row, newKeys.begin() + run->first, newKeys.begin() + run->second);
+            endInsertRows();
         }
     }
 
@@ -1184,90 +1407,60 @@ void HierarchicalKeyListModel::addTopLevelKey(const Key &key)
 namespace
 {
 
-// based on https://www.boost.org/doc/libs/1_77_0/libs/graph/doc/file_dependency_example.html#sec:cycles
-struct cycle_detector : public boost::dfs_visitor<> {
-    cycle_detector(bool &has_cycle)
-        : _has_cycle{has_cycle}
-    {
-    }
-
-    template<class Edge, class Graph>
-    void back_edge(Edge, Graph &)
-    {
-        _has_cycle = true;
-    }
-
-private:
-    bool &_has_cycle;
-};
-
-static bool graph_has_cycle(const boost::adjacency_list<> &graph)
-{
-    bool cycle_found = false;
-    cycle_detector vis{cycle_found};
-    boost::depth_first_search(graph, visitor(vis));
-    return cycle_found;
-}
-
-static void find_keys_causing_cycles_and_mask_their_issuers(const std::vector<Key> &keys)
+// Returns the issuers of key from its parent up to the root (or the first issuer that is not in keys).
+// Stops if the chain returns to an issuer that has already been visited.
+static std::vector<Key> issuer_chain(const Key &key, const std::vector<Key> &keys)
 {
-    boost::adjacency_list<> graph{keys.size()};
-
-    for (unsigned int i = 0, end = keys.size(); i != end; ++i) {
-        const auto &key = keys[i];
-        const char *const issuer_fpr = cleanChainID(key);
-        if (!issuer_fpr || !*issuer_fpr) {
-            continue;
-        }
+    std::vector<Key> chain;
+    const char *issuer_fpr = cleanChainID(key);
+    while (issuer_fpr && *issuer_fpr) {
         const std::vector<Key>::const_iterator it = Kleo::binary_find(keys.begin(), keys.end(), issuer_fpr, _detail::ByFingerprint<std::less>());
         if (it == keys.end()) {
-            continue;
+            break;
         }
-        const auto j = std::distance(keys.begin(), it);
-        const auto edge = boost::add_edge(i, j, graph).first;
-        if (graph_has_cycle(graph)) {
-            Issuers::instance()->maskIssuerOfKey(key);
-            boost::remove_edge(edge, graph);
+        const bool visited = std::any_of(chain.begin(), chain.end(), [&it](const Key &k) {
+            return _detail::ByFingerprint<std::equal_to>()(k, *it);
+        });
+        chain.push_back(*it);
+        if (visited) {
+            break;
         }
+        issuer_fpr = cleanChainID(*it);
     }
+    return chain;
 }
 
-static auto build_key_graph(const std::vector<Key> &keys)
+// Masks the issuer of the given (new or changed) keys if their issuer chain leads back to them.
+// Only the chains of these keys need to be checked because the other keys didn't form a cycle before.
+static void mask_issuers_of_keys_causing_cycles(const std::vector<Key> &keys, const std::vector<Key> &allKeys)
 {
-    boost::adjacency_list<> graph(keys.size());
-
-    // add edges from children to parents:
-    for (unsigned int i = 0, end = keys.size(); i != end; ++i) {
-        const char *const issuer_fpr = cleanChainID(keys[i]);
-        if (!issuer_fpr || !*issuer_fpr) {
-            continue;
-        }
-        const std::vector<Key>::const_iterator it = Kleo::binary_find(keys.begin(), keys.end(), issuer_fpr, _detail::ByFingerprint<std::less>());
-        if (it == keys.end()) {
-            continue;
+    for (const Key &key : keys) {
+        const auto chain = issuer_chain(key, allKeys);
+        const bool has_cycle = std::any_of(chain.begin(), chain.end(), [&key](const Key &k) {
+            return _detail::ByFingerprint<std::equal_to>()(k, key);
+        });
+        if (has_cycle) {
+            Issuers::instance()->maskIssuerOfKey(key);
         }
-        const auto j = std::distance(keys.begin(), it);
-        add_edge(i, j, graph);
     }
-
-    return graph;
 }
 
 // sorts 'keys' such that parent always come before their children:
-static std::vector<Key> topological_sort(const std::vector<Key> &keys)
+static std::vector<Key> sort_by_depth(const std::vector<Key> &keys, const std::vector<Key> &allKeys)
 {
-    const auto graph = build_key_graph(keys);
-
-    std::vector<int> order;
-    order.reserve(keys.size());
-    topological_sort(graph, std::back_inserter(order));
-
-    Q_ASSERT(order.size() == keys.size());
+    std::vector<std::pair<std::size_t, Key>> keysWithDepth;
+    keysWithDepth.reserve(keys.size());
+    for (const Key &key : keys) {
+        keysWithDepth.emplace_back(issuer_chain(key, allKeys).size(), key);
+    }
+    std::stable_sort(keysWithDepth.begin(), keysWithDepth.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.first < rhs.first;
+    });
 
     std::vector<Key> result;
     result.reserve(keys.size());
-    for (int i : std::as_const(order)) {
-        result.push_back(keys[i]);
+    for (const auto &[depth, key] : keysWithDepth) {
+        result.push_back(key);
     }
     return result;
 }
@@ -1282,34 +1475,44 @@ QList<QModelIndex> HierarchicalKeyListModel::doAddKeys(const std::vector<Key> &k
         return QList<QModelIndex>();
     }
 
-    const std::vector<Key> oldKeys = mKeysByFingerprint;
-
-    std::vector<Key> merged;
-    merged.reserve(keys.size() + mKeysByFingerprint.size());
-    std::set_union(keys.begin(),
-                   keys.end(),
+    // replace the keys which existed before in place and merge the new keys
+    std::vector<Key> newKeys;
+    {
+        auto pos = mKeysByFingerprint.begin();
+        for (const Key &key : keys) {
+            pos = std::lower_bound(pos, mKeysByFingerprint.end(), key, _detail::ByFingerprint<std::less>());
+            if (pos != mKeysByFingerprint.end() && _detail::ByFingerprint<std::equal_to>()(*pos, key)) {
+                *pos = key;
+            } else if (newKeys.empty() || !_detail::ByFingerprint<std::equal_to>()(newKeys.back(), key)) {
+                newKeys.push_back(key);
+            }
+        }
+    }
+    if (!newKeys.empty()) {
+        std::vector<Key> merged;
+        merged.reserve(newKeys.size() + mKeysByFingerprint.size());
+        std::merge(newKeys.begin(),
+                   newKeys.end(),
                    mKeysByFingerprint.begin(),
                    mKeysByFingerprint.end(),
                    std::back_inserter(merged),
                    _detail::ByFingerprint<std::less>());
-
-    mKeysByFingerprint = merged;
-
-    if (graph_has_cycle(build_key_graph(mKeysByFingerprint))) {
-        find_keys_causing_cycles_and_mask_their_issuers(mKeysByFingerprint);
+        mKeysByFingerprint.swap(merged);
     }
 
+    mask_issuers_of_keys_causing_cycles(keys, mKeysByFingerprint);
+
     std::set<Key, _detail::ByFingerprint<std::less>> changedParents;
 
-    const auto topologicalSortedList = topological_sort(keys);
-    for (const Key &key : topologicalSortedList) {
+    const auto sortedByDepth = sort_by_depth(keys, mKeysByFingerprint);
+    for (const Key &key : sortedByDepth) {
         // check to see whether this key is a parent for a previously parent-less group:
         const char *const fpr = key.primaryFingerprint();
         if (!fpr || !*fpr) {
             continue;
         }
 
-        const bool keyAlreadyExisted = std::binary_search(oldKeys.begin(), oldKeys.end(), key, _detail::ByFingerprint<std::less>());
+        const bool keyAlreadyExisted = !std::binary_search(newKeys.begin(), newKeys.end(), key, _detail::ByFingerprint<std::less>());
 
         const Map::iterator it = mKeysByNonExistingParent.find(fpr);
         const std::vector<Key> children = it != mKeysByNonExistingParent.end() ? it->second : std::vector<Key>();
@@ -12,6 +12,7 @@
 #include "keylistsortfilterproxymodel.h"
 
 #include "keylist.h"
+#include "keylistfilterengine_p.h"
 #include "keylistmodel.h"
 
 #include <libkleo/algorithm.h>
@@ -21,8 +22,13 @@
 
 #include <libkleo_debug.h>
 
+#include <QCollator>
+#include <QHash>
+
 #include <gpgme++/key.h>
 
+#include <optional>
+
 using namespace Kleo;
 using namespace GpgME;
 
@@ -123,30 +129,347 @@ QModelIndex AbstractKeyListSortFilterProxyModel::index(const Kleo::KeyGroup &gro
 class KeyListSortFilterProxyModel::Private
 {
     friend class ::Kleo::KeyListSortFilterProxyModel;
+    KeyListSortFilterProxyModel *const q;
 
 public:
-    explicit Private()
-        : keyFilter()
+    explicit Private(KeyListSortFilterProxyModel *qq)
+        : q{qq}
+        , keyFilter()
     {
     }
     ~Private()
     {
+        cancelFiltering();
     }
 
+private:
+    std::vector<KeyListFilterEngine::Item> collectItems(const KeyListFilterEngine::Input &input, int column, int role, QHash<QModelIndex, qsizetype> &firstChildItems);
+    void startFiltering();
+    void cancelFiltering();
+    void publishFilterResult(const std::vector<bool> &textMatches);
+    void dropFilterResult();
+    void sourceModelAboutToChange();
+    std::optional<bool> acceptedByFilterResult(int sourceRow, const QModelIndex &sourceParent) const;
+    const std::optional<QString> &literalFilter(const QRegularExpression &filter) const;
+    struct SortValue;
+    const SortValue *sortValue(const QModelIndex &sourceIndex) const;
+    bool matchesKeyFilter(const KeyListFilterEngine::Item &item) const;
+
 private:
     std::shared_ptr<const KeyFilter> keyFilter;
+    std::vector<QMetaObject::Connection> sourceModelConnections;
+
+    // the rows accepted by the filter set with setFilterFixedStringAsync()
+    struct FilterResult {
+        QRegularExpression filter;
+        std::optional<QString> literal;
+        int column;
+        int role;
+        std::shared_ptr<const KeyFilter> keyFilter;
+        std::shared_ptr<const std::vector<KeyListFilterEngine::Item>> items;
+        QHash<QModelIndex, qsizetype> firstChildItems; // by parent (or invalid index for top-level rows)
+        std::vector<bool> textMatches; // by item
+        std::vector<bool> accepted; // by item
+    };
+    std::optional<FilterResult> filterResult;
+
+    // the filter which is matched in worker threads
+    struct PendingFilter {
+        QString text;
+        int column = 0;
+        int role = Qt::DisplayRole;
+        std::shared_ptr<const KeyListFilterEngine::Input> input;
+        QHash<QModelIndex, qsizetype> firstChildItems;
+        QFuture<std::vector<bool>> future;
+    };
+    std::optional<PendingFilter> pendingFilter;
+    bool restartScheduled = false;
+
+    mutable QRegularExpression literalFilterSource;
+    mutable std::optional<QString> literalFilterText;
+
+    // the values of the sort column of the top-level source rows prepared for comparison
+    struct SortValue {
+        std::optional<QCollatorSortKey> collationKey; // if the sorting is locale-aware
+        QString text; // case-folded if the sorting is case-insensitive
+        bool isText = false;
+    };
+    struct SortValues {
+        int column;
+        int role;
+        Qt::CaseSensitivity caseSensitivity;
+        bool localeAware;
+        std::vector<SortValue> values; // by source row
+    };
+    mutable std::optional<SortValues> sortValues;
 };
 
+std::vector<KeyListFilterEngine::Item>
+KeyListSortFilterProxyModel::Private::collectItems(const KeyListFilterEngine::Input &input, int column, int role, QHash<QModelIndex, qsizetype> &firstChildItems)
+{
+    QAbstractItemModel *const source = q->sourceModel();
+    const auto klm = dynamic_cast<KeyListModelInterface *>(source);
+    const auto alm = dynamic_cast<AbstractKeyListModel *>(source);
+    // the remarks are only needed for matching a non-empty filter
+    const bool withRemarks = alm && !alm->remarkKeys().empty() && !input.filter.pattern().isEmpty();
+    Q_ASSERT(klm);
+
+    std::vector<KeyListFilterEngine::Item> items;
+    firstChildItems.clear();
+    // collect the rows level by level, so that the children of a row are stored consecutively
+    std::vector<std::pair<QModelIndex, qsizetype>> parents{{QModelIndex{}, -1}};
+    for (std::size_t i = 0; i < parents.size(); ++i) {
+        const auto [parent, parentItem] = parents[i];
+        const int rowCount = source->rowCount(parent);
+        if (rowCount == 0) {
+            continue;
+        }
+        firstChildItems.insert(parent, items.size());
+        for (int row = 0; row < rowCount; ++row) {
+            const QModelIndex nameIndex = source->index(row, KeyList::PrettyName, parent);
+            KeyListFilterEngine::Item item;
+            item.key = klm->key(nameIndex);
+            item.userID = nameIndex.data(KeyList::UserIDRole).value<UserID>();
+            item.group = klm->group(nameIndex);
+            item.parent = parentItem;
+            if (input.matchColumn) {
+                item.text = source->index(row, column, parent).data(role).toString();
+            } else if (!item.key.isNull()) {
+                if (input.literal && item.userID.isNull()) {
+                    item.searchText = nameIndex.data(KeyList::SearchTextRole).toString();
+                }
+                if (withRemarks) {
+                    // requesting the remarks schedules loading them if they have not been loaded yet; the search
+                    // text only contains the loaded remarks, but the rows are filtered again when they have been loaded
+                    const QVariant remarks = alm->index(item.key, KeyList::Remarks).data(KeyList::RemarksRole);
+                    if (item.searchText.isNull()) {
+                        item.remarks = remarks.toString();
+                    }
+                }
+            } else if (!item.group.isNull()) {
+                item.text = item.group.name();
+            }
+            items.push_back(std::move(item));
+            const QModelIndex index = source->index(row, 0, parent);
+            if (source->hasChildren(index)) {
+                parents.emplace_back(index, items.size() - 1);
+            }
+        }
+    }
+    return items;
+}
+
+void KeyListSortFilterProxyModel::Private::startFiltering()
+{
+    Q_ASSERT(pendingFilter);
+    pendingFilter->future.cancel();
+
+    if (!dynamic_cast<KeyListModelInterface *>(q->sourceModel())) {
+        const QString text = pendingFilter->text;
+        pendingFilter.reset();
+        q->setFilterFixedString(text);
+        Q_EMIT q->filteringFinished();
+        return;
+    }
+
+    auto input = std::make_shared<KeyListFilterEngine::Input>();
+    input->filter = q->filterRegularExpression();
+    input->filter.setPattern(QRegularExpression::escape(pendingFilter->text));
+    input->literal = KeyListFilterEngine::foldedLiteral(input->filter);
+    pendingFilter->column = q->filterKeyColumn();
+    pendingFilter->role = q->filterRole();
+    input->matchColumn = pendingFilter->column != 0;
+
+    const bool refinesFilterResult = filterResult && filterResult->column == pendingFilter->column && filterResult->role == pendingFilter->role
+        && filterResult->literal && input->literal && input->literal->contains(*filterResult->literal);
+    if (refinesFilterResult) {
+        // a text containing the new search text also contains the previous search text, so that
+        // only the rows matching the previous search text need to be matched
+        input->items = filterResult->items;
+        input->candidates = filterResult->textMatches;
+        pendingFilter->firstChildItems = filterResult->firstChildItems;
+    } else {
+        input->items = std::make_shared<const std::vector<KeyListFilterEngine::Item>>(
+            collectItems(*input, pendingFilter->column, pendingFilter->role, pendingFilter->firstChildItems));
+    }
+
+    pendingFilter->input = input;
+    pendingFilter->future = KeyListFilterEngine::match(input);
+    pendingFilter->future.then(q, [this, input](const std::vector<bool> &textMatches) {
+        if (pendingFilter && pendingFilter->input == input) {
+            publishFilterResult(textMatches);
+        }
+    });
+}
+
+void KeyListSortFilterProxyModel::Private::cancelFiltering()
+{
+    if (pendingFilter) {
+        pendingFilter->future.cancel();
+        pendingFilter.reset();
+    }
+}
+
+bool KeyListSortFilterProxyModel::Private::matchesKeyFilter(const KeyListFilterEngine::Item &item) const
+{
+    if (!item.userID.isNull()) {
+        return keyFilter->matches(item.userID, KeyFilter::Filtering);
+    } else if (!item.key.isNull()) {
+        return keyFilter->matches(item.key, KeyFilter::Filtering);
+    } else if (!item.group.isNull()) {
+        return Kleo::any_of(item.group.keys(), [this](const auto &key) {
+            return keyFilter->matches(key, KeyFilter::Filtering);
+        });
+    }
+    return true;
+}
+
+void KeyListSortFilterProxyModel::Private::publishFilterResult(const std::vector<bool> &textMatches)
+{
+    PendingFilter pending = std::move(*pendingFilter);
+    pendingFilter.reset();
+
+    // the key filters may check the compliance of the keys which requires the GUI thread
+    const std::vector<KeyListFilterEngine::Item> &items = *pending.input->items;
+    std::vector<bool> accepted(items.size());
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        accepted[i] = textMatches[i] && (!keyFilter || matchesKeyFilter(items[i]));
+    }
+    // keep parents of matching children; the items of the children follow the item of their parent
+    for (std::size_t i = items.size(); i-- > 0;) {
+        if (accepted[i] && items[i].parent >= 0) {
+            accepted[items[i].parent] = true;
+        }
+    }
+
+    filterResult = FilterResult{
+        pending.input->filter,
+        pending.input->literal,
+        pending.column,
+        pending.role,
+        keyFilter,
+        pending.input->items,
+        std::move(pending.firstChildItems),
+        textMatches,
+        std::move(accepted),
+    };
+    // update the rows in one go; filterAcceptsRow() looks up the result
+    if (q->filterRegularExpression() == pending.input->filter) {
+        q->invalidateFilter();
+    } else {
+        q->setFilterRegularExpression(pending.input->filter);
+    }
+    Q_EMIT q->filteringFinished();
+}
+
+void KeyListSortFilterProxyModel::Private::dropFilterResult()
+{
+    filterResult.reset();
+}
+
+void KeyListSortFilterProxyModel::Private::sourceModelAboutToChange()
+{
+    // the result and the sort values refer to the rows by position
+    dropFilterResult();
+    sortValues.reset();
+    if (pendingFilter && !restartScheduled) {
+        // match the filter again when the source model has been updated
+        pendingFilter->future.cancel();
+        pendingFilter->input.reset();
+        restartScheduled = true;
+        QMetaObject::invokeMethod(
+            q,
+            [this]() {
+                restartScheduled = false;
+                if (pendingFilter) {
+                    startFiltering();
+                }
+            },
+            Qt::QueuedConnection);
+    }
+}
+
+std::optional<bool> KeyListSortFilterProxyModel::Private::acceptedByFilterResult(int sourceRow, const QModelIndex &sourceParent) const
+{
+    if (!filterResult || filterResult->keyFilter != keyFilter || filterResult->column != q->filterKeyColumn() || filterResult->role != q->filterRole()) {
+        return std::nullopt;
+    }
+    const QRegularExpression filter = q->filterRegularExpression();
+    const bool sameFilter = filterResult->filter == filter;
+    // the rows rejected by a literal filter are also rejected by a literal filter containing its text
+    const bool refinedFilter = !sameFilter && filterResult->literal && literalFilter(filter) && literalFilter(filter)->contains(*filterResult->literal);
+    if (!sameFilter && !refinedFilter) {
+        return std::nullopt;
+    }
+    const auto it = filterResult->firstChildItems.constFind(sourceParent.siblingAtColumn(0));
+    if (it == filterResult->firstChildItems.cend()) {
+        return std::nullopt;
+    }
+    const std::size_t item = *it + sourceRow;
+    if (item >= filterResult->accepted.size()) {
+        return std::nullopt;
+    }
+    if (sameFilter) {
+        return filterResult->accepted[item];
+    }
+    return filterResult->accepted[item] ? std::nullopt : std::optional<bool>{false};
+}
+
+const std::optional<QString> &KeyListSortFilterProxyModel::Private::literalFilter(const QRegularExpression &filter) const
+{
+    if (!(literalFilterSource == filter)) {
+        literalFilterSource = filter;
+        literalFilterText = KeyListFilterEngine::foldedLiteral(filter);
+    }
+    return literalFilterText;
+}
+
+auto KeyListSortFilterProxyModel::Private::sortValue(const QModelIndex &sourceIndex) const -> const SortValue *
+{
+    if (sourceIndex.parent().isValid()) {
+        return nullptr;
+    }
+    const int column = sourceIndex.column();
+    const int role = q->sortRole();
+    const Qt::CaseSensitivity caseSensitivity = q->sortCaseSensitivity();
+    const bool localeAware = q->isSortLocaleAware();
+    if (!sortValues || sortValues->column != column || sortValues->role != role || sortValues->caseSensitivity != caseSensitivity
+        || sortValues->localeAware != localeAware) {
+        // prepare the values of all rows once instead of converting the values for every comparison
+        QAbstractItemModel *const source = q->sourceModel();
+        const int rowCount = source->rowCount();
+        const QCollator collator;
+        sortValues = SortValues{column, role, caseSensitivity, localeAware, {}};
+        sortValues->values.resize(rowCount);
+        for (int row = 0; row < rowCount; ++row) {
+            const QVariant value = source->index(row, column).data(role);
+            if (value.userType() != QMetaType::QString) {
+                continue;
+            }
+            SortValue &sortValue = sortValues->values[row];
+            sortValue.isText = true;
+            if (localeAware) {
+                sortValue.collationKey = collator.sortKey(value.toString());
+            } else {
+                sortValue.text = caseSensitivity == Qt::CaseInsensitive ? value.toString().toCaseFolded() : value.toString();
+            }
+        }
+    }
+    const int row = sourceIndex.row();
+    return row < int(sortValues->values.size()) ? &sortValues->values[row] : nullptr;
+}
+
 KeyListSortFilterProxyModel::KeyListSortFilterProxyModel(QObject *p)
     : AbstractKeyListSortFilterProxyModel(p)
-    , d(new Private)
+    , d(new Private{this})
 {
 }
 
 KeyListSortFilterProxyModel::KeyListSortFilterProxyModel(const KeyListSortFilterProxyModel &other)
     : AbstractKeyListSortFilterProxyModel(other)
-    , d(new Private(*other.d))
+    , d(new Private{this})
 {
+    d->keyFilter = other.d->keyFilter;
 }
 
 KeyListSortFilterProxyModel::~KeyListSortFilterProxyModel()
@@ -172,8 +495,68 @@ void KeyListSortFilterProxyModel::setKeyFilter(const std::shared_ptr<const KeyFi
     invalidate();
 }
 
+void KeyListSortFilterProxyModel::setFilterFixedStringAsync(const QString &text)
+{
+    if (!d->pendingFilter) {
+        d->pendingFilter.emplace();
+    }
+    d->pendingFilter->text = text;
+    if (!d->restartScheduled) {
+        d->startFiltering();
+    }
+}
+
+void KeyListSortFilterProxyModel::setSourceModel(QAbstractItemModel *model)
+{
+    if (model == sourceModel()) {
+        return;
+    }
+    for (const auto &connection : d->sourceModelConnections) {
+        disconnect(connection);
+    }
+    d->sourceModelConnections.clear();
+    d->dropFilterResult();
+    d->sortValues.reset();
+    if (model) {
+        // connect before the base class connects, so that the result of the asynchronous filtering
+        // is dropped before the base class filters the changed rows
+        const auto aboutToChange = [this]() {
+            d->sourceModelAboutToChange();
+        };
+        d->sourceModelConnections = {
+            connect(model, &QAbstractItemModel::dataChanged, this, aboutToChange),
+            connect(model, &QAbstractItemModel::rowsAboutToBeInserted, this, aboutToChange),
+            connect(model, &QAbstractItemModel::rowsAboutToBeRemoved, this, aboutToChange),
+            connect(model, &QAbstractItemModel::rowsAboutToBeMoved, this, aboutToChange),
+            connect(model, &QAbstractItemModel::layoutAboutToBeChanged, this, aboutToChange),
+            connect(model, &QAbstractItemModel::modelAboutToBeReset, this, aboutToChange),
+        };
+    }
+    AbstractKeyListSortFilterProxyModel::setSourceModel(model);
+    if (d->pendingFilter) {
+        d->sourceModelAboutToChange();
+    }
+}
+
+bool KeyListSortFilterProxyModel::lessThan(const QModelIndex &source_left, const QModelIndex &source_right) const
+{
+    const Private::SortValue *const left = d->sortValue(source_left);
+    const Private::SortValue *const right = d->sortValue(source_right);
+    if (!left || !right || !left->isText || !right->isText) {
+        return AbstractKeyListSortFilterProxyModel::lessThan(source_left, source_right);
+    }
+    if (left->collationKey) {
+        return left->collationKey->compare(*right->collationKey) < 0;
+    }
+    return left->text < right->text;
+}
+
 bool KeyListSortFilterProxyModel::filterAcceptsRow(int source_row, const QModelIndex &source_parent) const
 {
+    if (const auto accepted = d->acceptedByFilterResult(source_row, source_parent)) {
+        return *accepted;
+    }
+
     //
     // 0. Keep parents of matching children:
     //
@@ -199,12 +582,25 @@ bool KeyListSortFilterProxyModel::filterAcceptsRow(int source_row, const QModelI
     const KeyGroup group = klm->group(nameIndex);
     Q_ASSERT(!key.isNull() || !group.isNull());
 
+    // literal filters are matched against the search text of the key (if the source model provides it)
+    const std::optional<QString> &literal = d->literalFilter(rx);
+    const QString searchText = (!col && literal && !key.isNull() && userID.isNull()) ? nameIndex.data(KeyList::SearchTextRole).toString() : QString{};
+
     if (col) {
         const QModelIndex colIdx = sourceModel()->index(source_row, col, source_parent);
         const QString content = colIdx.data(role).toString();
         if (!content.contains(rx)) {
             return false;
         }
+    } else if (!searchText.isNull()) {
+        if (!searchText.contains(*literal)) {
+            if (const auto alm = dynamic_cast<AbstractKeyListModel *>(sourceModel())) {
+                // the search text only contains the loaded remarks; request the remarks, so that
+                // they are loaded and the row is filtered again if they have not been loaded yet
+                alm->index(key, KeyList::Remarks).data(KeyList::RemarksRole);
+            }
+            return false;
+        }
     } else if (!key.isNull()) {
         // By default match against the full uid data (name / email / comment / dn)
         bool match = false;
@@ -227,7 +623,8 @@ bool KeyListSortFilterProxyModel::filterAcceptsRow(int source_row, const QModelI
             // Also match against remarks (search tags)
             const auto alm = dynamic_cast<AbstractKeyListModel *>(sourceModel());
             if (alm) {
-                const auto remarks = alm->data(alm->index(key, KeyList::Remarks));
+                // the row is filtered again when the remarks have been loaded
+                const auto remarks = alm->index(key, KeyList::Remarks).data(KeyList::RemarksRole);
                 if (!remarks.isNull() && remarks.toString().contains(rx)) {
                     match = true;
                 }
@@ -66,10 +66,27 @@ public:
     std::shared_ptr<const KeyFilter> keyFilter() const;
     void setKeyFilter(const std::shared_ptr<const KeyFilter> &kf);
 
+    /**
+     * Filters the rows by @p text like setFilterFixedString(), but matches the
+     * text against the rows in worker threads. The filtered rows are updated at
+     * once when all rows have been matched; until then the rows accepted by the
+     * current filter are shown. The key filter is applied to the matching rows
+     * in the GUI thread.
+     *
+     * filteringFinished() is emitted after the rows have been updated.
+     */
+    void setFilterFixedStringAsync(const QString &text);
+
     KeyListSortFilterProxyModel *clone() const override;
 
+    void setSourceModel(QAbstractItemModel *sourceModel) override;
+
+Q_SIGNALS:
+    void filteringFinished();
+
 protected:
     bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const override;
+    bool lessThan(const QModelIndex &source_left, const QModelIndex &source_right) const override;
 
 private:
     class Private;
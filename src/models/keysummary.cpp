@@ -0,0 +1,42 @@
+/*
+    models/keysummary.cpp
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-libkleo.h>
+
+#include "keysummary.h"
+
+#include "keycacheindex_p.h"
+
+using namespace Kleo;
+using namespace GpgME;
+
+KeySummary KeySummary::fromKey(const Key &key)
+{
+    KeySummary summary;
+    summary.fingerprint = key.primaryFingerprint() ? key.primaryFingerprint() : "";
+    summary.keyID = key.keyID() ? key.keyID() : "";
+    summary.protocol = key.protocol();
+    summary.flags.setFlag(Revoked, key.isRevoked());
+    summary.flags.setFlag(Expired, key.isExpired());
+    summary.flags.setFlag(Disabled, key.isDisabled());
+    summary.flags.setFlag(Invalid, key.isInvalid());
+    summary.flags.setFlag(HasSecret, key.hasSecret());
+    summary.flags.setFlag(CanEncrypt, key.canEncrypt());
+    summary.flags.setFlag(CanSign, key.canSign());
+    summary.flags.setFlag(CanCertify, key.canCertify());
+    summary.flags.setFlag(CanAuthenticate, key.canAuthenticate());
+    if (key.numUserIDs() > 0) {
+        summary.validity = key.userID(0).validity();
+    }
+    if (!key.subkey(0).neverExpires()) {
+        summary.expirationTime = key.subkey(0).expirationTime();
+    }
+    summary.emails = KeyCacheIndex::emails(key);
+    return summary;
+}
@@ -0,0 +1,61 @@
+/*
+    models/keysummary.h
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include "kleo_export.h"
+
+#include <QFlags>
+
+#include <gpgme++/key.h>
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+namespace Kleo
+{
+
+/**
+ * The properties of a key which are kept by the key cache in light mode.
+ *
+ * A summary contains the fields needed for finding and filtering keys. Use
+ * KeyCache::findByFingerprint() to get the full key.
+ */
+struct KLEO_EXPORT KeySummary {
+    enum Flag {
+        // clang-format off
+        NoFlags         = 0x000,
+        Revoked         = 0x001,
+        Expired         = 0x002,
+        Disabled        = 0x004,
+        Invalid         = 0x008,
+        HasSecret       = 0x010,
+        CanEncrypt      = 0x020,
+        CanSign         = 0x040,
+        CanCertify      = 0x080,
+        CanAuthenticate = 0x100,
+        // clang-format on
+    };
+    Q_DECLARE_FLAGS(Flags, Flag)
+
+    static KeySummary fromKey(const GpgME::Key &key);
+
+    std::string fingerprint;
+    std::string keyID;
+    GpgME::Protocol protocol = GpgME::UnknownProtocol;
+    Flags flags;
+    GpgME::UserID::Validity validity = GpgME::UserID::Unknown; //< the validity of the primary user ID
+    time_t expirationTime = 0; //< the expiration time of the primary key; 0 if the key does not expire
+    std::vector<std::string> emails; //< the normalized email addresses of the user IDs
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(KeySummary::Flags)
+
+}
@@ -0,0 +1,211 @@
+/*
+    models/remarksloader.cpp
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-libkleo.h>
+
+#include "remarksloader_p.h"
+
+#include <libkleo/formatting.h>
+
+#include <libkleo_debug.h>
+
+#include <QGpgME/KeyListJob>
+#include <QGpgME/Protocol>
+
+#include <QTimer>
+
+#include <gpgme++/context.h>
+#include <gpgme++/keylistresult.h>
+
+using namespace Kleo;
+using namespace GpgME;
+
+namespace
+{
+static constexpr qsizetype batchSize = 100;
+
+QByteArray rawFingerprint(const Key &key)
+{
+    const char *const fpr = key.primaryFingerprint();
+    return fpr ? QByteArray::fromRawData(fpr, qstrlen(fpr)) : QByteArray{};
+}
+
+QString joinedRemarks(const Key &key, const std::vector<Key> &remarkKeys)
+{
+    Error err;
+    const auto remarks = key.userID(0).remarks(remarkKeys, err);
+    QStringList remarkList;
+    remarkList.reserve(remarks.size());
+    for (const auto &rem : remarks) {
+        remarkList << QString::fromStdString(rem);
+    }
+    return remarkList.join(QStringLiteral("; "));
+}
+}
+
+RemarksLoader::RemarksLoader(QObject *parent)
+    : QObject{parent}
+{
+}
+
+RemarksLoader::~RemarksLoader()
+{
+    cancelBatch();
+}
+
+void RemarksLoader::setRemarkKeys(const std::vector<Key> &keys)
+{
+    clear();
+    m_remarkKeys = keys;
+}
+
+const std::vector<Key> &RemarksLoader::remarkKeys() const
+{
+    return m_remarkKeys;
+}
+
+std::optional<QString> RemarksLoader::remarks(const Key &key)
+{
+    const QByteArray fpr = rawFingerprint(key);
+    if (fpr.isEmpty()) {
+        return std::nullopt;
+    }
+    const auto it = m_remarks.constFind(fpr);
+    if (it != m_remarks.cend()) {
+        if (it->key.impl() == key.impl()) {
+            return it->text;
+        }
+        // the key has been updated; the certifications may have changed
+        m_remarks.erase(it);
+    }
+    if (key.keyListMode() & GpgME::SignatureNotations) {
+        // the key has been listed with the signature notations
+        return m_remarks.insert(QByteArray{fpr}, Remarks{key, joinedRemarks(key, m_remarkKeys)})->text;
+    }
+    if (!m_requestedKeys.contains(fpr)) {
+        m_requestedKeys.insert(QByteArray{fpr}, key);
+        m_queue.push_back(QString::fromLatin1(fpr));
+        scheduleNextBatch();
+    }
+    return std::nullopt;
+}
+
+std::optional<QString> RemarksLoader::loadedRemarks(const Key &key) const
+{
+    const auto it = m_remarks.constFind(rawFingerprint(key));
+    if (it != m_remarks.cend() && it->key.impl() == key.impl()) {
+        return it->text;
+    }
+    if (key.keyListMode() & GpgME::SignatureNotations) {
+        return joinedRemarks(key, m_remarkKeys);
+    }
+    return std::nullopt;
+}
+
+void RemarksLoader::forget(const Key &key)
+{
+    m_remarks.remove(rawFingerprint(key));
+}
+
+void RemarksLoader::clear()
+{
+    cancelBatch();
+    m_remarks.clear();
+    m_requestedKeys.clear();
+    m_queue.clear();
+}
+
+void RemarksLoader::scheduleNextBatch()
+{
+    if (m_batchScheduled || m_job || m_queue.empty()) {
+        return;
+    }
+    // collect the requests made until control returns to the event loop, e.g. for all visible rows
+    m_batchScheduled = true;
+    QTimer::singleShot(0, this, [this]() {
+        m_batchScheduled = false;
+        startNextBatch();
+    });
+}
+
+void RemarksLoader::startNextBatch()
+{
+    if (m_job || m_queue.empty()) {
+        return;
+    }
+    m_batch = m_queue.mid(0, batchSize);
+    m_queue.remove(0, m_batch.size());
+    m_listedKeys.clear();
+
+    QGpgME::KeyListJob *const job = QGpgME::openpgp()->keyListJob(/*remote*/ false, /*includeSigs*/ true, /*validate*/ true);
+    if (auto ctx = QGpgME::Job::context(job)) {
+        ctx->addKeyListMode(KeyListMode::Signatures | KeyListMode::SignatureNotations);
+    }
+    connect(job, &QGpgME::KeyListJob::nextKey, this, [this](const Key &key) {
+        m_listedKeys.push_back(key);
+    });
+    connect(job, &QGpgME::KeyListJob::result, this, [this](const KeyListResult &result) {
+        batchDone(result);
+    });
+    const Error err = job->start(m_batch, /*secretOnly*/ false);
+    if (err) {
+        qCDebug(LIBKLEO_LOG) << __func__ << "Listing the keys with signature notations failed:" << Formatting::errorAsString(err);
+        batchDone(KeyListResult{err});
+        return;
+    }
+    m_job = job;
+}
+
+void RemarksLoader::batchDone(const KeyListResult &result)
+{
+    m_job.clear();
+    if (result.error() && !result.error().isCanceled()) {
+        qCDebug(LIBKLEO_LOG) << __func__ << "Listing the keys with signature notations failed:" << Formatting::errorAsString(result.error());
+    }
+    QHash<QByteArray, QString> listedRemarks;
+    for (const Key &key : m_listedKeys) {
+        listedRemarks.insert(QByteArray{key.primaryFingerprint()}, joinedRemarks(key, m_remarkKeys));
+    }
+    m_listedKeys.clear();
+
+    std::vector<Key> loadedKeys;
+    loadedKeys.reserve(m_batch.size());
+    for (const QString &fpr : std::as_const(m_batch)) {
+        const QByteArray fprBytes = fpr.toLatin1();
+        const auto it = m_requestedKeys.constFind(fprBytes);
+        if (it == m_requestedKeys.cend()) {
+            continue;
+        }
+        loadedKeys.push_back(*it);
+        // remember the requested version of the key (not the listed one), so that the remarks
+        // are loaded again after the key has been updated; keys which were not listed
+        // get empty remarks, so that they are not requested again
+        m_remarks.insert(fprBytes, Remarks{*it, listedRemarks.value(fprBytes)});
+        m_requestedKeys.erase(it);
+    }
+    m_batch.clear();
+
+    scheduleNextBatch();
+    if (!loadedKeys.empty()) {
+        Q_EMIT remarksLoaded(loadedKeys);
+    }
+}
+
+void RemarksLoader::cancelBatch()
+{
+    if (m_job) {
+        disconnect(m_job, nullptr, this, nullptr);
+        m_job->slotCancel();
+        m_job.clear();
+    }
+    m_batch.clear();
+    m_listedKeys.clear();
+}
+
+#include "moc_remarksloader_p.cpp"
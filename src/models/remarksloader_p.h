@@ -0,0 +1,94 @@
+/*
+    models/remarksloader_p.h
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QStringList>
+
+#include <gpgme++/key.h>
+
+#include <optional>
+#include <vector>
+
+namespace GpgME
+{
+class KeyListResult;
+}
+
+namespace QGpgME
+{
+class KeyListJob;
+}
+
+namespace Kleo
+{
+
+/**
+ * Loads the remarks of OpenPGP keys, i.e. the signature notations of the
+ * certifications made with the remark keys, in the background.
+ *
+ * Listing all keys with signatures and signature notations is slow. Therefore,
+ * only the keys whose remarks are requested are listed. The requests are
+ * collected until control returns to the event loop. Then the keys are listed
+ * in batches, with one key listing job at a time.
+ */
+class RemarksLoader : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RemarksLoader(QObject *parent = nullptr);
+    ~RemarksLoader() override;
+
+    /** Sets the keys whose certifications provide the remarks. Forgets all loaded remarks. */
+    void setRemarkKeys(const std::vector<GpgME::Key> &keys);
+    const std::vector<GpgME::Key> &remarkKeys() const;
+
+    /**
+     * Returns the remarks of @p key joined by a semicolon and a space if they
+     * have been loaded for this version of the key. Otherwise, schedules
+     * loading the remarks and returns std::nullopt.
+     */
+    std::optional<QString> remarks(const GpgME::Key &key);
+    /** Like remarks(), but does not schedule loading the remarks. */
+    std::optional<QString> loadedRemarks(const GpgME::Key &key) const;
+
+    void forget(const GpgME::Key &key);
+    void clear();
+
+Q_SIGNALS:
+    /** Emitted when the remarks of @p keys have been loaded. */
+    void remarksLoaded(const std::vector<GpgME::Key> &keys);
+
+private:
+    void scheduleNextBatch();
+    void startNextBatch();
+    void batchDone(const GpgME::KeyListResult &result);
+    void cancelBatch();
+
+private:
+    std::vector<GpgME::Key> m_remarkKeys;
+    struct Remarks {
+        GpgME::Key key; // the version of the key the remarks were loaded for
+        QString text;
+    };
+    QHash<QByteArray, Remarks> m_remarks; // by fingerprint
+    QHash<QByteArray, GpgME::Key> m_requestedKeys; // keys which are queued or listed, by fingerprint
+    QStringList m_queue;
+    QStringList m_batch;
+    std::vector<GpgME::Key> m_listedKeys;
+    QPointer<QGpgME::KeyListJob> m_job;
+    bool m_batchScheduled = false;
+};
+
+}
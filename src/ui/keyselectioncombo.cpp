@@ -23,12 +23,15 @@
 #include <KLocalizedString>
 
 #include <QAbstractProxyModel>
+#include <QCollator>
 #include <QList>
 #include <QSortFilterProxyModel>
 #include <QTimer>
 
 #include <gpgme++/key.h>
 
+#include <numeric>
+
 using namespace Kleo;
 
 #if !UNITY_BUILD
@@ -98,62 +101,117 @@ public:
     {
     }
 
+    void setSourceModel(QAbstractItemModel *model) override
+    {
+        if (model == sourceModel()) {
+            return;
+        }
+        for (const auto &connection : mSourceModelConnections) {
+            disconnect(connection);
+        }
+        mSourceModelConnections.clear();
+        mSortKeysValid = false;
+        if (model) {
+            // connect before the base class connects, so that the sort keys are outdated before the changed rows are sorted
+            const auto invalidateSortKeys = [this]() {
+                mSortKeysValid = false;
+            };
+            mSourceModelConnections = {
+                connect(model, &QAbstractItemModel::dataChanged, this, invalidateSortKeys),
+                connect(model, &QAbstractItemModel::rowsInserted, this, invalidateSortKeys),
+                connect(model, &QAbstractItemModel::rowsRemoved, this, invalidateSortKeys),
+                connect(model, &QAbstractItemModel::rowsMoved, this, invalidateSortKeys),
+                connect(model, &QAbstractItemModel::layoutChanged, this, invalidateSortKeys),
+                connect(model, &QAbstractItemModel::modelReset, this, invalidateSortKeys),
+            };
+        }
+        QSortFilterProxyModel::setSourceModel(model);
+    }
+
 private:
+    struct SortKey {
+        GpgME::Key key;
+        bool hasUserID = false;
+        quint32 nameRank = 0; // the position of the formatted name and email address in the locale-aware order
+        GpgME::UserID::Validity validity = GpgME::UserID::Unknown;
+        time_t creationTime = 0; // the newest creation time of the good subkeys
+    };
+
+    void ensureSortKeys() const
+    {
+        if (mSortKeysValid) {
+            return;
+        }
+        // compute the sort keys of all rows once instead of formatting the user IDs for every comparison
+        const int rowCount = sourceModel()->rowCount();
+        const QCollator collator;
+        std::vector<QCollatorSortKey> names;
+        names.reserve(rowCount);
+        mSortKeys.assign(rowCount, SortKey{});
+        for (int row = 0; row < rowCount; ++row) {
+            SortKey &sortKey = mSortKeys[row];
+            sortKey.key = sourceModel()->data(sourceModel()->index(row, 0), KeyList::KeyRole).value<GpgME::Key>();
+            // As we display UID(0) this is ok. We probably need a get Best UID at some point.
+            const auto uid = sortKey.key.userID(0);
+            sortKey.hasUserID = !sortKey.key.isNull() && !uid.isNull();
+            names.push_back(collator.sortKey(sortKey.hasUserID ? formatUserID(sortKey.key) : QString{}));
+            if (!sortKey.hasUserID) {
+                continue;
+            }
+            sortKey.validity = uid.validity();
+            for (const GpgME::Subkey &s : sortKey.key.subkeys()) {
+                if (!s.isBad() && s.creationTime() > sortKey.creationTime) {
+                    sortKey.creationTime = s.creationTime();
+                }
+            }
+        }
+        std::vector<int> order(rowCount);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&names](int lhs, int rhs) {
+            return names[lhs].compare(names[rhs]) < 0;
+        });
+        quint32 rank = 0;
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            if (i > 0 && names[order[i - 1]].compare(names[order[i]]) != 0) {
+                ++rank;
+            }
+            mSortKeys[order[i]].nameRank = rank;
+        }
+        mSortKeysValid = true;
+    }
+
     bool lessThan(const QModelIndex &left, const QModelIndex &right) const override
     {
-        const auto leftKey = sourceModel()->data(left, KeyList::KeyRole).value<GpgME::Key>();
-        const auto rightKey = sourceModel()->data(right, KeyList::KeyRole).value<GpgME::Key>();
-        if (leftKey.isNull()) {
+        ensureSortKeys();
+        const SortKey &l = mSortKeys[left.row()];
+        const SortKey &r = mSortKeys[right.row()];
+        if (l.key.isNull()) {
             return false;
         }
-        if (rightKey.isNull()) {
+        if (r.key.isNull()) {
             return true;
         }
-        // As we display UID(0) this is ok. We probably need a get Best UID at some point.
-        const auto lUid = leftKey.userID(0);
-        const auto rUid = rightKey.userID(0);
-        if (lUid.isNull()) {
+        if (!l.hasUserID) {
             return false;
         }
-        if (rUid.isNull()) {
+        if (!r.hasUserID) {
             return true;
         }
-        const auto leftNameAndEmail = formatUserID(leftKey);
-        const auto rightNameAndEmail = formatUserID(rightKey);
-        const int cmp = QString::localeAwareCompare(leftNameAndEmail, rightNameAndEmail);
-        if (cmp) {
-            return cmp < 0;
+        if (l.nameRank != r.nameRank) {
+            return l.nameRank < r.nameRank;
         }
 
-        if (lUid.validity() != rUid.validity()) {
-            return lUid.validity() > rUid.validity();
+        if (l.validity != r.validity) {
+            return l.validity > r.validity;
         }
 
         /* Both have the same validity, check which one is newer. */
-        time_t leftTime = 0;
-        for (const GpgME::Subkey &s : leftKey.subkeys()) {
-            if (s.isBad()) {
-                continue;
-            }
-            if (s.creationTime() > leftTime) {
-                leftTime = s.creationTime();
-            }
-        }
-        time_t rightTime = 0;
-        for (const GpgME::Subkey &s : rightKey.subkeys()) {
-            if (s.isBad()) {
-                continue;
-            }
-            if (s.creationTime() > rightTime) {
-                rightTime = s.creationTime();
-            }
-        }
-        if (rightTime != leftTime) {
-            return leftTime > rightTime;
+        if (l.creationTime != r.creationTime) {
+            return l.creationTime > r.creationTime;
         }
 
         // as final resort we compare the fingerprints
-        return strcmp(leftKey.primaryFingerprint(), rightKey.primaryFingerprint()) < 0;
+        return strcmp(l.key.primaryFingerprint(), r.key.primaryFingerprint()) < 0;
     }
 
 protected:
@@ -202,6 +260,9 @@ protected:
 
 private:
     Formatting::IconProvider mIconProvider;
+    std::vector<QMetaObject::Connection> mSourceModelConnections;
+    mutable std::vector<SortKey> mSortKeys; // by source row
+    mutable bool mSortKeysValid = false;
 };
 
 class CustomItemsProxyModel : public QAbstractProxyModel
@@ -0,0 +1,167 @@
+/*
+    utils/keystate.cpp
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-libkleo.h>
+
+#include "keystate_p.h"
+
+#include "compliance.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QReadLocker>
+#include <QReadWriteLock>
+#include <QWriteLocker>
+
+#include <gpgme++/key.h>
+
+#include <algorithm>
+#include <functional>
+
+using namespace Kleo;
+using namespace GpgME;
+
+namespace
+{
+struct Entry {
+    Key key; // the version of the key the state was computed for
+    quint32 state;
+    // IsDeVs is computed on demand; it's only meaningful if computed while the compliance mode was active
+    bool deVsComputed = false;
+};
+
+struct States {
+    QReadWriteLock lock;
+    QHash<QByteArray, Entry> entries; // by fingerprint
+};
+
+States &states()
+{
+    static States s;
+    return s;
+}
+
+QByteArray rawFingerprint(const Key &key)
+{
+    const char *const fpr = key.primaryFingerprint();
+    return fpr ? QByteArray::fromRawData(fpr, qstrlen(fpr)) : QByteArray{};
+}
+
+quint32 computeState(const Key &key, bool deVsComplianceActive, quint32 relevantFlags = ~0u)
+{
+    const auto subkeys = key.subkeys();
+    const bool isCardKey = std::any_of(subkeys.begin(), subkeys.end(), std::mem_fn(&Subkey::isCardKey));
+    const bool isBad = key.isNull() || key.isRevoked() || key.isExpired() || key.isDisabled() || key.isInvalid();
+    // the compliance check is comparatively expensive
+    const bool isDeVs = (relevantFlags & KeyState::IsDeVs) && (!deVsComplianceActive || DeVSCompliance::keyIsCompliant(key));
+
+    quint32 state = 0;
+    const auto set = [&state](KeyState::Flag flag, bool on) {
+        if (on) {
+            state |= flag;
+        }
+    };
+    set(KeyState::Revoked, key.isRevoked());
+    set(KeyState::Expired, key.isExpired());
+    set(KeyState::Invalid, key.isInvalid());
+    set(KeyState::Disabled, key.isDisabled());
+    set(KeyState::Root, key.isRoot());
+    set(KeyState::CanEncrypt, key.canEncrypt());
+    set(KeyState::CanSign, key.canSign());
+    set(KeyState::CanCertify, key.canCertify());
+    set(KeyState::CanAuthenticate, key.canAuthenticate());
+    set(KeyState::HasEncrypt, key.hasEncrypt());
+    set(KeyState::HasSign, key.hasSign());
+    set(KeyState::HasCertify, key.hasCertify());
+    set(KeyState::HasAuthenticate, key.hasAuthenticate());
+    set(KeyState::Qualified, key.isQualified());
+    set(KeyState::CardKey, isCardKey);
+    set(KeyState::HasSecret, key.hasSecret());
+    set(KeyState::IsOpenPGP, key.protocol() == GpgME::OpenPGP);
+    set(KeyState::WasValidated, key.keyListMode() & GpgME::Validate);
+    set(KeyState::IsDeVs, isDeVs);
+    set(KeyState::Bad, isBad);
+    return state;
+}
+}
+
+quint32 KeyState::of(const Key &key, quint32 relevantFlags)
+{
+    // the compliance mode may change at any time, so that it is checked on every call
+    const bool deVsRelevant = relevantFlags & KeyState::IsDeVs;
+    const bool deVsComplianceActive = deVsRelevant && DeVSCompliance::isActive();
+    bool known = false;
+    {
+        const QReadLocker locker{&states().lock};
+        const auto it = states().entries.constFind(rawFingerprint(key));
+        if (it != states().entries.cend() && it->key.impl() == key.impl()) {
+            if (!deVsRelevant) {
+                return it->state;
+            }
+            if (!deVsComplianceActive) {
+                // all keys are compliant if the compliance mode is not active, regardless of a previously computed IsDeVs
+                return it->state | KeyState::IsDeVs;
+            }
+            if (it->deVsComputed) {
+                return it->state;
+            }
+            known = true;
+        }
+    }
+    if (!known) {
+        return computeState(key, deVsComplianceActive, relevantFlags);
+    }
+    // compute the comparatively expensive compliance of the key only once
+    const bool isDeVs = DeVSCompliance::keyIsCompliant(key);
+    const QWriteLocker locker{&states().lock};
+    const auto it = states().entries.find(rawFingerprint(key));
+    if (it == states().entries.end() || it->key.impl() != key.impl()) {
+        // the key has been updated or forgotten in the meantime
+        return computeState(key, deVsComplianceActive, relevantFlags);
+    }
+    if (isDeVs) {
+        it->state |= KeyState::IsDeVs;
+    }
+    it->deVsComputed = true;
+    return it->state;
+}
+
+void KeyState::update(const std::vector<Key> &keys)
+{
+    if (keys.empty()) {
+        return;
+    }
+    std::vector<std::pair<QByteArray, Entry>> newEntries;
+    newEntries.reserve(keys.size());
+    for (const Key &key : keys) {
+        if (const char *const fpr = key.primaryFingerprint()) {
+            // IsDeVs is computed when it's needed for the first time
+            newEntries.emplace_back(QByteArray{fpr}, Entry{key, computeState(key, false, ~quint32(KeyState::IsDeVs))});
+        }
+    }
+    const QWriteLocker locker{&states().lock};
+    states().entries.reserve(states().entries.size() + newEntries.size());
+    for (auto &[fpr, entry] : newEntries) {
+        states().entries.insert(fpr, std::move(entry));
+    }
+}
+
+void KeyState::forget(const std::vector<Key> &keys)
+{
+    const QWriteLocker locker{&states().lock};
+    for (const Key &key : keys) {
+        states().entries.remove(rawFingerprint(key));
+    }
+}
+
+void KeyState::clear()
+{
+    const QWriteLocker locker{&states().lock};
+    states().entries.clear();
+}
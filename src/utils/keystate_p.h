@@ -0,0 +1,73 @@
+/*
+    utils/keystate_p.h
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <QtGlobal>
+
+#include <vector>
+
+namespace GpgME
+{
+class Key;
+}
+
+namespace Kleo
+{
+
+/**
+ * The boolean properties of a key checked by the key filters packed into a bitset.
+ *
+ * The key cache computes the states of its keys when they are inserted, so that
+ * the key filters do not need to query the properties of the keys again and again.
+ * The de-vs compliance (IsDeVs) depends on the current compliance mode and is
+ * comparatively expensive to compute. Therefore, it's computed when it's needed
+ * for the first time while the compliance mode is active.
+ */
+namespace KeyState
+{
+enum Flag : quint32 {
+    // clang-format off
+    Revoked         = 1u << 0,
+    Expired         = 1u << 1,
+    Invalid         = 1u << 2,
+    Disabled        = 1u << 3,
+    Root            = 1u << 4,
+    CanEncrypt      = 1u << 5,
+    CanSign         = 1u << 6,
+    CanCertify      = 1u << 7,
+    CanAuthenticate = 1u << 8,
+    HasEncrypt      = 1u << 9,
+    HasSign         = 1u << 10,
+    HasCertify      = 1u << 11,
+    HasAuthenticate = 1u << 12,
+    Qualified       = 1u << 13,
+    CardKey         = 1u << 14,
+    HasSecret       = 1u << 15,
+    IsOpenPGP       = 1u << 16,
+    WasValidated    = 1u << 17,
+    IsDeVs          = 1u << 18,
+    Bad             = 1u << 19,
+    // clang-format on
+};
+
+/**
+ * Returns the state of @p key. Uses the state computed by update() if available.
+ * Otherwise, only the flags in @p relevantFlags are computed. Requires the main
+ * thread if @p relevantFlags contains IsDeVs or if the state isn't available.
+ */
+quint32 of(const GpgME::Key &key, quint32 relevantFlags = ~0u);
+
+/** Computes and remembers the states of @p keys except for IsDeVs. */
+void update(const std::vector<GpgME::Key> &keys);
+void forget(const std::vector<GpgME::Key> &keys);
+void clear();
+}
+
+}
@@ -0,0 +1,53 @@
+/*
+    utils/parallel_p.h
+
+    This file is part of libkleopatra, the KDE keymanagement library
+    SPDX-FileCopyrightText: 2026 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <QSemaphore>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+namespace Kleo
+{
+
+/**
+ * Calls @p f with consecutive ranges [begin, end) covering the indexes [0, count).
+ *
+ * Large counts are split into chunks which are also processed by idle threads of
+ * the global thread pool. Only idle threads are used, so that the calling thread
+ * never waits for other tasks of the thread pool. Returns when all chunks have
+ * been processed.
+ */
+template<typename F>
+void forEachChunkInParallel(std::size_t count, F f)
+{
+    static constexpr std::size_t chunkSize = 256;
+    const std::size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+    std::atomic<std::size_t> nextChunk = 0;
+    const auto work = [&nextChunk, &f, count, chunkCount]() {
+        for (std::size_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++) {
+            f(chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+        }
+    };
+    QSemaphore finishedWorkers;
+    int workerCount = 0;
+    while (std::size_t(workerCount + 1) < chunkCount && QThreadPool::globalInstance()->tryStart([&work, &finishedWorkers]() {
+        work();
+        finishedWorkers.release();
+    })) {
+        ++workerCount;
+    }
+    work();
+    finishedWorkers.acquire(workerCount);
+}
+
+}